@@ -531,6 +531,15 @@ typedef enum
 #define LOG_SKIPPED     0x200 /* Log skipped bugs */
 #define FIND_BAD_COMBOS 0x400 /* Attempt to deduce bad combos */
 #define LIST_COMBOS     0x800 /* List combos by name */
+#define PARALLEL       0x1000 /* Use the parallel read and write options */
+#define ROWS_INTO      0x2000 /* Compare png_read_rows_into and png_read_image */
+#define REGION         0x4000 /* Compare reads of regions with the whole image */
+#define PULL           0x8000 /* Compare png_pull_row and png_read_image */
+#define PROBE         0x10000 /* Test png_read_probe with a range of limits */
+#define READ_MEMORY   0x20000 /* Compare png_set_read_memory and png_read_fn */
+#define CODEC         0x40000 /* Write and read with each deflate codec */
+#define QUANTIZE      0x80000 /* Compare serial and parallel png_set_quantize */
+#define GAMMA_CACHE  0x100000 /* Compare reads with PNG_GAMMA_CACHE on, off */
 
 /* Result masks apply to the result bits in the 'results' field below; these
  * bits are simple 1U<<error_level.  A pass requires either nothing worse than
@@ -582,10 +591,23 @@ struct display
 #  ifdef PNG_WRITE_PNG_SUPPORTED
       /* Used to write a new image (the original info_ptr is used) */
       png_structp   write_pp;
+      png_infop     write_ip;       /* only if the original is not used */
       struct buffer written_file;   /* where the file gets written */
 #  endif
 
    struct buffer  original_file;     /* Data read from the original file */
+
+   /* Used by the tests of the other read APIs, freed by display_clean */
+   png_bytep      api_result;        /* from the API being tested */
+   png_bytep      api_reference;     /* to compare api_result with */
+   png_bytepp     api_rows;          /* row pointers into api_result */
+   png_bytep      api_file;          /* original_file in one piece */
+
+#  ifdef PNG_DEFLATE_CODEC_SUPPORTED
+      /* Passed to png_set_deflate_codec by read_png and write_png */
+      int         read_codec;
+      int         write_codec;
+#  endif
 };
 
 static void
@@ -604,10 +626,19 @@ display_init(struct display *dp)
    dp->original_rows = NULL;
    dp->read_pp = NULL;
    dp->read_ip = NULL;
+   dp->api_result = NULL;
+   dp->api_reference = NULL;
+   dp->api_rows = NULL;
+   dp->api_file = NULL;
    buffer_init(&dp->original_file);
 
+#  ifdef PNG_DEFLATE_CODEC_SUPPORTED
+      dp->read_codec = dp->write_codec = PNG_DEFLATE_CODEC_STREAM;
+#  endif
+
 #  ifdef PNG_WRITE_PNG_SUPPORTED
       dp->write_pp = NULL;
+      dp->write_ip = NULL;
       buffer_init(&dp->written_file);
 #  endif
 }
@@ -624,7 +655,7 @@ static void
 display_clean_write(struct display *dp)
 {
       if (dp->write_pp != NULL)
-         png_destroy_write_struct(&dp->write_pp, NULL);
+         png_destroy_write_struct(&dp->write_pp, &dp->write_ip);
 }
 #endif
 
@@ -641,6 +672,12 @@ display_clean(struct display *dp)
    dp->chunks = 0;
 
    png_destroy_read_struct(&dp->original_pp, &dp->original_ip, NULL);
+
+   free(dp->api_result), dp->api_result = NULL;
+   free(dp->api_reference), dp->api_reference = NULL;
+   free(dp->api_rows), dp->api_rows = NULL;
+   free(dp->api_file), dp->api_file = NULL;
+
    /* leave the filename for error detection */
    dp->results = 0; /* reset for next time */
 }
@@ -866,6 +903,21 @@ read_function(png_structp pp, png_bytep data, size_t size)
    buffer_read(get_dp(pp), get_buffer(pp), data, size);
 }
 
+#ifdef PNG_PARALLEL_SUPPORTED
+/* This runs the jobs in reverse order to check that the results do not depend
+ * on the order.
+ */
+static void PNGCBAPI
+parallel_function(png_structp pp, png_parallel_job_ptr job, png_voidp job_arg,
+   png_uint_32 job_count)
+{
+   while (job_count > 0)
+      job(job_arg, --job_count);
+
+   (void)pp;
+}
+#endif
+
 static void
 read_png(struct display *dp, struct buffer *bp, const char *operation,
    int transforms)
@@ -901,6 +953,20 @@ read_png(struct display *dp, struct buffer *bp, const char *operation,
       png_set_user_limits(pp, 0x7fffffff, 0x7fffffff);
 #  endif
 
+#  ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+      if (dp->options & PARALLEL)
+      {
+         png_set_option(pp, PNG_PARALLEL_INFLATE, PNG_OPTION_ON);
+         png_set_parallel_fn(pp, NULL, parallel_function);
+      }
+#  endif
+
+#  ifdef PNG_DEFLATE_CODEC_SUPPORTED
+      if (png_set_deflate_codec(pp, dp->read_codec) == 0)
+         display_log(dp, LIBPNG_ERROR, "deflate codec %d not available",
+            dp->read_codec);
+#  endif
+
    /* Set the IO handling */
    buffer_start_read(bp);
    png_set_read_fn(pp, bp, read_function);
@@ -1356,6 +1422,21 @@ write_png(struct display *dp, png_infop ip, int transforms)
       png_set_user_limits(dp->write_pp, 0x7fffffff, 0x7fffffff);
 #  endif
 
+#  ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+      /* Use very small bands so that the PngSuite images have several. */
+      if (dp->options & PARALLEL)
+      {
+         png_set_compression_bands(dp->write_pp, 3/*rows*/, 2/*jobs*/);
+         png_set_parallel_fn(dp->write_pp, NULL, parallel_function);
+      }
+#  endif
+
+#  ifdef PNG_DEFLATE_CODEC_SUPPORTED
+      if (png_set_deflate_codec(dp->write_pp, dp->write_codec) == 0)
+         display_log(dp, LIBPNG_ERROR, "deflate codec %d not available",
+            dp->write_codec);
+#  endif
+
    /* Certain transforms require the png_info to be zapped to allow the
     * transform to work correctly.
     */
@@ -1382,6 +1463,82 @@ write_png(struct display *dp, png_infop ip, int transforms)
 }
 #endif /* WRITE_PNG */
 
+#if defined(PNG_DEFLATE_CODEC_SUPPORTED) && defined(PNG_WRITE_PNG_SUPPORTED)
+static int
+codec_available(struct display *dp, int codec)
+   /* Return 1 if png_set_deflate_codec accepts 'codec', 0 if it does not but
+    * this build need not have it (libdeflate is a build option).
+    */
+{
+   int ok;
+   png_structp pp = png_create_read_struct(PNG_LIBPNG_VER_STRING, dp,
+      display_error, display_warning);
+
+   if (pp == NULL)
+      display_log(dp, LIBPNG_ERROR, "failed to create read struct");
+
+   ok = png_set_deflate_codec(pp, codec);
+   png_destroy_read_struct(&pp, NULL, NULL);
+
+   if (ok)
+      return 1;
+
+#  ifndef PNG_LIBDEFLATE
+      if (codec == PNG_DEFLATE_CODEC_LIBDEFLATE)
+         return 0;
+#  endif
+
+   display_log(dp, LIBPNG_BUG, "deflate codec %d not available", codec);
+   return 0;
+}
+
+static void
+test_codec(struct display *dp)
+   /* Write the image with each deflate codec in this build and read each
+    * result back with every codec; the rows must match the original.
+    */
+{
+   static const int codecs[] =
+   {
+      PNG_DEFLATE_CODEC_STREAM,
+      PNG_DEFLATE_CODEC_ZLIB,
+      PNG_DEFLATE_CODEC_LIBDEFLATE
+   };
+#  define NCODECS ((int)(sizeof codecs / sizeof codecs[0]))
+   int available[NCODECS];
+   int w, r;
+
+   for (w=0; w<NCODECS; ++w)
+      available[w] = codec_available(dp, codecs[w]);
+
+   for (w=0; w<NCODECS; ++w)
+   {
+      if (!available[w])
+         continue;
+
+      dp->write_codec = codecs[w];
+      write_png(dp, dp->original_ip, 0/*transforms*/);
+
+      for (r=0; r<NCODECS; ++r)
+      {
+         if (!available[r])
+            continue;
+
+         dp->read_codec = codecs[r];
+         read_png(dp, &dp->written_file, "deflate codec", 0/*transforms*/);
+
+         if (!compare_read(dp, 0/*transforms applied*/))
+            display_log(dp, APP_FAIL, "written with codec %d, read with %d",
+               codecs[w], codecs[r]);
+      }
+   }
+
+   dp->read_codec = dp->write_codec = PNG_DEFLATE_CODEC_STREAM;
+   display_clean_read(dp);
+#  undef NCODECS
+}
+#endif /* DEFLATE_CODEC && WRITE_PNG */
+
 static int
 skip_transform(struct display *dp, int tr)
    /* Helper to test for a bad combo and log it if it is skipped */
@@ -1418,6 +1575,1014 @@ skip_transform(struct display *dp, int tr)
    return 0; /* don't skip */
 }
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+static void *
+api_alloc(struct display *dp, void *old, size_t size)
+   /* Used for the api_ buffers in the display, which display_clean frees */
+{
+   void *ptr;
+
+   free(old);
+   ptr = malloc(size > 0 ? size : 1);
+
+   if (ptr == NULL)
+      display_log(dp, APP_ERROR, "out of memory (%lu bytes)",
+         (unsigned long)size);
+
+   return ptr;
+}
+
+static void
+start_buffer_read(struct display *dp, struct buffer *bp, const char *operation)
+   /* Start a new read of the file in 'bp' in read_pp and read_ip */
+{
+   png_structp pp;
+
+   display_clean_read(dp);
+   dp->operation = operation;
+   dp->transforms = 0;
+
+   dp->read_pp = pp = png_create_read_struct(PNG_LIBPNG_VER_STRING, dp,
+      display_error, display_warning);
+   if (pp == NULL)
+      display_log(dp, LIBPNG_ERROR, "failed to create read struct");
+
+   dp->read_ip = png_create_info_struct(pp);
+   if (dp->read_ip == NULL)
+      display_log(dp, LIBPNG_ERROR, "failed to create info struct");
+
+#  ifdef PNG_SET_USER_LIMITS_SUPPORTED
+      png_set_user_limits(pp, 0x7fffffff, 0x7fffffff);
+#  endif
+
+   buffer_start_read(bp);
+   png_set_read_fn(pp, bp, read_function);
+}
+
+static void
+start_api_read(struct display *dp, const char *operation)
+   /* Start a new read of the original file in read_pp and read_ip */
+{
+   start_buffer_read(dp, &dp->original_file, operation);
+}
+
+static size_t
+get_api_file(struct display *dp)
+   /* Copy the original file to api_file and return its size */
+{
+   struct buffer *bp = &dp->original_file;
+   struct buffer_list *list;
+   size_t size = 0;
+
+   for (list = &bp->first; list != bp->last; list = list->next)
+      size += sizeof list->buffer;
+
+   size += bp->end_count;
+
+   dp->api_file = api_alloc(dp, dp->api_file, size);
+   size = 0;
+
+   for (list = &bp->first; list != bp->last; list = list->next)
+   {
+      memcpy(dp->api_file + size, list->buffer, sizeof list->buffer);
+      size += sizeof list->buffer;
+   }
+
+   memcpy(dp->api_file + size, list->buffer, bp->end_count);
+
+   return size + bp->end_count;
+}
+
+static int
+same_pixel(png_const_bytep a, png_uint_32 xa, png_const_bytep b,
+   png_uint_32 xb, unsigned int pixel_depth)
+   /* Compare pixel xa of row a with pixel xb of row b */
+{
+   if (pixel_depth >= 8)
+   {
+      size_t bytes = pixel_depth >> 3;
+
+      return memcmp(a + xa * bytes, b + xb * bytes, bytes) == 0;
+   }
+
+   else
+   {
+      size_t ba = (size_t)xa * pixel_depth, bb = (size_t)xb * pixel_depth;
+      unsigned int mask = (1U << pixel_depth) - 1;
+
+      return ((a[ba >> 3] >> (8 - pixel_depth - (ba & 7))) & mask) ==
+         ((b[bb >> 3] >> (8 - pixel_depth - (bb & 7))) & mask);
+   }
+}
+
+static int
+same_as_original(struct display *dp, png_const_bytep row, png_uint_32 y)
+   /* Compare a whole row with row y of the original image */
+{
+   unsigned int pixel_depth = dp->bit_depth *
+      png_get_channels(dp->original_pp, dp->original_ip);
+   png_uint_32 x;
+
+   if (pixel_depth >= 8)
+      return memcmp(row, dp->original_rows[y], dp->original_rowbytes) == 0;
+
+   /* Else the unused bits at the end of the row may differ */
+   for (x=0; x<dp->width; ++x)
+      if (!same_pixel(row, x, dp->original_rows[y], x, pixel_depth))
+         return 0;
+
+   return 1;
+}
+#endif /* SEQUENTIAL_READ */
+
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* The ways the --rows-into test reads the rows; png_read_row, one row at a
+ * time, gives the result the other two must match.
+ */
+#define BY_ROW      0
+#define READ_IMAGE  1
+#define READ_INTO   2
+
+static void
+read_rows_to(struct display *dp, int how, png_bytep buffer, size_t size,
+   png_ptrdiff_t stride)
+   /* Read the original file into 'buffer', which is 'size' bytes, with the
+    * start of each row 'stride' bytes after the one before.  When the rows
+    * overlap they are all written to the same memory, in the same order, by
+    * each method.
+    */
+{
+   png_structp pp;
+   png_bytep first;
+   png_uint_32 y;
+   int passes;
+
+   start_api_read(dp, how == BY_ROW ? "png_read_row" :
+      how == READ_IMAGE ? "png_read_image" : "png_read_rows_into");
+   pp = dp->read_pp;
+
+   png_read_info(pp, dp->read_ip);
+   passes = png_set_interlace_handling(pp);
+   png_read_update_info(pp, dp->read_ip);
+
+   memset(buffer, 0, size);
+   first = stride >= 0 ? buffer : buffer + (size - dp->original_rowbytes);
+
+   switch (how)
+   {
+      case BY_ROW:
+         while (passes-- > 0)
+            for (y=0; y<dp->height; ++y)
+               png_read_row(pp, first + y * stride, NULL);
+         break;
+
+      case READ_IMAGE:
+         for (y=0; y<dp->height; ++y)
+            dp->api_rows[y] = first + y * stride;
+
+         png_read_image(pp, dp->api_rows);
+         break;
+
+      case READ_INTO:
+         while (passes-- > 0)
+            png_read_rows_into(pp, first, stride, dp->height);
+         break;
+
+      default:
+         display_log(dp, INTERNAL_ERROR, "read_rows_to: %d", how);
+   }
+
+   png_read_end(pp, NULL);
+}
+
+static void
+test_rows_into(struct display *dp)
+   /* Compare png_read_image and png_read_rows_into with png_read_row for rows
+    * at a range of strides, including strides which make the rows overlap.
+    */
+{
+   size_t rowbytes = dp->original_rowbytes;
+   png_ptrdiff_t strides[6];
+   int nstrides = 0, i;
+
+   strides[nstrides++] = (png_ptrdiff_t)rowbytes;
+   strides[nstrides++] = -(png_ptrdiff_t)rowbytes;
+   strides[nstrides++] = (png_ptrdiff_t)rowbytes + 3;
+   strides[nstrides++] = 0;
+
+   if (rowbytes > 1)
+   {
+      strides[nstrides++] = (png_ptrdiff_t)(rowbytes / 2);
+      strides[nstrides++] = -(png_ptrdiff_t)(rowbytes / 2);
+   }
+
+   dp->api_rows = api_alloc(dp, dp->api_rows,
+      dp->height * sizeof *dp->api_rows);
+
+   for (i=0; i<nstrides; ++i)
+   {
+      png_ptrdiff_t stride = strides[i];
+      size_t size = (dp->height-1) * (size_t)(stride >= 0 ? stride : -stride) +
+         rowbytes;
+      int how;
+
+      dp->api_reference = api_alloc(dp, dp->api_reference, size);
+      dp->api_result = api_alloc(dp, dp->api_result, size);
+      read_rows_to(dp, BY_ROW, dp->api_reference, size, stride);
+
+      for (how = READ_IMAGE; how <= READ_INTO; ++how)
+      {
+         read_rows_to(dp, how, dp->api_result, size, stride);
+
+         if (memcmp(dp->api_result, dp->api_reference, size) != 0)
+            display_log(dp, APP_FAIL, "rows differ from png_read_row"
+               " (stride %ld)", (long)stride);
+      }
+   }
+
+   display_clean_read(dp);
+}
+
+static void
+test_read_memory(struct display *dp)
+   /* Read the image from memory with png_set_read_memory and compare it with
+    * the original, read through a read function.
+    */
+{
+   size_t size = get_api_file(dp);
+   png_structp pp;
+   png_uint_32 y;
+
+   start_api_read(dp, "png_set_read_memory");
+   pp = dp->read_pp;
+   png_set_read_memory(pp, dp->api_file, size);
+
+   png_read_info(pp, dp->read_ip);
+   (void)png_set_interlace_handling(pp);
+   png_read_update_info(pp, dp->read_ip);
+
+   if (png_get_rowbytes(pp, dp->read_ip) != dp->original_rowbytes)
+      display_log(dp, LIBPNG_BUG, "rowbytes changed");
+
+   dp->api_result = api_alloc(dp, dp->api_result,
+      dp->height * dp->original_rowbytes);
+   dp->api_rows = api_alloc(dp, dp->api_rows,
+      dp->height * sizeof *dp->api_rows);
+
+   for (y=0; y<dp->height; ++y)
+      dp->api_rows[y] = dp->api_result + y * dp->original_rowbytes;
+
+   png_read_image(pp, dp->api_rows);
+   png_read_end(pp, dp->read_ip);
+
+   for (y=0; y<dp->height; ++y)
+      if (!same_as_original(dp, dp->api_rows[y], y))
+      {
+         display_log(dp, APP_FAIL, "row %lu differs", (unsigned long)y);
+         break;
+      }
+
+   /* PNG_INFO_IDAT is only set by png_read_png */
+   {
+      png_uint_32 chunks = png_get_valid(pp, dp->read_ip, 0xffffffff);
+
+      if (chunks != (dp->chunks & ~PNG_INFO_IDAT))
+         display_log(dp, APP_FAIL, "PNG chunks changed from 0x%lx to 0x%lx",
+            (unsigned long)dp->chunks, (unsigned long)chunks);
+   }
+
+   display_clean_read(dp);
+}
+#endif /* SEQUENTIAL_READ */
+
+#ifdef PNG_READ_REGION_SUPPORTED
+static void
+test_region(struct display *dp)
+   /* Read regions of the image with png_set_read_region and, if available,
+    * png_image_set_read_region; compare them with the whole image.
+    */
+{
+   png_uint_32 width = dp->width, height = dp->height;
+   png_uint_32 regions[5][4];
+   unsigned int pixel_depth;
+   int i;
+
+   if (dp->interlace_method != PNG_INTERLACE_NONE)
+      return; /* not supported */
+
+   pixel_depth = dp->bit_depth *
+      png_get_channels(dp->original_pp, dp->original_ip);
+
+   /* x, y, width, height: the whole image, the middle, the last pixel, the
+    * bottom half and the top row less the first pixel.
+    */
+   regions[0][0] = 0, regions[0][1] = 0;
+   regions[0][2] = width, regions[0][3] = height;
+   regions[1][0] = width / 3, regions[1][1] = height / 3;
+   regions[1][2] = width - width / 3 - width / 4;
+   regions[1][3] = height - height / 3 - height / 4;
+   regions[2][0] = width - 1, regions[2][1] = height - 1;
+   regions[2][2] = 1, regions[2][3] = 1;
+   regions[3][0] = 0, regions[3][1] = height / 2;
+   regions[3][2] = width, regions[3][3] = height - height / 2;
+   regions[4][0] = width > 1, regions[4][1] = 0;
+   regions[4][2] = width - (width > 1), regions[4][3] = 1;
+
+   for (i=0; i<5; ++i)
+   {
+      png_uint_32 x = regions[i][0], y = regions[i][1];
+      png_uint_32 w = regions[i][2], h = regions[i][3];
+      png_structp pp;
+      png_infop ip;
+      size_t rowbytes;
+      png_uint_32 r;
+
+      start_api_read(dp, "png_set_read_region");
+      pp = dp->read_pp;
+      ip = dp->read_ip;
+
+      png_read_info(pp, ip);
+      if (!png_set_read_region(pp, x, y, w, h))
+         display_log(dp, LIBPNG_BUG, "png_set_read_region(%lu,%lu,%lu,%lu)"
+            " failed", (unsigned long)x, (unsigned long)y, (unsigned long)w,
+            (unsigned long)h);
+
+      png_read_update_info(pp, ip);
+      rowbytes = png_get_rowbytes(pp, ip);
+
+      if (png_get_image_width(pp, ip) != w ||
+         png_get_image_height(pp, ip) != h ||
+         rowbytes != (w * pixel_depth + 7) / 8)
+         display_log(dp, LIBPNG_BUG, "region %d: wrong size %lux%lu (%lu)",
+            i, (unsigned long)png_get_image_width(pp, ip),
+            (unsigned long)png_get_image_height(pp, ip),
+            (unsigned long)rowbytes);
+
+      dp->api_result = api_alloc(dp, dp->api_result, h * rowbytes);
+      dp->api_rows = api_alloc(dp, dp->api_rows, h * sizeof *dp->api_rows);
+
+      for (r=0; r<h; ++r)
+         dp->api_rows[r] = dp->api_result + r * rowbytes;
+
+      png_read_image(pp, dp->api_rows);
+      png_read_end(pp, NULL);
+
+      for (r=0; r<h; ++r)
+      {
+         png_uint_32 c;
+
+         for (c=0; c<w; ++c)
+            if (!same_pixel(dp->api_rows[r], c, dp->original_rows[y+r], x+c,
+               pixel_depth))
+            {
+               display_log(dp, APP_FAIL, "region %d: pixel (%lu,%lu) differs",
+                  i, (unsigned long)(x+c), (unsigned long)(y+r));
+               return;
+            }
+      }
+   }
+
+   display_clean_read(dp);
+
+#  ifdef PNG_SIMPLIFIED_READ_SUPPORTED
+   {
+      size_t size = get_api_file(dp);
+      png_image image;
+
+      dp->operation = "png_image_set_read_region";
+
+      memset(&image, 0, sizeof image);
+      image.version = PNG_IMAGE_VERSION;
+
+      if (!png_image_begin_read_from_memory(&image, dp->api_file, size))
+         display_log(dp, LIBPNG_ERROR, "%s", image.message);
+
+      image.format = PNG_FORMAT_RGBA;
+      dp->api_reference = api_alloc(dp, dp->api_reference,
+         PNG_IMAGE_SIZE(image));
+
+      if (!png_image_finish_read(&image, NULL, dp->api_reference, 0, NULL))
+         display_log(dp, LIBPNG_ERROR, "%s", image.message);
+
+      for (i=0; i<5; ++i)
+      {
+         png_uint_32 x = regions[i][0], y = regions[i][1];
+         png_uint_32 w = regions[i][2], h = regions[i][3];
+         png_uint_32 r;
+
+         memset(&image, 0, sizeof image);
+         image.version = PNG_IMAGE_VERSION;
+
+         if (!png_image_begin_read_from_memory(&image, dp->api_file, size))
+            display_log(dp, LIBPNG_ERROR, "%s", image.message);
+
+         image.format = PNG_FORMAT_RGBA;
+
+         if (!png_image_set_read_region(&image, x, y, w, h))
+            display_log(dp, LIBPNG_BUG, "%s", image.message);
+
+         if (image.width != w || image.height != h)
+         {
+            png_image_free(&image);
+            display_log(dp, LIBPNG_BUG, "region %d: wrong size %lux%lu", i,
+               (unsigned long)image.width, (unsigned long)image.height);
+         }
+
+         dp->api_result = api_alloc(dp, dp->api_result, PNG_IMAGE_SIZE(image));
+
+         if (!png_image_finish_read(&image, NULL, dp->api_result, 0, NULL))
+            display_log(dp, LIBPNG_ERROR, "%s", image.message);
+
+         for (r=0; r<h; ++r)
+            if (memcmp(dp->api_result + r * (w * 4),
+               dp->api_reference + ((y+r) * (size_t)width + x) * 4,
+               w * 4) != 0)
+            {
+               display_log(dp, APP_FAIL, "region %d: row %lu differs", i,
+                  (unsigned long)(y+r));
+               return;
+            }
+      }
+   }
+#  endif /* SIMPLIFIED_READ */
+}
+#endif /* READ_REGION */
+
+#ifdef PNG_PULL_READ_SUPPORTED
+static void
+test_pull(struct display *dp)
+   /* Read the image with png_pull_data and png_pull_row, giving it the file a
+    * byte at a time, in small and large blocks and all at once, and compare
+    * the rows with the original rows.
+    */
+{
+   size_t size = get_api_file(dp);
+   size_t rowbytes = dp->original_rowbytes;
+   size_t block_sizes[4];
+   int i;
+
+   block_sizes[0] = 1;
+   block_sizes[1] = 13;
+   block_sizes[2] = 4096;
+   block_sizes[3] = size;
+
+   dp->api_result = api_alloc(dp, dp->api_result, dp->height * rowbytes);
+   dp->api_rows = api_alloc(dp, dp->api_rows,
+      dp->height * sizeof *dp->api_rows);
+
+   for (i=0; i<4; ++i)
+   {
+      png_structp pp;
+      size_t offset = 0;
+      png_uint_32 y;
+      int done = 0;
+
+      start_api_read(dp, "png_pull_row");
+      pp = dp->read_pp;
+
+      memset(dp->api_result, 0, dp->height * rowbytes);
+      for (y=0; y<dp->height; ++y)
+         dp->api_rows[y] = dp->api_result + y * rowbytes;
+
+      while (!done)
+      {
+         png_bytep row;
+         png_uint_32 row_number;
+
+         switch (png_pull_row(pp, dp->read_ip, &row, &row_number, NULL))
+         {
+            case PNG_PULL_NEED_DATA:
+               {
+                  size_t count = size - offset;
+
+                  if (count == 0)
+                     display_log(dp, LIBPNG_BUG, "data needed after the end");
+
+                  if (count > block_sizes[i])
+                     count = block_sizes[i];
+
+                  if (!png_pull_data(pp, dp->api_file + offset, count))
+                     display_log(dp, LIBPNG_BUG, "png_pull_data failed");
+
+                  offset += count;
+               }
+               break;
+
+            case PNG_PULL_INFO:
+               (void)png_set_interlace_handling(pp);
+               png_read_update_info(pp, dp->read_ip);
+
+               if (png_get_rowbytes(pp, dp->read_ip) != rowbytes)
+                  display_log(dp, LIBPNG_BUG, "rowbytes changed");
+               break;
+
+            case PNG_PULL_ROW:
+               if (row_number >= dp->height)
+                  display_log(dp, LIBPNG_BUG, "row %lu returned",
+                     (unsigned long)row_number);
+
+               png_progressive_combine_row(pp, dp->api_rows[row_number], row);
+               break;
+
+            case PNG_PULL_END:
+               done = 1;
+               break;
+
+            default:
+               display_log(dp, LIBPNG_BUG, "unexpected error");
+         }
+      }
+
+      for (y=0; y<dp->height; ++y)
+         if (!same_as_original(dp, dp->api_rows[y], y))
+         {
+            display_log(dp, APP_FAIL, "row %lu differs (%lu byte blocks)",
+               (unsigned long)y, (unsigned long)block_sizes[i]);
+            break;
+         }
+   }
+
+   display_clean_read(dp);
+}
+#endif /* PULL_READ */
+
+#ifdef PNG_READ_PROBE_SUPPORTED
+#define PROBE_LOCATIONS 64 /* most chunks recorded */
+
+struct probe_io
+{
+   png_const_bytep data;
+   size_t          size;
+   size_t          offset; /* bytes read */
+};
+
+static void PNGCBAPI
+probe_read(png_structp pp, png_bytep data, size_t size)
+{
+   struct probe_io *io = (struct probe_io*)png_get_io_ptr(pp);
+
+   if (size > io->size - io->offset)
+      png_error(pp, "read beyond the end of the file");
+
+   memcpy(data, io->data + io->offset, size);
+   io->offset += size;
+}
+
+static void
+test_probe(struct display *dp)
+   /* Call png_read_probe with every byte limit up to the one which reaches the
+    * first IDAT.  Check that no more than the limit is read, that the chunks
+    * are recorded and that a listed ancillary chunk (tRNS) is read.  With the
+    * last limit read the image afterward and compare it with the original.
+    */
+{
+   static const png_byte chunk_list[5] = { 116, 82, 78, 83, '\0' }; /* tRNS */
+   size_t size = get_api_file(dp);
+   png_const_bytep file = dp->api_file;
+   png_chunk_location expected[PROBE_LOCATIONS];
+   int num_expected = 0;
+   size_t offset = 8, max_bytes;
+
+   /* Find the chunks up to the first IDAT */
+   for (;;)
+   {
+      png_uint_32 length;
+
+      if (size - offset < 12)
+         display_log(dp, LIBPNG_BUG, "no IDAT");
+
+      length = png_get_uint_32(file + offset);
+
+      if (num_expected < PROBE_LOCATIONS)
+      {
+         memcpy(expected[num_expected].name, file + offset + 4, 4);
+         expected[num_expected].name[4] = 0;
+         expected[num_expected].length = length;
+         expected[num_expected].offset = offset;
+         ++num_expected;
+      }
+
+      if (memcmp(file + offset + 4, "IDAT", 4) == 0)
+         break;
+
+      offset += 12 + (size_t)length;
+   }
+
+   for (max_bytes = 0; max_bytes <= offset + 8; ++max_bytes)
+   {
+      png_chunk_location locations[PROBE_LOCATIONS];
+      struct probe_io io;
+      png_structp pp;
+      png_infop ip;
+      int num_locations = PROBE_LOCATIONS, result, i;
+
+      start_api_read(dp, "png_read_probe");
+      pp = dp->read_pp;
+      ip = dp->read_ip;
+
+      io.data = file;
+      io.size = size;
+      io.offset = 0;
+      png_set_read_fn(pp, &io, probe_read);
+
+      result = png_read_probe(pp, ip, max_bytes, chunk_list, 1, locations,
+         &num_locations);
+
+      if (io.offset > max_bytes)
+         display_log(dp, LIBPNG_BUG, "read %lu bytes with a"
+            " limit of %lu", (unsigned long)io.offset,
+            (unsigned long)max_bytes);
+
+      if (result != (max_bytes >= offset + 8))
+         display_log(dp, LIBPNG_BUG, "returned %d with a"
+            " limit of %lu", result, (unsigned long)max_bytes);
+
+      /* A chunk is recorded if its header is within the limit. */
+      for (i=0; i<num_expected; ++i)
+         if (expected[i].offset + 8 > max_bytes)
+            break;
+
+      if (num_locations != i)
+         display_log(dp, LIBPNG_BUG, "%d chunks recorded, not"
+            " %d, with a limit of %lu", num_locations, i,
+            (unsigned long)max_bytes);
+
+      for (i=0; i<num_locations; ++i)
+         if (strcmp((const char*)locations[i].name,
+               (const char*)expected[i].name) != 0 ||
+            locations[i].length != expected[i].length ||
+            locations[i].offset != expected[i].offset)
+            display_log(dp, LIBPNG_BUG, "chunk %d (%s)"
+               " recorded wrongly", i, (const char*)expected[i].name);
+
+      if (result)
+      {
+         png_uint_32 y;
+
+         if (png_get_image_width(pp, ip) != dp->width ||
+            png_get_image_height(pp, ip) != dp->height ||
+            png_get_bit_depth(pp, ip) != dp->bit_depth ||
+            png_get_color_type(pp, ip) != dp->color_type)
+            display_log(dp, LIBPNG_BUG, "IHDR not read");
+
+         if (png_get_valid(pp, ip, PNG_INFO_tRNS) !=
+            (dp->chunks & PNG_INFO_tRNS))
+            display_log(dp, LIBPNG_BUG, "tRNS not read");
+
+         (void)png_set_interlace_handling(pp);
+         png_read_update_info(pp, ip);
+
+         dp->api_result = api_alloc(dp, dp->api_result,
+            dp->height * dp->original_rowbytes);
+         dp->api_rows = api_alloc(dp, dp->api_rows,
+            dp->height * sizeof *dp->api_rows);
+
+         for (y=0; y<dp->height; ++y)
+            dp->api_rows[y] = dp->api_result + y * dp->original_rowbytes;
+
+         png_read_image(pp, dp->api_rows);
+         png_read_end(pp, NULL);
+
+         for (y=0; y<dp->height; ++y)
+            if (!same_as_original(dp, dp->api_rows[y], y))
+            {
+               display_log(dp, APP_FAIL, "row %lu differs",
+                  (unsigned long)y);
+               break;
+            }
+      }
+   }
+
+   display_clean_read(dp);
+}
+#endif /* READ_PROBE */
+
+#if defined(PNG_READ_QUANTIZE_SUPPORTED) && defined(PNG_PARALLEL_SUPPORTED) &&\
+   defined(PNG_WRITE_PNG_SUPPORTED)
+static void
+write_quantize_cube(struct display *dp)
+   /* Write an 8-bit RGB image to written_file with one pixel for each entry in
+    * the png_set_quantize lookup table, which uses the top five bits of each
+    * component, so that quantizing it gives the whole table.
+    */
+{
+   png_byte row[256 * 3];
+   png_uint_32 x, y;
+
+   display_clean_write(dp);
+   buffer_start_write(&dp->written_file);
+   dp->operation = "write quantize cube";
+   dp->transforms = 0;
+
+   dp->write_pp = png_create_write_struct(PNG_LIBPNG_VER_STRING, dp,
+      display_error, display_warning);
+   if (dp->write_pp == NULL)
+      display_log(dp, APP_ERROR, "failed to create write png_struct");
+
+   dp->write_ip = png_create_info_struct(dp->write_pp);
+   if (dp->write_ip == NULL)
+      display_log(dp, APP_ERROR, "failed to create write png_info");
+
+   png_set_write_fn(dp->write_pp, &dp->written_file, write_function,
+      NULL/*flush*/);
+   png_set_IHDR(dp->write_pp, dp->write_ip, 256, 128, 8, PNG_COLOR_TYPE_RGB,
+      PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+   png_write_info(dp->write_pp, dp->write_ip);
+
+   for (y=0; y<128; ++y)
+   {
+      for (x=0; x<256; ++x)
+      {
+         png_uint_32 v = (y << 8) + x;
+
+         row[3*x+0] = (png_byte)((v >> 10) << 3);
+         row[3*x+1] = (png_byte)(((v >> 5) & 31) << 3);
+         row[3*x+2] = (png_byte)((v & 31) << 3);
+      }
+
+      png_write_row(dp->write_pp, row);
+   }
+
+   png_write_end(dp->write_pp, NULL);
+   display_clean_write(dp);
+}
+
+static size_t
+quantize_read(struct display *dp, struct buffer *bp, png_colorp palette,
+   int num_palette, int maximum_colors, png_const_uint_16p histogram,
+   int parallel, png_bytep result)
+   /* Read the 8-bit RGB or RGBA image in 'bp' with png_set_quantize into
+    * result, one byte for each pixel, and return the number of pixels.
+    * png_set_quantize changes 'palette'.
+    */
+{
+   png_structp pp;
+   png_uint_32 height, y;
+   size_t width, i;
+   int passes;
+
+   start_buffer_read(dp, bp, parallel ? "quantize (parallel)" : "quantize");
+   pp = dp->read_pp;
+
+   png_read_info(pp, dp->read_ip);
+   width = png_get_image_width(pp, dp->read_ip);
+   height = png_get_image_height(pp, dp->read_ip);
+
+   if (parallel)
+      png_set_parallel_fn(pp, NULL, parallel_function);
+
+   png_set_quantize(pp, palette, num_palette, maximum_colors, histogram,
+      1/*full_quantize*/);
+   passes = png_set_interlace_handling(pp);
+   png_read_update_info(pp, dp->read_ip);
+
+   if (png_get_color_type(pp, dp->read_ip) != PNG_COLOR_TYPE_PALETTE ||
+       png_get_rowbytes(pp, dp->read_ip) != width)
+      display_log(dp, LIBPNG_BUG, "quantize did not give palette indices");
+
+   memset(result, 0, width * height);
+
+   while (passes-- > 0)
+      for (y=0; y<height; ++y)
+         png_read_row(pp, result + y * width, NULL);
+
+   png_read_end(pp, NULL);
+
+   /* Every index must be in the reduced palette */
+   if (maximum_colors < num_palette)
+      num_palette = maximum_colors;
+
+   for (i=0; i<width * height; ++i)
+      if (result[i] >= num_palette)
+         display_log(dp, LIBPNG_BUG, "palette index %d out of range",
+            result[i]);
+
+   return width * height;
+}
+
+static void
+quantize_compare(struct display *dp, struct buffer *bp, const char *name,
+   png_const_colorp palette, int num_palette, int maximum_colors,
+   png_const_uint_16p histogram)
+   /* Quantize the image in 'bp' with the jobs of png_set_quantize run in order
+    * and then, with png_set_parallel_fn, in reverse; the resultant palettes
+    * and indices must be identical.
+    */
+{
+   png_color serial_palette[256], parallel_palette[256];
+   size_t size;
+
+   memset(serial_palette, 0, sizeof serial_palette);
+   memset(parallel_palette, 0, sizeof parallel_palette);
+   memcpy(serial_palette, palette, num_palette * sizeof *palette);
+   memcpy(parallel_palette, palette, num_palette * sizeof *palette);
+
+   size = quantize_read(dp, bp, serial_palette, num_palette, maximum_colors,
+      histogram, 0/*serial*/, dp->api_reference);
+   (void)quantize_read(dp, bp, parallel_palette, num_palette, maximum_colors,
+      histogram, 1/*parallel*/, dp->api_result);
+
+   if (memcmp(serial_palette, parallel_palette, sizeof serial_palette) != 0)
+      display_log(dp, APP_FAIL, "%s to %d colors%s: palettes differ", name,
+         maximum_colors, histogram != NULL ? " with histogram" : "");
+
+   if (memcmp(dp->api_reference, dp->api_result, size) != 0)
+      display_log(dp, APP_FAIL, "%s to %d colors%s: indices differ", name,
+         maximum_colors, histogram != NULL ? " with histogram" : "");
+}
+
+static void
+test_quantize(struct display *dp)
+   /* Check that png_set_quantize with full_quantize gives the same result with
+    * and without png_set_parallel_fn, with and without a histogram (hIST if
+    * there is one).  The palette is that of the original, or a made up one if
+    * it has none, and the image is one with every color in the lookup table
+    * and the original if it is 8-bit RGB or RGBA.
+    */
+{
+   png_color palette[256];
+   png_uint_16 histogram[256];
+   png_colorp file_palette;
+   int num_palette = 0, maxima[3], i;
+   size_t size;
+
+   if (png_get_PLTE(dp->original_pp, dp->original_ip, &file_palette,
+         &num_palette) != 0 && num_palette > 0)
+      memcpy(palette, file_palette, num_palette * sizeof *palette);
+
+   else
+   {
+      /* The made up palette depends on the image and has a duplicate entry */
+      png_uint_32 seed = (dp->width << 16) ^ dp->height ^
+         ((png_uint_32)dp->color_type << 8) ^ (png_uint_32)dp->bit_depth;
+
+      for (num_palette=0; num_palette<256; ++num_palette)
+      {
+         seed = seed * 1103515245U + 12345U;
+         palette[num_palette].red = (png_byte)(seed >> 24);
+         palette[num_palette].green = (png_byte)(seed >> 16);
+         palette[num_palette].blue = (png_byte)(seed >> 8);
+      }
+
+      palette[255] = palette[0];
+   }
+
+   for (i=0; i<num_palette; ++i)
+      histogram[i] = (png_uint_16)((i * 7919U) & 0xffffU);
+
+#  ifdef PNG_hIST_SUPPORTED
+   {
+      png_uint_16p file_histogram;
+
+      if (png_get_hIST(dp->original_pp, dp->original_ip, &file_histogram) != 0)
+         memcpy(histogram, file_histogram, num_palette * sizeof *histogram);
+   }
+#  endif
+
+   size = dp->width * (size_t)dp->height;
+   if (size < 256 * 128)
+      size = 256 * 128;
+
+   dp->api_reference = api_alloc(dp, dp->api_reference, size);
+   dp->api_result = api_alloc(dp, dp->api_result, size);
+   write_quantize_cube(dp);
+
+   /* No reduction, half the colors, two colors */
+   maxima[0] = num_palette;
+   maxima[1] = num_palette / 2;
+   maxima[2] = 2;
+
+   for (i=0; i<3; ++i)
+   {
+      int maximum = maxima[i];
+
+      if (maximum < 2 || (i > 0 && maximum >= maxima[i-1]))
+         continue;
+
+      quantize_compare(dp, &dp->written_file, "cube", palette,
+         num_palette, maximum, NULL);
+      quantize_compare(dp, &dp->written_file, "cube", palette,
+         num_palette, maximum, histogram);
+
+      if (dp->bit_depth == 8 && (dp->color_type == PNG_COLOR_TYPE_RGB ||
+          dp->color_type == PNG_COLOR_TYPE_RGB_ALPHA))
+      {
+         quantize_compare(dp, &dp->original_file, "image", palette,
+            num_palette, maximum, NULL);
+         quantize_compare(dp, &dp->original_file, "image", palette,
+            num_palette, maximum, histogram);
+      }
+   }
+
+   display_clean_read(dp);
+}
+#endif /* READ_QUANTIZE && PARALLEL && WRITE_PNG */
+
+#if defined(PNG_GAMMA_CACHE_SUPPORTED) && defined(PNG_FIXED_POINT_SUPPORTED)
+#ifdef PNG_USER_MEM_SUPPORTED
+static png_voidp PNGCBAPI
+gamma_malloc(png_structp pp, png_alloc_size_t size)
+{
+   (void)pp;
+   return malloc(size);
+}
+
+static void PNGCBAPI
+gamma_free(png_structp pp, png_voidp ptr)
+{
+   (void)pp;
+   free(ptr);
+}
+#endif /* USER_MEM */
+
+static void
+gamma_cache_read(struct display *dp, png_fixed_point screen_gamma, int cache,
+   int user_memory, png_bytep result)
+   /* Read the original with the given screen gamma into result, with the
+    * PNG_GAMMA_CACHE option if 'cache' is set and, if 'user_memory' is set,
+    * with memory functions, which keep the png_struct out of the cache.
+    */
+{
+   png_structp pp;
+   png_uint_32 y;
+
+   start_api_read(dp, !cache ? "gamma" : !user_memory ? "gamma cache" :
+      "gamma cache (user memory)");
+   pp = dp->read_pp;
+
+#  ifdef PNG_USER_MEM_SUPPORTED
+      if (user_memory)
+         png_set_mem_fn(pp, dp, gamma_malloc, gamma_free);
+#  else
+      (void)user_memory;
+#  endif
+
+   if (cache && png_set_option(pp, PNG_GAMMA_CACHE, PNG_OPTION_ON) ==
+       PNG_OPTION_INVALID)
+      display_log(dp, LIBPNG_BUG, "PNG_GAMMA_CACHE: invalid option");
+
+   png_read_info(pp, dp->read_ip);
+   png_set_gamma_fixed(pp, screen_gamma, PNG_DEFAULT_sRGB);
+   (void)png_set_interlace_handling(pp);
+   png_read_update_info(pp, dp->read_ip);
+
+   if (png_get_rowbytes(pp, dp->read_ip) != dp->original_rowbytes)
+      display_log(dp, LIBPNG_BUG, "rowbytes changed");
+
+   for (y=0; y<dp->height; ++y)
+      dp->api_rows[y] = result + y * dp->original_rowbytes;
+
+   png_read_image(pp, dp->api_rows);
+   png_read_end(pp, NULL);
+}
+
+static void
+test_gamma_cache(struct display *dp)
+   /* Read the image with a range of screen gammas with and without the
+    * PNG_GAMMA_CACHE option; the rows must be the same.  Each cached read is
+    * made twice, so that the second finds the tables of the first, and again
+    * with memory functions.  Then png_free_gamma_cache is called and the reads
+    * are repeated.
+    */
+{
+   static const png_fixed_point screen_gammas[] =
+   {
+      PNG_GAMMA_LINEAR, PNG_GAMMA_MAC_18, 250000, PNG_DEFAULT_sRGB, 45455
+   };
+   size_t size = dp->height * dp->original_rowbytes;
+   int free_cache, i, read;
+
+   dp->api_reference = api_alloc(dp, dp->api_reference, size);
+   dp->api_result = api_alloc(dp, dp->api_result, size);
+   dp->api_rows = api_alloc(dp, dp->api_rows,
+      dp->height * sizeof *dp->api_rows);
+
+   for (free_cache=0; free_cache<2; ++free_cache)
+   {
+      for (i=0; i<(int)(sizeof screen_gammas / sizeof screen_gammas[0]); ++i)
+      {
+         gamma_cache_read(dp, screen_gammas[i], 0/*cache*/, 0/*user memory*/,
+            dp->api_reference);
+
+         for (read=0; read<3; ++read)
+         {
+            gamma_cache_read(dp, screen_gammas[i], 1/*cache*/, read == 2,
+               dp->api_result);
+
+            if (memcmp(dp->api_result, dp->api_reference, size) != 0)
+               display_log(dp, APP_FAIL, "screen gamma %ld: cached read %d"
+                  " differs%s", (long)screen_gammas[i], read + 1,
+                  free_cache ? " after png_free_gamma_cache" : "");
+         }
+      }
+
+      /* No png_struct is using the cache now so this frees all of it */
+      display_clean_read(dp);
+      png_free_gamma_cache();
+   }
+}
+#endif /* GAMMA_CACHE && FIXED_POINT */
+
 static void
 test_one_file(struct display *dp, const char *filename)
 {
@@ -1429,6 +2594,46 @@ test_one_file(struct display *dp, const char *filename)
    display_cache_file(dp, filename);
    update_display(dp);
 
+#  ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+      /* The tests of the other ways of reading the image. */
+      if (dp->options & ROWS_INTO)
+         test_rows_into(dp);
+
+      if (dp->options & READ_MEMORY)
+         test_read_memory(dp);
+#  endif
+
+#  ifdef PNG_READ_REGION_SUPPORTED
+      if (dp->options & REGION)
+         test_region(dp);
+#  endif
+
+#  ifdef PNG_PULL_READ_SUPPORTED
+      if (dp->options & PULL)
+         test_pull(dp);
+#  endif
+
+#  ifdef PNG_READ_PROBE_SUPPORTED
+      if (dp->options & PROBE)
+         test_probe(dp);
+#  endif
+
+#  if defined(PNG_DEFLATE_CODEC_SUPPORTED) && defined(PNG_WRITE_PNG_SUPPORTED)
+      if (dp->options & CODEC)
+         test_codec(dp);
+#  endif
+
+#  if defined(PNG_READ_QUANTIZE_SUPPORTED) && defined(PNG_PARALLEL_SUPPORTED)\
+      && defined(PNG_WRITE_PNG_SUPPORTED)
+      if (dp->options & QUANTIZE)
+         test_quantize(dp);
+#  endif
+
+#  if defined(PNG_GAMMA_CACHE_SUPPORTED) && defined(PNG_FIXED_POINT_SUPPORTED)
+      if (dp->options & GAMMA_CACHE)
+         test_gamma_cache(dp);
+#  endif
+
    /* First test: if there are options that should be ignored for this file
     * verify that they really are ignored.
     */
@@ -1666,6 +2871,60 @@ main(int argc, char **argv)
       else if (strcmp(name, "--nolist-combos") == 0)
          d.options &= ~LIST_COMBOS;
 
+      else if (strcmp(name, "--parallel") == 0)
+         d.options |= PARALLEL;
+
+      else if (strcmp(name, "--noparallel") == 0)
+         d.options &= ~PARALLEL;
+
+      else if (strcmp(name, "--rows-into") == 0)
+         d.options |= ROWS_INTO;
+
+      else if (strcmp(name, "--norows-into") == 0)
+         d.options &= ~ROWS_INTO;
+
+      else if (strcmp(name, "--region") == 0)
+         d.options |= REGION;
+
+      else if (strcmp(name, "--noregion") == 0)
+         d.options &= ~REGION;
+
+      else if (strcmp(name, "--pull") == 0)
+         d.options |= PULL;
+
+      else if (strcmp(name, "--nopull") == 0)
+         d.options &= ~PULL;
+
+      else if (strcmp(name, "--probe") == 0)
+         d.options |= PROBE;
+
+      else if (strcmp(name, "--noprobe") == 0)
+         d.options &= ~PROBE;
+
+      else if (strcmp(name, "--read-memory") == 0)
+         d.options |= READ_MEMORY;
+
+      else if (strcmp(name, "--noread-memory") == 0)
+         d.options &= ~READ_MEMORY;
+
+      else if (strcmp(name, "--codec") == 0)
+         d.options |= CODEC;
+
+      else if (strcmp(name, "--nocodec") == 0)
+         d.options &= ~CODEC;
+
+      else if (strcmp(name, "--quantize") == 0)
+         d.options |= QUANTIZE;
+
+      else if (strcmp(name, "--noquantize") == 0)
+         d.options &= ~QUANTIZE;
+
+      else if (strcmp(name, "--gamma-cache") == 0)
+         d.options |= GAMMA_CACHE;
+
+      else if (strcmp(name, "--nogamma-cache") == 0)
+         d.options &= ~GAMMA_CACHE;
+
       else if (name[0] == '-' && name[1] == '-')
       {
          fprintf(stderr, "pngimage: %s: unknown option\n", name);
@@ -62,6 +62,13 @@ typedef struct
    FILE *output;
 }  io_data;
 
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+/* Set by --rgb-to-gray (1) or --rgb-to-gray-gamma (2) to add the conversion
+ * to the read by row.
+ */
+static int rgb_to_gray = 0;
+#endif
+
 static PNG_CALLBACK(void, read_and_copy,
       (png_structp png_ptr, png_bytep buffer, size_t cb))
 {
@@ -97,8 +104,27 @@ static void read_by_row(png_structp png_ptr, png_infop info_ptr,
 
    png_read_info(png_ptr, info_ptr);
 
+#  ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+      /* Not when copying the file to the temporary file. */
+      if (rgb_to_gray != 0 && write_ptr == NULL)
+      {
+         png_set_rgb_to_gray_fixed(png_ptr, PNG_ERROR_ACTION_NONE, -1, -1);
+
+         /* Gray output in linear light, as for OCR. */
+         if (rgb_to_gray > 1)
+            png_set_gamma_fixed(png_ptr, PNG_GAMMA_LINEAR, PNG_DEFAULT_sRGB);
+      }
+#  endif
+
    {
-      size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+      size_t rowbytes;
+      int passes = png_set_interlace_handling(png_ptr);
+
+      /* This also starts the read, so the row buffers are big enough for the
+       * transformed rows.
+       */
+      png_read_update_info(png_ptr, info_ptr);
+      rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 
       row = voidcast(png_bytep,malloc(rowbytes));
       display = voidcast(png_bytep,malloc(rowbytes));
@@ -108,11 +134,8 @@ static void read_by_row(png_structp png_ptr, png_infop info_ptr,
 
       {
          png_uint_32 height = png_get_image_height(png_ptr, info_ptr);
-         int passes = png_set_interlace_handling(png_ptr);
          int pass;
 
-         png_start_read_image(png_ptr);
-
          for (pass = 0; pass < passes; ++pass)
          {
             png_uint_32 y = height;
@@ -188,6 +211,39 @@ static int mytime(struct timespec *t)
    return 0;
 }
 
+static int print_time(const struct timespec *before,
+      const struct timespec *after)
+{
+   /* Work out the time difference and print it - this is the only output, so
+    * flush it immediately.
+    */
+   unsigned long s = after->tv_sec - before->tv_sec;
+   long ns = after->tv_nsec - before->tv_nsec;
+
+   if (ns < 0)
+   {
+      --s;
+      ns += 1000000000;
+
+      if (ns < 0)
+      {
+         fprintf(stderr, "timepng: bad clock from kernel\n");
+         return 0;
+      }
+   }
+
+   printf("%lu.%.9ld\n", s, ns);
+   fflush(stdout);
+   if (ferror(stdout))
+   {
+      fprintf(stderr, "timepng: error writing output\n");
+      return 0;
+   }
+
+   /* Successful return */
+   return 1;
+}
+
 static int perform_one_test(FILE *fp, int nfiles, png_int_32 transforms)
 {
    int i;
@@ -223,40 +279,100 @@ static int perform_one_test(FILE *fp, int nfiles, png_int_32 transforms)
       return 0;
 
    if (mytime(&after))
+      return print_time(&before, &after);
+
+   else
+      return 0;
+}
+
+#ifdef PNG_SIMPLIFIED_READ_SUPPORTED
+/* Time reading the named files as RGBA with the simplified API.  With
+ * use_file the files are opened by png_image_begin_read_from_file with
+ * PNG_IMAGE_FLAG_MAP_FILE, which maps them into memory where the system
+ * supports this, otherwise they are read through stdio with
+ * png_image_begin_read_from_stdio.  This compares the two ways of getting the
+ * data into libpng, so the files are not assembled.
+ */
+static int perform_simplified_test(int nfiles, char **names, int use_file)
+{
+   int i;
+   png_bytep buffer = NULL;
+   size_t buffer_size = 0;
+   struct timespec before, after;
+
+   if (!mytime(&before))
+      return 0;
+
+   for (i=0; i<nfiles; ++i)
    {
-      /* Work out the time difference and print it - this is the only output,
-       * so flush it immediately.
-       */
-      unsigned long s = after.tv_sec - before.tv_sec;
-      long ns = after.tv_nsec - before.tv_nsec;
+      png_image image;
+      FILE *ip = NULL;
+      int ok;
 
-      if (ns < 0)
+      memset(&image, 0, sizeof image);
+      image.version = PNG_IMAGE_VERSION;
+
+      if (use_file)
+      {
+         image.flags = PNG_IMAGE_FLAG_MAP_FILE;
+         ok = png_image_begin_read_from_file(&image, names[i]);
+      }
+
+      else
       {
-         --s;
-         ns += 1000000000;
+         ip = fopen(names[i], "rb");
 
-         if (ns < 0)
+         if (ip == NULL)
          {
-            fprintf(stderr, "timepng: bad clock from kernel\n");
+            perror(names[i]);
             return 0;
          }
+
+         ok = png_image_begin_read_from_stdio(&image, ip);
       }
 
-      printf("%lu.%.9ld\n", s, ns);
-      fflush(stdout);
-      if (ferror(stdout))
+      if (ok)
       {
-         fprintf(stderr, "timepng: error writing output\n");
-         return 0;
+         image.format = PNG_FORMAT_RGBA;
+
+         if (PNG_IMAGE_SIZE(image) > buffer_size)
+         {
+            free(buffer);
+            buffer_size = PNG_IMAGE_SIZE(image);
+            buffer = voidcast(png_bytep, malloc(buffer_size));
+
+            if (buffer == NULL)
+            {
+               fprintf(stderr, "timepng: OOM allocating image buffer\n");
+               exit(1);
+            }
+         }
+
+         ok = png_image_finish_read(&image, NULL/*background*/, buffer,
+               0/*row_stride*/, NULL/*colormap*/);
       }
 
-      /* Successful return */
-      return 1;
+      if (ip != NULL)
+         (void)fclose(ip);
+
+      if (!ok)
+      {
+         fprintf(stderr, "%s: %s\n", names[i], image.message);
+         png_image_free(&image);
+         free(buffer);
+         return 0;
+      }
    }
 
+   free(buffer);
+
+   if (mytime(&after))
+      return print_time(&before, &after);
+
    else
       return 0;
 }
+#endif /* SIMPLIFIED_READ */
 
 static int add_one_file(FILE *fp, char *name)
 {
@@ -339,11 +455,17 @@ usage(FILE *fp)
 "  Read the files into <assembly>, output the count.  Options are ignored.\n"
 " timepng --dissemble <assembly> <count> [options]\n"
 "  Time <count> files from <assembly>, additional files may not be given.\n"
+   /* ISO C90 string length max 509 */);fprintf(stderr,
+" timepng --image-stdio|--image-file {files}\n"
+"  Time reading the files with the simplified API through stdio or with\n"
+"  png_image_begin_read_from_file (memory mapped where supported).\n"
 " Otherwise:\n"
 "  Read the files into a temporary file and time the decode\n"
 "Transforms:\n"
 "  --by-image: read by image with png_read_png\n"
 "  --<transform>: implies by-image, use PNG_TRANSFORM_<transform>\n"
+"  --rgb-to-gray[-gamma]: read by row with png_set_rgb_to_gray, with\n"
+"    linear output for -gamma\n"
 "  Otherwise: read by row using png_read_row (to a single row buffer)\n"
    /* ISO C90 string length max 509 */);fprintf(stderr,
 "{files}:\n"
@@ -367,6 +489,13 @@ int main(int argc, char **argv)
    const char *assembly = NULL;
    FILE *fp;
 
+#ifdef PNG_SIMPLIFIED_READ_SUPPORTED
+   if (argc > 2 && (strcmp(argv[1], "--image-stdio") == 0 ||
+         strcmp(argv[1], "--image-file") == 0))
+      return !perform_simplified_test(argc-2, argv+2,
+            strcmp(argv[1], "--image-file") == 0);
+#endif
+
    if (argc > 2 && strcmp(argv[1], "--assemble") == 0)
    {
       /* Just build the test file, argv[2] is the file name. */
@@ -466,6 +595,16 @@ int main(int argc, char **argv)
 
       --argc;
 
+#     ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+         /* These read by row: */
+         if (strcmp(opt, "rgb-to-gray") == 0 ||
+             strcmp(opt, "rgb-to-gray-gamma") == 0)
+         {
+            rgb_to_gray = opt[11] == 0 ? 1 : 2;
+            continue;
+         }
+#     endif
+
       /* Transforms turn on the by-image processing and maybe set some
        * transforms:
        */
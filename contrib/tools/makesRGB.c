@@ -10,7 +10,8 @@
  *
  * Make two tables to take a linear value scaled to 255*65535 and return an
  * approximation to the 8-bit sRGB encoded value.  Calculate the error in these
- * tables and display it.
+ * tables and display it.  The two tables are also output packed into one
+ * 32-bit table for the SIMD code.
  */
 
 #define _C99_SOURCE 1
@@ -423,6 +424,20 @@ main(int argc, char **argv)
          if (i<511) printf("\n   ");
       }
       printf("%d\n};\n\n", png_sRGB_delta[i]);
+
+      /* The two tables above packed into one, for the SIMD code: */
+      printf("const png_uint_32 png_sRGB_base_delta[512] =\n{\n   ");
+      for (i=0; i<511; )
+      {
+         do
+         {
+            printf("0x%08x,", png_sRGB_base[i] | (png_sRGB_delta[i] << 16));
+            ++i;
+         }
+         while (i % 6 != 0 && i<511);
+         if (i<511) printf("\n   ");
+      }
+      printf("0x%08x\n};\n\n", png_sRGB_base[i] | (png_sRGB_delta[i] << 16));
    }
 
    return 0;
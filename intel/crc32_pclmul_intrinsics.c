@@ -0,0 +1,108 @@
+/* crc32_pclmul_intrinsics.c - PCLMULQDQ optimized CRC-32
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * The algorithm is from "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction", V. Gopal et al., Intel, 2009: four 128-bit lanes are
+ * folded forward 64 bytes at a time with carry-less multiplies, reduced to a
+ * single lane, then to 64 bits and finally to the 32-bit CRC with a Barrett
+ * reduction.  The constants are those for the bit reflected CRC-32 used by PNG
+ * (and zlib), given at the end of the paper.
+ */
+
+#include "../pngpriv.h"
+
+#if PNG_INTEL_CPUID_OPT > 0
+
+#include <immintrin.h>
+
+/* The instructions are enabled for this function alone; png_init_crc32_intel
+ * only selects it when the CPU has them.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#  define PNG_PCLMUL_FUNCTION __attribute__((target("sse2,pclmul")))
+#else
+#  define PNG_PCLMUL_FUNCTION
+#endif
+
+/* Each pair of 33-bit constants is stored as four 32-bit values for
+ * _mm_loadu_si128.
+ */
+static const png_uint_32 k1k2[4] = /* fold by 4 lanes */
+   { 0x54442bd4U, 1U, 0xc6e41596U, 1U };
+static const png_uint_32 k3k4[4] = /* fold by 1 lane */
+   { 0x751997d0U, 1U, 0xccaa009eU, 0U };
+static const png_uint_32 k5k0[4] = /* fold 96 bits to 64 */
+   { 0x63cd6124U, 1U, 0U, 0U };
+static const png_uint_32 poly[4] = /* P(x) and mu for Barrett reduction */
+   { 0xdb710641U, 1U, 0xf7011641U, 1U };
+
+#define LOAD(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+
+/* Fold x by 128 bits (or 512 bits with k1k2) and add in the data d. */
+#define FOLD(x, k, d) _mm_xor_si128(_mm_xor_si128(\
+   _mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00)), d)
+
+/* Update 'crc' (as returned by zlib crc32) over 'length' bytes; length must be
+ * a multiple of 16 and at least 64.
+ */
+PNG_PCLMUL_FUNCTION png_uint_32
+png_crc32_pclmul(png_uint_32 crc, png_const_bytep buf, size_t length)
+{
+   __m128i x0, x1, x2, x3, x4;
+   __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+
+   x1 = _mm_xor_si128(LOAD(buf), _mm_cvtsi32_si128((int)~crc));
+   x2 = LOAD(buf + 16);
+   x3 = LOAD(buf + 32);
+   x4 = LOAD(buf + 48);
+   buf += 64;
+   length -= 64;
+
+   /* Fold the four lanes forward over each 64 bytes. */
+   x0 = LOAD(k1k2);
+
+   while (length >= 64)
+   {
+      x1 = FOLD(x1, x0, LOAD(buf));
+      x2 = FOLD(x2, x0, LOAD(buf + 16));
+      x3 = FOLD(x3, x0, LOAD(buf + 32));
+      x4 = FOLD(x4, x0, LOAD(buf + 48));
+      buf += 64;
+      length -= 64;
+   }
+
+   /* Fold the lanes into one, then the remaining 16 byte blocks. */
+   x0 = LOAD(k3k4);
+   x1 = FOLD(x1, x0, x2);
+   x1 = FOLD(x1, x0, x3);
+   x1 = FOLD(x1, x0, x4);
+
+   while (length >= 16)
+   {
+      x1 = FOLD(x1, x0, LOAD(buf));
+      buf += 16;
+      length -= 16;
+   }
+
+   /* 128 bits to 64. */
+   x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+   x0 = LOAD(k5k0);
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   /* Barrett reduction to 32 bits. */
+   x0 = LOAD(poly);
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), x0, 0x10);
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return ~(png_uint_32)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
@@ -0,0 +1,328 @@
+/* filter_avx2_intrinsics.c - AVX2 optimized filter functions
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * These are selected at run time by png_init_filter_functions_sse2 when the
+ * CPU supports AVX2.  Sub covers 3, 4, 6 and 8 bytes per pixel.  Avg and
+ * Paeth cover only the 16-bit formats, 6 and 8 bytes per pixel, which have no
+ * SSE2 versions; for 3 and 4 bytes the SSE2 Avg and SSE4.1 Paeth are as fast,
+ * since every pixel depends on the one to its left.
+ */
+
+#include "../pngpriv.h"
+
+#ifdef PNG_READ_SUPPORTED
+
+#if PNG_INTEL_CPUID_OPT > 0
+
+#include <immintrin.h>
+
+/* The instructions are enabled for these functions alone. */
+#if defined(__GNUC__) || defined(__clang__)
+#  define PNG_AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#  define PNG_AVX2_FUNCTION
+#endif
+
+/* Pixels of up to 8 bytes are loaded into the low half of a register.  The
+ * bytes go through general registers, not memory, so that a pixel stored by
+ * the previous iteration is not reloaded through a partly overlapping access,
+ * which stalls store forwarding; nothing beyond the pixel is read or written.
+ * 'bpp' is a constant once these are inlined.
+ */
+static PNG_AVX2_FUNCTION __m128i
+load_pixel(png_const_bytep p, unsigned int bpp)
+{
+   png_uint_32 lo;
+   png_uint_16 hi;
+
+   switch (bpp)
+   {
+      case 3:
+         memcpy(&hi, p, 2);
+         return _mm_cvtsi32_si128((int)(hi | ((png_uint_32)p[2] << 16)));
+
+      case 4:
+         memcpy(&lo, p, 4);
+         return _mm_cvtsi32_si128((int)lo);
+
+      case 6:
+         memcpy(&lo, p, 4);
+         memcpy(&hi, p + 4, 2);
+         return _mm_insert_epi16(_mm_cvtsi32_si128((int)lo), hi, 2);
+
+      default: /* 8 */
+         return _mm_loadl_epi64((const __m128i*)(const void*)p);
+   }
+}
+
+static PNG_AVX2_FUNCTION void
+store_pixel(png_bytep p, __m128i v, unsigned int bpp)
+{
+   png_uint_32 lo = (png_uint_32)_mm_cvtsi128_si32(v);
+   png_uint_16 hi;
+
+   switch (bpp)
+   {
+      case 3:
+         hi = (png_uint_16)lo;
+         memcpy(p, &hi, 2);
+         p[2] = (png_byte)(lo >> 16);
+         break;
+
+      case 4:
+         memcpy(p, &lo, 4);
+         break;
+
+      case 6:
+         hi = (png_uint_16)_mm_extract_epi16(v, 2);
+         memcpy(p, &lo, 4);
+         memcpy(p + 4, &hi, 2);
+         break;
+
+      default: /* 8 */
+         _mm_storel_epi64((__m128i*)(void*)p, v);
+         break;
+   }
+}
+
+/* Sub: each byte adds the byte bpp to its left, so a run of pixels is a
+ * prefix sum.  Each 16 bytes hold a whole number of pixels (15 for bpp 3, 12
+ * for bpp 6); the prefix sum is done with shifted adds and the last pixel of
+ * the previous block is then added to every pixel.  The bytes after the
+ * whole pixels are stored back unchanged.
+ */
+static PNG_AVX2_FUNCTION void
+sub_avx2(png_row_infop row_info, png_bytep row, unsigned int bpp)
+{
+   const size_t block = (16 / bpp) * bpp;
+   const __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+       12, 13, 14, 15);
+   /* Bytes of the block which are not part of a whole pixel. */
+   const __m128i keep = _mm_cmpgt_epi8(index, _mm_set1_epi8((char)(block-1)));
+   __m128i last; /* shuffle to repeat the last pixel of a block */
+   __m128i carry = _mm_setzero_si128();
+   size_t rb = row_info->rowbytes;
+   png_bytep rp = row;
+
+   switch (bpp)
+   {
+      case 3:
+         last = _mm_setr_epi8(12, 13, 14, 12, 13, 14, 12, 13, 14, 12, 13, 14,
+             12, 13, 14, 12);
+         break;
+
+      case 6:
+         last = _mm_setr_epi8(6, 7, 8, 9, 10, 11, 6, 7, 8, 9, 10, 11,
+             6, 7, 8, 9);
+         break;
+
+      case 4:
+         last = _mm_setr_epi8(12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15,
+             12, 13, 14, 15);
+         break;
+
+      default: /* 8 */
+         last = _mm_setr_epi8(8, 9, 10, 11, 12, 13, 14, 15, 8, 9, 10, 11,
+             12, 13, 14, 15);
+         break;
+   }
+
+   /* For 3 and 6 bytes per pixel each block overlaps the next by one or four
+    * bytes, so the next block is loaded before this one is stored; loading it
+    * afterward stalls on the store.
+    */
+   if (rb >= 16)
+   {
+      __m128i raw = _mm_loadu_si128((const __m128i*)(const void*)rp);
+
+      while (rb >= 16)
+      {
+         __m128i x = raw;
+
+         switch (bpp)
+         {
+            case 3:
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 12));
+               break;
+
+            case 4:
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+               break;
+
+            case 6:
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+               break;
+
+            default: /* 8 */
+               x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+               break;
+         }
+
+         x = _mm_add_epi8(x, carry);
+         x = _mm_blendv_epi8(x, raw, keep);
+         carry = _mm_shuffle_epi8(x, last);
+
+         if (rb - block >= 16)
+            raw = _mm_loadu_si128((const __m128i*)(const void*)(rp + block));
+
+         _mm_storeu_si128((__m128i*)(void*)rp, x);
+
+         rp += block;
+         rb -= block;
+      }
+   }
+
+   /* The remaining pixels one at a time; the first pixel of the row has
+    * nothing to its left.
+    */
+   if (rb > 0)
+   {
+      __m128i a = rp > row ? load_pixel(rp - bpp, bpp) : _mm_setzero_si128();
+
+      while (rb > 0)
+      {
+         a = _mm_add_epi8(a, load_pixel(rp, bpp));
+         store_pixel(rp, a, bpp);
+         rp += bpp;
+         rb -= bpp;
+      }
+   }
+}
+
+/* Avg: the truncating average of a and b, one pixel at a time because of the
+ * dependency on a.  A 16-bit pixel fills the low half of a register.
+ */
+static PNG_AVX2_FUNCTION void
+avg_avx2(png_row_infop row_info, png_bytep row, png_const_bytep prev,
+    unsigned int bpp)
+{
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a = _mm_setzero_si128();
+   size_t rb = row_info->rowbytes;
+
+   while (rb > 0)
+   {
+      __m128i b = load_pixel(prev, bpp);
+      __m128i avg = _mm_avg_epu8(a, b);
+
+      /* _mm_avg_epu8 rounds up; subtract 1 where it did. */
+      avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(load_pixel(row, bpp), avg);
+      store_pixel(row, a, bpp);
+
+      prev += bpp;
+      row += bpp;
+      rb -= bpp;
+   }
+}
+
+/* Paeth for one pixel with 16-bit lanes.  b-c and |b-c| depend only on the
+ * previous row and are passed in; the rest depends on a, the pixel just
+ * decoded.  Returns the decoded pixel, which is the next a.
+ */
+static PNG_AVX2_FUNCTION __m128i
+paeth_pixel(png_bytep row, __m128i a, __m128i b, __m128i c, __m128i bc,
+    __m128i pa, unsigned int bpp)
+{
+   __m128i ac = _mm_sub_epi16(a, c);
+   __m128i pb = _mm_abs_epi16(ac);
+   __m128i pc = _mm_abs_epi16(_mm_add_epi16(bc, ac));
+   __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+   __m128i nearest, d;
+
+   /* Paeth breaks ties favoring a over b over c. */
+   nearest = _mm_blendv_epi8(
+       _mm_blendv_epi8(c, b, _mm_cmpeq_epi16(smallest, pb)), a,
+       _mm_cmpeq_epi16(smallest, pa));
+
+   /* The high byte of every lane is zero, so an 8-bit add wraps correctly
+    * and leaves it zero.
+    */
+   d = _mm_add_epi8(_mm_cvtepu8_epi16(load_pixel(row, bpp)), nearest);
+   store_pixel(row, _mm_packus_epi16(d, d), bpp);
+
+   return d;
+}
+
+/* Paeth: b-c and |b-c| for two pixels are computed together in a 256-bit
+ * register, then the two pixels are finished in turn; the rest of the
+ * predictor needs the pixel to the left, so it cannot be done for several
+ * pixels at once.
+ */
+static PNG_AVX2_FUNCTION void
+paeth_avx2(png_row_infop row_info, png_bytep row, png_const_bytep prev,
+    unsigned int bpp)
+{
+   /* The first pixel has no left context; a and c are zero, making p = b. */
+   __m128i a = _mm_setzero_si128();
+   __m128i c = _mm_setzero_si128();
+   size_t rb = row_info->rowbytes;
+
+   while (rb >= 2*bpp)
+   {
+      __m128i b0 = _mm_cvtepu8_epi16(load_pixel(prev, bpp));
+      __m128i b1 = _mm_cvtepu8_epi16(load_pixel(prev + bpp, bpp));
+      __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(b0), b1, 1);
+      __m256i cc = _mm256_inserti128_si256(_mm256_castsi128_si256(c), b0, 1);
+      __m256i bc = _mm256_sub_epi16(b, cc);
+      __m256i pa = _mm256_abs_epi16(bc);
+
+      a = paeth_pixel(row, a, b0, c, _mm256_castsi256_si128(bc),
+          _mm256_castsi256_si128(pa), bpp);
+      a = paeth_pixel(row + bpp, a, b1, b0, _mm256_extracti128_si256(bc, 1),
+          _mm256_extracti128_si256(pa, 1), bpp);
+      c = b1;
+
+      prev += 2*bpp;
+      row += 2*bpp;
+      rb -= 2*bpp;
+   }
+
+   if (rb > 0)
+   {
+      __m128i b = _mm_cvtepu8_epi16(load_pixel(prev, bpp));
+      __m128i bc = _mm_sub_epi16(b, c);
+
+      (void)paeth_pixel(row, a, b, c, bc, _mm_abs_epi16(bc), bpp);
+   }
+}
+
+#define PNG_AVX2_SUB(bpp)\
+PNG_AVX2_FUNCTION void png_read_filter_row_sub ## bpp ## _avx2(\
+   png_row_infop row_info, png_bytep row, png_const_bytep prev)\
+{\
+   png_debug(1, "in png_read_filter_row_sub" #bpp "_avx2");\
+   sub_avx2(row_info, row, bpp);\
+   PNG_UNUSED(prev)\
+}
+
+#define PNG_AVX2_FILTERS(bpp)\
+PNG_AVX2_SUB(bpp)\
+\
+PNG_AVX2_FUNCTION void png_read_filter_row_avg ## bpp ## _avx2(\
+   png_row_infop row_info, png_bytep row, png_const_bytep prev)\
+{\
+   png_debug(1, "in png_read_filter_row_avg" #bpp "_avx2");\
+   avg_avx2(row_info, row, prev, bpp);\
+}\
+\
+PNG_AVX2_FUNCTION void png_read_filter_row_paeth ## bpp ## _avx2(\
+   png_row_infop row_info, png_bytep row, png_const_bytep prev)\
+{\
+   png_debug(1, "in png_read_filter_row_paeth" #bpp "_avx2");\
+   paeth_avx2(row_info, row, prev, bpp);\
+}
+
+PNG_AVX2_SUB(3)
+PNG_AVX2_SUB(4)
+PNG_AVX2_FILTERS(6)
+PNG_AVX2_FILTERS(8)
+
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
+#endif /* READ */
@@ -386,5 +386,100 @@ void png_read_filter_row_paeth4_sse2(png_row_infop row_info, png_bytep row,
    }
 }
 
+#if PNG_INTEL_CPUID_OPT > 0
+/* The Paeth functions above use SSSE3 for abs_i16 and SSE4.1 for if_then_else
+ * only when the compiler targets them.  These versions are compiled for each
+ * level on its own and selected at run time by png_init_filter_functions_sse2,
+ * so a build for plain SSE2 still uses the better instructions where the CPU
+ * has them.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#  define PNG_SSSE3_FUNCTION __attribute__((target("ssse3")))
+#  define PNG_SSE41_FUNCTION __attribute__((target("sse4.1")))
+#else
+#  define PNG_SSSE3_FUNCTION
+#  define PNG_SSE41_FUNCTION
+#endif
+
+static PNG_SSSE3_FUNCTION __m128i abs_i16_ssse3(__m128i x) {
+   return _mm_abs_epi16(x);
+}
+
+static PNG_SSSE3_FUNCTION __m128i if_then_else_ssse3(__m128i c, __m128i t,
+   __m128i e) {
+   return _mm_or_si128(_mm_and_si128(c, t), _mm_andnot_si128(c, e));
+}
+
+static PNG_SSE41_FUNCTION __m128i abs_i16_sse41(__m128i x) {
+   return _mm_abs_epi16(x);
+}
+
+static PNG_SSE41_FUNCTION __m128i if_then_else_sse41(__m128i c, __m128i t,
+   __m128i e) {
+   return _mm_blendv_epi8(e,t,c);
+}
+
+/* The loop of png_read_filter_row_paeth3_sse2 and paeth4_sse2 for 3 or 4 byte
+ * pixels, with the abs_i16 and if_then_else of one level.  As there, 3 byte
+ * pixels are loaded 4 bytes at a time until the last, since load3 is much
+ * slower.
+ */
+#define PNG_SSE_PAETH(level, target)\
+static target void paeth_##level(png_row_infop row_info, png_bytep row,\
+   png_const_bytep prev, unsigned int bpp) {\
+   size_t rb;\
+   const __m128i zero = _mm_setzero_si128();\
+   __m128i c, b = zero,\
+           a, d = zero;\
+\
+   rb = row_info->rowbytes;\
+   while (rb > 0) {\
+      __m128i pa,pb,pc,smallest,nearest;\
+      c = b; b = _mm_unpacklo_epi8(rb >= 4 ? load4(prev) : load3(prev), zero);\
+      a = d; d = _mm_unpacklo_epi8(rb >= 4 ? load4(row ) : load3(row ), zero);\
+\
+      pa = _mm_sub_epi16(b,c);\
+      pb = _mm_sub_epi16(a,c);\
+      pc = _mm_add_epi16(pa,pb);\
+\
+      pa = abs_i16_##level(pa);\
+      pb = abs_i16_##level(pb);\
+      pc = abs_i16_##level(pc);\
+\
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));\
+\
+      nearest  = if_then_else_##level(_mm_cmpeq_epi16(smallest, pa), a,\
+                 if_then_else_##level(_mm_cmpeq_epi16(smallest, pb), b,\
+                                                                     c));\
+\
+      d = _mm_add_epi8(d, nearest);\
+      if (bpp == 4)\
+         store4(row, _mm_packus_epi16(d,d));\
+      else\
+         store3(row, _mm_packus_epi16(d,d));\
+\
+      prev += bpp;\
+      row  += bpp;\
+      rb   -= bpp;\
+   }\
+}\
+\
+target void png_read_filter_row_paeth3_##level(png_row_infop row_info,\
+   png_bytep row, png_const_bytep prev) {\
+   png_debug(1, "in png_read_filter_row_paeth3_" #level);\
+   paeth_##level(row_info, row, prev, 3);\
+}\
+\
+target void png_read_filter_row_paeth4_##level(png_row_infop row_info,\
+   png_bytep row, png_const_bytep prev) {\
+   png_debug(1, "in png_read_filter_row_paeth4_" #level);\
+   paeth_##level(row_info, row, prev, 4);\
+}
+
+PNG_SSE_PAETH(ssse3, PNG_SSSE3_FUNCTION)
+PNG_SSE_PAETH(sse41, PNG_SSE41_FUNCTION)
+
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
+
 #endif /* PNG_INTEL_SSE_IMPLEMENTATION > 0 */
 #endif /* READ */
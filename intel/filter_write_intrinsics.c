@@ -0,0 +1,381 @@
+/* filter_write_intrinsics.c - SSE2 and AVX2 write filter selection
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * png_write_find_filter picks the filter with the smallest sum of absolute
+ * differences, counting bytes >= 128 as negative.  These functions find the
+ * sums for all five filters in one pass over the row and the previous row,
+ * then apply the chosen filter, instead of filtering the row once for each
+ * filter.
+ */
+
+#include "../pngpriv.h"
+
+#ifdef PNG_WRITE_FILTER_SUPPORTED
+
+#if PNG_INTEL_SSE_IMPLEMENTATION > 0
+
+#include <immintrin.h>
+
+/* As in filter_sse2_intrinsics.c the bytes are named:
+ *    prev:  c b
+ *    row:   a x
+ * with a and c zero for the first pixel.
+ */
+#define SAD(v) ((v) < 128 ? (v) : 256 - (v))
+
+static unsigned int
+paeth_predictor(unsigned int a, unsigned int b, unsigned int c)
+{
+   int p = (int)b - (int)c;
+   int pc = (int)a - (int)c;
+   int pa, pb;
+
+   pa = p < 0 ? -p : p;
+   pb = pc < 0 ? -pc : pc;
+   pc = (p + pc) < 0 ? -(p + pc) : p + pc;
+
+   return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+/* Add the bytes from i to end to the sums one at a time; used for the first
+ * pixel and the bytes after the last whole vector.
+ */
+static void
+sums_bytes(png_const_bytep row, png_const_bytep prev, size_t i, size_t end,
+    unsigned int bpp, size_t *sums)
+{
+   for (; i < end; i++)
+   {
+      unsigned int x = row[i], b = prev[i];
+      unsigned int a = i >= bpp ? row[i-bpp] : 0;
+      unsigned int c = i >= bpp ? prev[i-bpp] : 0;
+      unsigned int v;
+
+      sums[0] += SAD(x);
+      v = (x - a) & 0xff;
+      sums[1] += SAD(v);
+      v = (x - b) & 0xff;
+      sums[2] += SAD(v);
+      v = (x - ((a + b) >> 1)) & 0xff;
+      sums[3] += SAD(v);
+      v = (x - paeth_predictor(a, b, c)) & 0xff;
+      sums[4] += SAD(v);
+   }
+}
+
+static void
+filter_bytes(png_bytep out, png_const_bytep row, png_const_bytep prev,
+    size_t i, size_t end, unsigned int bpp, int filter)
+{
+   for (; i < end; i++)
+   {
+      unsigned int x = row[i], p;
+      unsigned int a = i >= bpp ? row[i-bpp] : 0;
+
+      switch (filter)
+      {
+         case PNG_FILTER_VALUE_SUB:
+            p = a;
+            break;
+
+         case PNG_FILTER_VALUE_UP:
+            p = prev[i];
+            break;
+
+         case PNG_FILTER_VALUE_AVG:
+            p = (a + prev[i]) >> 1;
+            break;
+
+         default: /* PAETH */
+            p = paeth_predictor(a, prev[i], i >= bpp ? prev[i-bpp] : 0);
+            break;
+      }
+
+      out[i] = (png_byte)((x - p) & 0xff);
+   }
+}
+
+/* Return the two 64-bit sums of a _mm_sad_epu8 result added together. */
+static size_t
+sum64x2(__m128i s)
+{
+   png_uint_32 t[4];
+
+   _mm_storeu_si128((__m128i*)(void*)t, s);
+   /* The high halves are zero if size_t is 32 bits; see the overflow check
+    * in png_write_find_filter.
+    */
+   return (size_t)t[0] + (size_t)t[2] +
+       (((size_t)t[1] + (size_t)t[3]) << 16 << 16);
+}
+
+#define LOAD(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+
+/* |v| for signed bytes as an unsigned byte, summed in 64-bit lanes. */
+static __m128i
+sad_sse2(__m128i v)
+{
+   const __m128i zero = _mm_setzero_si128();
+
+   return _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(zero, v)), zero);
+}
+
+/* The truncating average; _mm_avg_epu8 rounds up. */
+static __m128i
+avg_sse2(__m128i a, __m128i b)
+{
+   return _mm_sub_epi8(_mm_avg_epu8(a, b),
+       _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+/* The Paeth predictor in 16-bit lanes; ties favor a over b over c. */
+static __m128i
+paeth16_sse2(__m128i a, __m128i b, __m128i c)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i p = _mm_sub_epi16(b, c);
+   __m128i q = _mm_sub_epi16(a, c);
+   __m128i r = _mm_add_epi16(p, q);
+   __m128i pa = _mm_max_epi16(p, _mm_sub_epi16(zero, p));
+   __m128i pb = _mm_max_epi16(q, _mm_sub_epi16(zero, q));
+   __m128i pc = _mm_max_epi16(r, _mm_sub_epi16(zero, r));
+   __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb),
+       _mm_cmpgt_epi16(pa, pc));
+   __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+   __m128i bc = _mm_or_si128(_mm_and_si128(not_b, c),
+       _mm_andnot_si128(not_b, b));
+
+   return _mm_or_si128(_mm_and_si128(not_a, bc), _mm_andnot_si128(not_a, a));
+}
+
+static __m128i
+paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+   const __m128i zero = _mm_setzero_si128();
+
+   return _mm_packus_epi16(
+       paeth16_sse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero),
+           _mm_unpacklo_epi8(c, zero)),
+       paeth16_sse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero),
+           _mm_unpackhi_epi8(c, zero)));
+}
+
+void
+png_write_filter_sums_sse2(png_const_bytep row, png_const_bytep prev,
+    size_t row_bytes, unsigned int bpp, size_t *sums)
+{
+   __m128i none, sub, up, avg, paeth;
+   size_t i;
+
+   png_debug(1, "in png_write_filter_sums_sse2");
+
+   none = sub = up = avg = paeth = _mm_setzero_si128();
+   sums[0] = sums[1] = sums[2] = sums[3] = sums[4] = 0;
+
+   /* The first pixel has no left context. */
+   sums_bytes(row, prev, 0, bpp, bpp, sums);
+
+   for (i = bpp; i + 16 <= row_bytes; i += 16)
+   {
+      __m128i x = LOAD(row + i), a = LOAD(row + i - bpp);
+      __m128i b = LOAD(prev + i), c = LOAD(prev + i - bpp);
+
+      none = _mm_add_epi64(none, sad_sse2(x));
+      sub = _mm_add_epi64(sub, sad_sse2(_mm_sub_epi8(x, a)));
+      up = _mm_add_epi64(up, sad_sse2(_mm_sub_epi8(x, b)));
+      avg = _mm_add_epi64(avg, sad_sse2(_mm_sub_epi8(x, avg_sse2(a, b))));
+      paeth = _mm_add_epi64(paeth,
+          sad_sse2(_mm_sub_epi8(x, paeth_sse2(a, b, c))));
+   }
+
+   sums_bytes(row, prev, i, row_bytes, bpp, sums);
+
+   sums[0] += sum64x2(none);
+   sums[1] += sum64x2(sub);
+   sums[2] += sum64x2(up);
+   sums[3] += sum64x2(avg);
+   sums[4] += sum64x2(paeth);
+}
+
+void
+png_write_filter_row_sse2(png_bytep out, png_const_bytep row,
+    png_const_bytep prev, size_t row_bytes, unsigned int bpp, int filter)
+{
+   size_t i;
+
+   png_debug(1, "in png_write_filter_row_sse2");
+
+   filter_bytes(out, row, prev, 0, bpp, bpp, filter);
+
+   for (i = bpp; i + 16 <= row_bytes; i += 16)
+   {
+      __m128i x = LOAD(row + i), a = LOAD(row + i - bpp), p;
+
+      switch (filter)
+      {
+         case PNG_FILTER_VALUE_SUB:
+            p = a;
+            break;
+
+         case PNG_FILTER_VALUE_UP:
+            p = LOAD(prev + i);
+            break;
+
+         case PNG_FILTER_VALUE_AVG:
+            p = avg_sse2(a, LOAD(prev + i));
+            break;
+
+         default: /* PAETH */
+            p = paeth_sse2(a, LOAD(prev + i), LOAD(prev + i - bpp));
+            break;
+      }
+
+      _mm_storeu_si128((__m128i*)(void*)(out + i), _mm_sub_epi8(x, p));
+   }
+
+   filter_bytes(out, row, prev, i, row_bytes, bpp, filter);
+}
+
+#if PNG_INTEL_CPUID_OPT > 0
+/* The same with 32 bytes at a time.  The unpack and pack instructions work
+ * within each 128-bit half, so the bytes come back in order.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#  define PNG_AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#  define PNG_AVX2_FUNCTION
+#endif
+
+#define LOAD256(p) _mm256_loadu_si256((const __m256i*)(const void*)(p))
+
+static PNG_AVX2_FUNCTION size_t
+sum64x4(__m256i s)
+{
+   return sum64x2(_mm_add_epi64(_mm256_castsi256_si128(s),
+       _mm256_extracti128_si256(s, 1)));
+}
+
+static PNG_AVX2_FUNCTION __m256i
+sad_avx2(__m256i v)
+{
+   const __m256i zero = _mm256_setzero_si256();
+
+   return _mm256_sad_epu8(_mm256_min_epu8(v, _mm256_sub_epi8(zero, v)), zero);
+}
+
+static PNG_AVX2_FUNCTION __m256i
+avg_avx2(__m256i a, __m256i b)
+{
+   return _mm256_sub_epi8(_mm256_avg_epu8(a, b),
+       _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+}
+
+static PNG_AVX2_FUNCTION __m256i
+paeth16_avx2(__m256i a, __m256i b, __m256i c)
+{
+   __m256i p = _mm256_sub_epi16(b, c);
+   __m256i q = _mm256_sub_epi16(a, c);
+   __m256i pa = _mm256_abs_epi16(p);
+   __m256i pb = _mm256_abs_epi16(q);
+   __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(p, q));
+   __m256i not_a = _mm256_or_si256(_mm256_cmpgt_epi16(pa, pb),
+       _mm256_cmpgt_epi16(pa, pc));
+
+   return _mm256_blendv_epi8(a,
+       _mm256_blendv_epi8(b, c, _mm256_cmpgt_epi16(pb, pc)), not_a);
+}
+
+static PNG_AVX2_FUNCTION __m256i
+paeth_avx2(__m256i a, __m256i b, __m256i c)
+{
+   const __m256i zero = _mm256_setzero_si256();
+
+   return _mm256_packus_epi16(
+       paeth16_avx2(_mm256_unpacklo_epi8(a, zero),
+           _mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(c, zero)),
+       paeth16_avx2(_mm256_unpackhi_epi8(a, zero),
+           _mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(c, zero)));
+}
+
+PNG_AVX2_FUNCTION void
+png_write_filter_sums_avx2(png_const_bytep row, png_const_bytep prev,
+    size_t row_bytes, unsigned int bpp, size_t *sums)
+{
+   __m256i none, sub, up, avg, paeth;
+   size_t i;
+
+   png_debug(1, "in png_write_filter_sums_avx2");
+
+   none = sub = up = avg = paeth = _mm256_setzero_si256();
+   sums[0] = sums[1] = sums[2] = sums[3] = sums[4] = 0;
+
+   sums_bytes(row, prev, 0, bpp, bpp, sums);
+
+   for (i = bpp; i + 32 <= row_bytes; i += 32)
+   {
+      __m256i x = LOAD256(row + i), a = LOAD256(row + i - bpp);
+      __m256i b = LOAD256(prev + i), c = LOAD256(prev + i - bpp);
+
+      none = _mm256_add_epi64(none, sad_avx2(x));
+      sub = _mm256_add_epi64(sub, sad_avx2(_mm256_sub_epi8(x, a)));
+      up = _mm256_add_epi64(up, sad_avx2(_mm256_sub_epi8(x, b)));
+      avg = _mm256_add_epi64(avg,
+          sad_avx2(_mm256_sub_epi8(x, avg_avx2(a, b))));
+      paeth = _mm256_add_epi64(paeth,
+          sad_avx2(_mm256_sub_epi8(x, paeth_avx2(a, b, c))));
+   }
+
+   sums_bytes(row, prev, i, row_bytes, bpp, sums);
+
+   sums[0] += sum64x4(none);
+   sums[1] += sum64x4(sub);
+   sums[2] += sum64x4(up);
+   sums[3] += sum64x4(avg);
+   sums[4] += sum64x4(paeth);
+}
+
+PNG_AVX2_FUNCTION void
+png_write_filter_row_avx2(png_bytep out, png_const_bytep row,
+    png_const_bytep prev, size_t row_bytes, unsigned int bpp, int filter)
+{
+   size_t i;
+
+   png_debug(1, "in png_write_filter_row_avx2");
+
+   filter_bytes(out, row, prev, 0, bpp, bpp, filter);
+
+   for (i = bpp; i + 32 <= row_bytes; i += 32)
+   {
+      __m256i x = LOAD256(row + i), a = LOAD256(row + i - bpp), p;
+
+      switch (filter)
+      {
+         case PNG_FILTER_VALUE_SUB:
+            p = a;
+            break;
+
+         case PNG_FILTER_VALUE_UP:
+            p = LOAD256(prev + i);
+            break;
+
+         case PNG_FILTER_VALUE_AVG:
+            p = avg_avx2(a, LOAD256(prev + i));
+            break;
+
+         default: /* PAETH */
+            p = paeth_avx2(a, LOAD256(prev + i), LOAD256(prev + i - bpp));
+            break;
+      }
+
+      _mm256_storeu_si256((__m256i*)(void*)(out + i), _mm256_sub_epi8(x, p));
+   }
+
+   filter_bytes(out, row, prev, i, row_bytes, bpp, filter);
+}
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
+
+#endif /* PNG_INTEL_SSE_IMPLEMENTATION > 0 */
+#endif /* WRITE_FILTER */
@@ -1,4 +1,5 @@
-/* intel_init.c - SSE2 optimized filter functions
+/* intel_init.c - SSE2 optimized filter functions, read transform and CRC-32
+ * selection
  *
  * Copyright (c) 2018 Cosmin Truta
  * Copyright (c) 2016-2017 Glenn Randers-Pehrson
@@ -12,6 +13,123 @@
 
 #include "../pngpriv.h"
 
+#if PNG_INTEL_CPUID_OPT > 0
+#ifdef _MSC_VER
+#  include <intrin.h>
+#else
+#  include <cpuid.h>
+#endif
+
+#define PNG_INTEL_HAVE_PCLMUL 0x01U
+#define PNG_INTEL_HAVE_SSSE3  0x02U
+#define PNG_INTEL_HAVE_SSE4_1 0x04U
+#define PNG_INTEL_HAVE_AVX2   0x08U
+#define PNG_INTEL_CHECKED     0x80U /* never zero once checked */
+
+/* Return the PNG_INTEL_HAVE_ flags for the features of this CPU which libpng
+ * can use.  AVX2 also needs the operating system to save the YMM registers,
+ * which XGETBV reports.
+ */
+static unsigned int
+png_intel_check_cpu(void)
+{
+   unsigned int features = 0;
+   unsigned int max_leaf, eax, ebx, ecx, edx;
+#ifdef _MSC_VER
+   int info[4];
+
+   __cpuid(info, 0);
+   max_leaf = (unsigned int)info[0];
+#else
+   max_leaf = __get_cpuid_max(0, NULL);
+#endif
+
+   if (max_leaf < 1)
+      return 0;
+
+#ifdef _MSC_VER
+   __cpuid(info, 1);
+   ecx = (unsigned int)info[2];
+#else
+   __cpuid(1, eax, ebx, ecx, edx);
+#endif
+
+   if ((ecx & 0x2U) != 0) /* PCLMULQDQ */
+      features |= PNG_INTEL_HAVE_PCLMUL;
+
+   if ((ecx & 0x200U) != 0) /* SSSE3 */
+   {
+      features |= PNG_INTEL_HAVE_SSSE3;
+
+      if ((ecx & 0x80000U) != 0) /* SSE4.1 */
+         features |= PNG_INTEL_HAVE_SSE4_1;
+   }
+
+   /* OSXSAVE and AVX, then the OS must enable the XMM and YMM state. */
+   if ((features & PNG_INTEL_HAVE_SSE4_1) != 0 &&
+       (ecx & 0x18000000U) == 0x18000000U && max_leaf >= 7)
+   {
+      unsigned int xcr0;
+
+#ifdef _MSC_VER
+      xcr0 = (unsigned int)_xgetbv(0);
+      __cpuidex(info, 7, 0);
+      ebx = (unsigned int)info[1];
+#else
+      __asm__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+#endif
+
+      if ((xcr0 & 0x6U) == 0x6U && (ebx & 0x20U) != 0) /* AVX2 */
+         features |= PNG_INTEL_HAVE_AVX2;
+   }
+
+   return features;
+}
+
+/* CPUID is only executed once in a process; it can be slow, particularly in a
+ * virtual machine.  Every thread stores the same value, so the race on the
+ * first call does no harm.
+ */
+static unsigned int
+png_intel_cpu_features(void)
+{
+   static volatile unsigned int features = 0; /* not checked */
+
+   if (features == 0)
+      features = png_intel_check_cpu() | PNG_INTEL_CHECKED;
+
+   return features;
+}
+
+/* Return the features the filters may use.  The levels are cumulative: turning
+ * one off with png_set_option turns off those above it too, so each level can
+ * be timed on its own.  The level the compiler targets is always used.
+ */
+static unsigned int
+png_intel_filter_features(png_const_structrp pp)
+{
+   unsigned int features = png_intel_cpu_features();
+
+#ifdef PNG_INTEL_SSE_API_SUPPORTED
+   if (((pp->options >> PNG_INTEL_SSSE3) & 3) == PNG_OPTION_OFF)
+      features &= ~PNG_INTEL_HAVE_SSSE3;
+
+   if (((pp->options >> PNG_INTEL_SSE4_1) & 3) == PNG_OPTION_OFF ||
+       (features & PNG_INTEL_HAVE_SSSE3) == 0)
+      features &= ~PNG_INTEL_HAVE_SSE4_1;
+
+   if (((pp->options >> PNG_INTEL_AVX2) & 3) == PNG_OPTION_OFF ||
+       (features & PNG_INTEL_HAVE_SSE4_1) == 0)
+      features &= ~PNG_INTEL_HAVE_AVX2;
+#else
+   PNG_UNUSED(pp)
+#endif
+
+   return features;
+}
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
+
 #ifdef PNG_READ_SUPPORTED
 #if PNG_INTEL_SSE_IMPLEMENTATION > 0
 
@@ -26,6 +144,10 @@ png_init_filter_functions_sse2(png_structp pp, unsigned int bpp)
     * Most of these can be implemented using only MMX and 64-bit registers,
     * but they end up a bit slower than using the equally-ubiquitous SSE2.
    */
+#if PNG_INTEL_CPUID_OPT > 0
+   unsigned int features;
+#endif
+
    png_debug(1, "in png_init_filter_functions_sse2");
    if (bpp == 3)
    {
@@ -45,7 +167,171 @@ png_init_filter_functions_sse2(png_structp pp, unsigned int bpp)
    /* No need optimize PNG_FILTER_VALUE_UP.  The compiler should
     * autovectorize.
     */
+
+#if PNG_INTEL_CPUID_OPT > 0
+   features = png_intel_filter_features(pp);
+
+   /* Paeth is the filter that gains from SSSE3 (abs) and SSE4.1 (blendv). */
+   if ((features & PNG_INTEL_HAVE_SSE4_1) != 0)
+   {
+      if (bpp == 3)
+         pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+            png_read_filter_row_paeth3_sse41;
+      else if (bpp == 4)
+         pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+            png_read_filter_row_paeth4_sse41;
+   }
+   else if ((features & PNG_INTEL_HAVE_SSSE3) != 0)
+   {
+      if (bpp == 3)
+         pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+            png_read_filter_row_paeth3_ssse3;
+      else if (bpp == 4)
+         pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+            png_read_filter_row_paeth4_ssse3;
+   }
+
+   /* The AVX2 functions unfilter several pixels at once for Sub.  For Avg
+    * and Paeth, where each pixel needs the one before it, they only cover the
+    * 16-bit formats; the functions above are as fast for 3 and 4 bytes.
+    */
+   if ((features & PNG_INTEL_HAVE_AVX2) != 0)
+   {
+      switch (bpp)
+      {
+         case 3:
+            pp->read_filter[PNG_FILTER_VALUE_SUB-1] =
+               png_read_filter_row_sub3_avx2;
+            break;
+
+         case 4:
+            pp->read_filter[PNG_FILTER_VALUE_SUB-1] =
+               png_read_filter_row_sub4_avx2;
+            break;
+
+         case 6:
+            pp->read_filter[PNG_FILTER_VALUE_SUB-1] =
+               png_read_filter_row_sub6_avx2;
+            pp->read_filter[PNG_FILTER_VALUE_AVG-1] =
+               png_read_filter_row_avg6_avx2;
+            pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+               png_read_filter_row_paeth6_avx2;
+            break;
+
+         case 8:
+            pp->read_filter[PNG_FILTER_VALUE_SUB-1] =
+               png_read_filter_row_sub8_avx2;
+            pp->read_filter[PNG_FILTER_VALUE_AVG-1] =
+               png_read_filter_row_avg8_avx2;
+            pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
+               png_read_filter_row_paeth8_avx2;
+            break;
+
+         default:
+            break;
+      }
+   }
+#endif
 }
 
 #endif /* PNG_INTEL_SSE_IMPLEMENTATION > 0 */
 #endif /* PNG_READ_SUPPORTED */
+
+#ifdef PNG_WRITE_FILTER_SUPPORTED
+#if PNG_INTEL_SSE_IMPLEMENTATION > 0
+void
+png_init_write_filter_functions_sse2(png_structp pp)
+{
+   png_debug(1, "in png_init_write_filter_functions_sse2");
+
+   pp->write_filter_sums = png_write_filter_sums_sse2;
+   pp->write_filter_row = png_write_filter_row_sse2;
+
+#if PNG_INTEL_CPUID_OPT > 0
+   if ((png_intel_filter_features(pp) & PNG_INTEL_HAVE_AVX2) != 0)
+   {
+      pp->write_filter_sums = png_write_filter_sums_avx2;
+      pp->write_filter_row = png_write_filter_row_avx2;
+   }
+#endif
+}
+#endif /* PNG_INTEL_SSE_IMPLEMENTATION > 0 */
+#endif /* WRITE_FILTER */
+
+#if PNG_INTEL_CPUID_OPT > 0
+#ifdef PNG_READ_TRANSFORMS_SUPPORTED
+void
+png_init_read_transforms_intel(png_structp pp)
+{
+   unsigned int features = png_intel_filter_features(pp);
+
+   png_debug(1, "in png_init_read_transforms_intel");
+
+#ifdef PNG_READ_INTERLACING_SUPPORTED
+   pp->read_combine_row = png_combine_row_sse2;
+#endif
+
+   if ((features & PNG_INTEL_HAVE_SSSE3) != 0)
+   {
+      pp->read_byte_map = png_do_byte_map_ssse3;
+#ifdef PNG_READ_EXPAND_SUPPORTED
+      pp->read_palette_map = png_do_palette_map_ssse3;
+#endif
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+      pp->read_scale_16_to_8 = png_do_scale_16_to_8_ssse3;
+#endif
+#ifdef PNG_READ_INTERLACING_SUPPORTED
+      pp->read_deinterlace = png_do_read_deinterlace_ssse3;
+#endif
+   }
+
+   /* There is no SSSE3 gamma: a 256 entry table as sixteen PSHUFB lookups is
+    * no faster than the table lookups of png_do_gamma.
+    */
+   if ((features & PNG_INTEL_HAVE_AVX2) != 0)
+   {
+#ifdef PNG_READ_EXPAND_SUPPORTED
+      pp->read_palette_map = png_do_palette_map_avx2;
+#endif
+#ifdef PNG_READ_GAMMA_SUPPORTED
+      pp->read_gamma_8 = png_do_gamma_8_avx2;
+      pp->read_gamma_16 = png_do_gamma_16_avx2;
+#endif
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED)
+      pp->read_compose_8 = png_do_compose_8_avx2;
+#endif
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+      pp->read_rgb_to_gray_8 = png_do_rgb_to_gray_8_avx2;
+      pp->read_rgb_to_gray_16 = png_do_rgb_to_gray_16_avx2;
+#endif
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+      pp->read_scale_16_to_8 = png_do_scale_16_to_8_avx2;
+#endif
+   }
+}
+#endif
+
+#ifdef PNG_SIMPLIFIED_WRITE_SUPPORTED
+void
+png_init_simplified_write_intel(png_structp pp)
+{
+   png_debug(1, "in png_init_simplified_write_intel");
+
+   /* There is no SSE version: without gathers the two table lookups for each
+    * sample take longer than the arithmetic that SSE could do.
+    */
+   if ((png_intel_filter_features(pp) & PNG_INTEL_HAVE_AVX2) != 0)
+      pp->write_sRGB_8 = png_write_sRGB_8_avx2;
+}
+#endif
+
+void
+png_init_crc32_intel(png_structp pp)
+{
+   png_debug(1, "in png_init_crc32_intel");
+
+   if ((png_intel_cpu_features() & PNG_INTEL_HAVE_PCLMUL) != 0)
+      pp->crc32_blocks = png_crc32_pclmul;
+}
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
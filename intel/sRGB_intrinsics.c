@@ -0,0 +1,193 @@
+/* sRGB_intrinsics.c - AVX2 optimized linear to sRGB conversion
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * This is selected at run time by png_init_simplified_write_intel when the
+ * CPU supports the instructions.
+ */
+
+#include "../pngpriv.h"
+
+#ifdef PNG_SIMPLIFIED_WRITE_SUPPORTED
+
+#if PNG_INTEL_CPUID_OPT > 0
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define PNG_AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#  define PNG_AVX2_FUNCTION
+#endif
+
+/* PNG_sRGB_FROM_LINEAR for eight values in the range 0..255*65535. */
+static __m256i PNG_AVX2_FUNCTION
+sRGB_from_linear(__m256i linear)
+{
+   const __m256i low15 = _mm256_set1_epi32(0x7fff);
+   const __m256i low16 = _mm256_set1_epi32(0xffff);
+   __m256i entry = _mm256_i32gather_epi32(
+       (const int *)png_sRGB_base_delta, _mm256_srli_epi32(linear, 15), 4);
+   __m256i value = _mm256_mullo_epi32(_mm256_and_si256(linear, low15),
+       _mm256_srli_epi32(entry, 16));
+
+   value = _mm256_add_epi32(_mm256_and_si256(entry, low16),
+       _mm256_srli_epi32(value, 12));
+
+   return _mm256_and_si256(_mm256_srli_epi32(value, 8),
+       _mm256_set1_epi32(0xff));
+}
+
+/* UNP_RECIPROCAL from pngwrite.c for four alpha values, with 0 in place of
+ * an alpha of 0.  The quotient is less than 2^31 so the double division is
+ * exact after truncation.
+ */
+static __m128i PNG_AVX2_FUNCTION
+unp_reciprocal(__m128i alpha)
+{
+   __m128i n = _mm_add_epi32(_mm_set1_epi32((0xffff*0xff)<<7),
+       _mm_srli_epi32(alpha, 1));
+   __m128i zero = _mm_cmpeq_epi32(alpha, _mm_setzero_si128());
+   __m128i q = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(n),
+       _mm256_cvtepi32_pd(_mm_sub_epi32(alpha, zero))));
+
+   return _mm_andnot_si128(zero, q);
+}
+
+/* png_unpremultiply for eight samples, c, with the alpha of each sample's
+ * pixel in a and UNP_RECIPROCAL(a) in reciprocal; the alpha samples
+ * themselves, selected by is_alpha, are scaled to 8 bits.
+ */
+static __m256i PNG_AVX2_FUNCTION
+unpremultiply_8(__m256i c, __m256i a, __m256i reciprocal, __m256i is_alpha)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i max = _mm256_set1_epi32(255);
+   __m256i alphabyte, linear, result, fixed;
+
+   /* PNG_DIV257; the reciprocal is only used for alphabyte in 1..254. */
+   alphabyte = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(a, max),
+       _mm256_set1_epi32(32895)), 16);
+   reciprocal = _mm256_and_si256(reciprocal, _mm256_andnot_si256(
+       _mm256_cmpeq_epi32(alphabyte, max), _mm256_cmpgt_epi32(alphabyte,
+       zero)));
+
+   /* The samples which come out as 255 are zeroed before the table lookup
+    * because c*reciprocal may overflow for them, and then the table index
+    * would be out of range.
+    */
+   fixed = _mm256_or_si256(
+       _mm256_cmpgt_epi32(c, _mm256_sub_epi32(a, _mm256_set1_epi32(1))),
+       _mm256_cmpgt_epi32(_mm256_set1_epi32(128), a));
+   linear = _mm256_blendv_epi8(
+       _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(c, reciprocal),
+       _mm256_set1_epi32(64)), 7),
+       _mm256_mullo_epi32(c, max),
+       _mm256_cmpgt_epi32(a, _mm256_set1_epi32(65406)));
+   result = _mm256_and_si256(sRGB_from_linear(
+       _mm256_andnot_si256(fixed, linear)), _mm256_cmpgt_epi32(c, zero));
+   result = _mm256_blendv_epi8(result, max, fixed);
+
+   return _mm256_blendv_epi8(result, alphabyte, is_alpha);
+}
+
+/* Eight samples, as 32-bit values, to eight bytes at out. */
+static void PNG_AVX2_FUNCTION
+store_8(png_bytep out, __m256i v)
+{
+   __m256i p = _mm256_packus_epi16(_mm256_packus_epi32(v, v),
+       _mm256_setzero_si256());
+
+   _mm_storel_epi64((__m128i *)out, _mm_unpacklo_epi32(
+       _mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1)));
+}
+
+/* The same as png_write_image_8bit: alpha is the index of the alpha sample
+ * in the pixel, which then has two or four channels, or -1 if there is none.
+ * Eight samples are converted at a time and the number of whole pixels done
+ * is returned; the caller converts the rest.
+ */
+png_uint_32 PNG_AVX2_FUNCTION
+png_write_sRGB_8_avx2(png_bytep out, png_const_uint_16p in,
+    png_uint_32 width, unsigned int channels, int alpha)
+{
+   size_t samples = (size_t)width * channels;
+   size_t i;
+
+   if (alpha < 0)
+   {
+      const __m256i scale = _mm256_set1_epi32(255);
+
+      for (i = 0; i + 8 <= samples; i += 8)
+      {
+         __m256i c = _mm256_cvtepu16_epi32(
+             _mm_loadu_si128((const __m128i *)(in + i)));
+
+         store_8(out + i, sRGB_from_linear(_mm256_mullo_epi32(c, scale)));
+      }
+
+      return (png_uint_32)(i / channels);
+   }
+
+   else if (channels == 4)
+   {
+      /* Four pixels at a time, so that one division finds the four
+       * reciprocals.
+       */
+      const __m256i is_alpha = _mm256_cmpeq_epi32(
+          _mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3), _mm256_set1_epi32(alpha));
+      const __m256i pick = _mm256_setr_epi32(alpha, alpha+4, alpha, alpha+4,
+          alpha, alpha+4, alpha, alpha+4);
+
+      for (i = 0; i + 16 <= samples; i += 16)
+      {
+         __m256i c0 = _mm256_cvtepu16_epi32(
+             _mm_loadu_si128((const __m128i *)(in + i)));
+         __m256i c1 = _mm256_cvtepu16_epi32(
+             _mm_loadu_si128((const __m128i *)(in + i + 8)));
+         __m256i r = _mm256_castsi128_si256(unp_reciprocal(
+             _mm_unpacklo_epi64(
+             _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(c0, pick)),
+             _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(c1, pick)))));
+
+         store_8(out + i, unpremultiply_8(c0, _mm256_permutevar8x32_epi32(c0,
+             _mm256_setr_epi32(alpha, alpha, alpha, alpha, alpha+4, alpha+4,
+             alpha+4, alpha+4)), _mm256_permutevar8x32_epi32(r,
+             _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1)), is_alpha));
+         store_8(out + i + 8, unpremultiply_8(c1, _mm256_permutevar8x32_epi32(
+             c1, _mm256_setr_epi32(alpha, alpha, alpha, alpha, alpha+4,
+             alpha+4, alpha+4, alpha+4)), _mm256_permutevar8x32_epi32(r,
+             _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3)), is_alpha));
+      }
+
+      return (png_uint_32)(i / 4);
+   }
+
+   else /* channels == 2 */
+   {
+      const __m256i is_alpha = _mm256_cmpeq_epi32(
+          _mm256_setr_epi32(0, 1, 0, 1, 0, 1, 0, 1), _mm256_set1_epi32(alpha));
+      const __m256i pick = _mm256_setr_epi32(alpha, alpha+2, alpha+4, alpha+6,
+          alpha, alpha+2, alpha+4, alpha+6);
+      const __m256i spread = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+
+      for (i = 0; i + 8 <= samples; i += 8)
+      {
+         __m256i c = _mm256_cvtepu16_epi32(
+             _mm_loadu_si128((const __m128i *)(in + i)));
+         __m256i a = _mm256_permutevar8x32_epi32(c, pick);
+         __m256i r = _mm256_castsi128_si256(
+             unp_reciprocal(_mm256_castsi256_si128(a)));
+
+         store_8(out + i, unpremultiply_8(c,
+             _mm256_permutevar8x32_epi32(a, spread),
+             _mm256_permutevar8x32_epi32(r, spread), is_alpha));
+      }
+
+      return (png_uint_32)(i / 2);
+   }
+}
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
+#endif /* SIMPLIFIED_WRITE */
@@ -0,0 +1,1105 @@
+/* transform_intrinsics.c - SSE2, SSSE3 and AVX2 optimized read transforms
+ *
+ * This code is released under the libpng license.
+ * For conditions of distribution and use, see the disclaimer
+ * and license in png.h
+ *
+ * These are selected at run time by png_init_read_transforms_intel when the
+ * CPU supports the instructions.
+ */
+
+#include "../pngpriv.h"
+
+#ifdef PNG_READ_TRANSFORMS_SUPPORTED
+
+#if PNG_INTEL_CPUID_OPT > 0
+
+#include <immintrin.h>
+
+/* The instructions are enabled for these functions alone. */
+#if defined(__GNUC__) || defined(__clang__)
+#  define PNG_SSSE3_FUNCTION __attribute__((target("ssse3")))
+#  define PNG_AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#  define PNG_SSSE3_FUNCTION
+#  define PNG_AVX2_FUNCTION
+#endif
+
+/* One pixel of the byte map; the pixel is read before it is written. */
+static void
+byte_map_pixel(png_bytep dp, png_const_bytep sp, unsigned int in_bytes,
+    unsigned int out_bytes, png_const_bytep src, png_const_bytep value)
+{
+   png_byte pixel[16];
+   unsigned int j;
+
+   memcpy(pixel, sp, in_bytes);
+   memcpy(pixel + 8, value, 8);
+
+   for (j = 0; j < out_bytes; ++j)
+      dp[j] = pixel[src[j]];
+}
+
+/* The byte map of the fused read transforms (see pngrtran.c) is a PSHUFB:
+ * each 16 byte vector holds as many whole pixels as fit in both the input and
+ * the output, and the constant bytes are ORed in afterwards.
+ *
+ * The row is transformed in place, so the unaligned 16 byte loads and stores
+ * must not reach bytes that are still to be read:
+ *
+ * - pixels which get larger are done from the end of the row, with the pixels
+ *   at the end of each vector, until the store would reach the input of the
+ *   pixels before the vector;
+ * - pixels which get smaller are done from the start once the output is 16
+ *   bytes behind the input;
+ * - pixels of the same size store the bytes after the last whole pixel back
+ *   unchanged.
+ *
+ * The few pixels left at the start or end of the row are done one at a time.
+ */
+void PNG_SSSE3_FUNCTION
+png_do_byte_map_ssse3(png_bytep row, png_uint_32 width, unsigned int in_bytes,
+    unsigned int out_bytes, png_const_bytep src, png_const_bytep value)
+{
+   const int grow = out_bytes > in_bytes;
+   const size_t block = 16 / (grow ? out_bytes : in_bytes);
+   const size_t in_block = block * in_bytes, out_block = block * out_bytes;
+   png_byte control[16], constant[16];
+   __m128i shuffle, fill;
+   size_t n, i;
+   unsigned int j;
+
+   for (i = 0; i < 16; ++i)
+   {
+      control[i] = (png_byte)i;
+      constant[i] = 0;
+   }
+
+   for (i = 0; i < block; ++i)
+   {
+      const size_t in_pos = (grow ? 16 - in_block : 0) + i * in_bytes;
+      const size_t out_pos = (grow ? 16 - out_block : 0) + i * out_bytes;
+
+      for (j = 0; j < out_bytes; ++j)
+      {
+         if (src[j] < 8)
+            control[out_pos + j] = (png_byte)(in_pos + src[j]);
+
+         else
+         {
+            control[out_pos + j] = 0x80; /* zero */
+            constant[out_pos + j] = value[src[j] - 8];
+         }
+      }
+   }
+
+   shuffle = _mm_loadu_si128((const __m128i*)(const void*)control);
+   fill = _mm_loadu_si128((const __m128i*)(const void*)constant);
+   n = width;
+
+   if (grow != 0)
+   {
+      /* The pixels before n are still to be done. */
+      while (n >= block && n * in_bytes >= 16 &&
+          n * out_bytes - 16 >= (n - block) * in_bytes)
+      {
+         __m128i v = _mm_loadu_si128(
+             (const __m128i*)(const void*)(row + n * in_bytes - 16));
+
+         v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), fill);
+         _mm_storeu_si128((__m128i*)(void*)(row + n * out_bytes - 16), v);
+         n -= block;
+      }
+
+      while (n > 0)
+      {
+         --n;
+         byte_map_pixel(row + n * out_bytes, row + n * in_bytes, in_bytes,
+             out_bytes, src, value);
+      }
+   }
+
+   else
+   {
+      png_const_bytep sp = row;
+      png_bytep dp = row;
+
+      /* n pixels from sp are still to be done. */
+      while (n > 0 && in_bytes > out_bytes && (size_t)(sp - dp) < 16)
+      {
+         byte_map_pixel(dp, sp, in_bytes, out_bytes, src, value);
+         sp += in_bytes;
+         dp += out_bytes;
+         --n;
+      }
+
+      /* The next vector is loaded before this one is stored: a load which
+       * overlaps a recent store is slow.
+       */
+      if (n >= block && n * in_bytes >= 16)
+      {
+         __m128i v = _mm_loadu_si128((const __m128i*)(const void*)sp);
+
+         for (;;)
+         {
+            __m128i next = v;
+            int more;
+
+            v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), fill);
+            sp += in_block;
+            n -= block;
+            more = n >= block && n * in_bytes >= 16;
+
+            if (more != 0)
+               next = _mm_loadu_si128((const __m128i*)(const void*)sp);
+
+            _mm_storeu_si128((__m128i*)(void*)dp, v);
+            dp += out_block;
+
+            if (more == 0)
+               break;
+
+            v = next;
+         }
+      }
+
+      while (n > 0)
+      {
+         byte_map_pixel(dp, sp, in_bytes, out_bytes, src, value);
+         sp += in_bytes;
+         dp += out_bytes;
+         --n;
+      }
+   }
+}
+
+
+#ifdef PNG_READ_EXPAND_SUPPORTED
+/* The palette map (see png_do_palette_map in pngrtran.c) has a 4 byte entry
+ * for each index, with pixels of 3 bytes in the last three bytes.  The row is
+ * expanded from the end; the pixels near the start, where a vector store
+ * would reach indices still to be read, are done one at a time.
+ */
+static png_uint_32
+palette_entry(png_const_bytep palette_map, unsigned int index)
+{
+   png_uint_32 entry;
+
+   memcpy(&entry, palette_map + 4 * index, 4);
+   return entry;
+}
+
+static void
+palette_map_pixels(png_bytep row, size_t n, unsigned int out_bytes,
+    png_const_bytep palette_map)
+{
+   while (n > 0)
+   {
+      --n;
+      memcpy(row + n * out_bytes, palette_map + 4 * row[n] + 4 - out_bytes,
+          out_bytes);
+   }
+}
+
+/* SSSE3: four pixels are assembled from their entries; PSHUFB drops the
+ * first byte of each for 3 byte pixels.
+ */
+void PNG_SSSE3_FUNCTION
+png_do_palette_map_ssse3(png_bytep row, png_uint_32 width,
+    unsigned int out_bytes, png_const_bytep palette_map)
+{
+   const __m128i pack3 = _mm_setr_epi8(-128, -128, -128, -128, 1, 2, 3, 5, 6,
+       7, 9, 10, 11, 13, 14, 15);
+   size_t n = width;
+
+   if (out_bytes == 4)
+   {
+      while (n >= 4)
+      {
+         png_const_bytep sp = row + n - 4;
+         __m128i v = _mm_setr_epi32(
+             (int)palette_entry(palette_map, sp[0]),
+             (int)palette_entry(palette_map, sp[1]),
+             (int)palette_entry(palette_map, sp[2]),
+             (int)palette_entry(palette_map, sp[3]));
+
+         n -= 4;
+         _mm_storeu_si128((__m128i*)(void*)(row + 4 * n), v);
+      }
+   }
+
+   else if (out_bytes == 3)
+   {
+      /* The 12 bytes are stored with 4 bytes before them, which must not
+       * reach index n-5: 3(n-4) - 4 >= n-4.
+       */
+      while (n >= 6)
+      {
+         png_const_bytep sp = row + n - 4;
+         __m128i v = _mm_setr_epi32(
+             (int)palette_entry(palette_map, sp[0]),
+             (int)palette_entry(palette_map, sp[1]),
+             (int)palette_entry(palette_map, sp[2]),
+             (int)palette_entry(palette_map, sp[3]));
+
+         n -= 4;
+         v = _mm_shuffle_epi8(v, pack3);
+         _mm_storeu_si128((__m128i*)(void*)(row + 3 * n - 4), v);
+      }
+   }
+
+   palette_map_pixels(row, n, out_bytes, palette_map);
+}
+
+/* AVX2: eight entries are gathered at once. */
+void PNG_AVX2_FUNCTION
+png_do_palette_map_avx2(png_bytep row, png_uint_32 width,
+    unsigned int out_bytes, png_const_bytep palette_map)
+{
+   const __m256i pack3 = _mm256_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13,
+       14, 15, -128, -128, -128, -128, 1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14,
+       15, -128, -128, -128, -128);
+   const __m256i join3 = _mm256_setr_epi32(0, 0, 0, 1, 2, 4, 5, 6);
+   const int *base = (const int*)(const void*)palette_map;
+   size_t n = width;
+
+   if (out_bytes == 4)
+   {
+      while (n >= 8)
+      {
+         __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+             (const __m128i*)(const void*)(row + n - 8)));
+
+         v = _mm256_i32gather_epi32(base, v, 4);
+         n -= 8;
+         _mm256_storeu_si256((__m256i*)(void*)(row + 4 * n), v);
+      }
+   }
+
+   else if (out_bytes == 3)
+   {
+      /* The 24 bytes are stored with 8 bytes before them, which must not
+       * reach index n-9: 3(n-8) - 8 >= n-8.
+       */
+      while (n >= 12)
+      {
+         __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+             (const __m128i*)(const void*)(row + n - 8)));
+
+         v = _mm256_i32gather_epi32(base, v, 4);
+         v = _mm256_shuffle_epi8(v, pack3);
+         v = _mm256_permutevar8x32_epi32(v, join3);
+         n -= 8;
+         _mm256_storeu_si256((__m256i*)(void*)(row + 3 * n - 8), v);
+      }
+   }
+
+   palette_map_pixels(row, n, out_bytes, palette_map);
+}
+#endif /* READ_EXPAND */
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+/* Gamma correction (see png_do_gamma in pngrtran.c) with AVX2 gathers from
+ * png_struct::gamma_table_wide: the 8-bit table with 32-bit entries, or the
+ * 16-bit tables one after the other so that entry
+ * ((low byte >> shift) << 8) + high byte is gamma_16_table[low >> shift][high].
+ *
+ * If 'alpha' is set the last sample of each pixel is left alone.  Pixels with
+ * alpha are 2, 4 or 8 bytes, so the alpha is at the same bytes in each 32 byte
+ * vector.
+ */
+static int
+gamma_keep(size_t offset, unsigned int pixel_bytes, int alpha,
+    unsigned int sample_bytes)
+{
+   return alpha != 0 && offset % pixel_bytes >= pixel_bytes - sample_bytes;
+}
+
+static __m256i PNG_AVX2_FUNCTION
+gamma_keep_mask(unsigned int pixel_bytes, int alpha, unsigned int sample_bytes)
+{
+   png_byte keep[32];
+   unsigned int i;
+
+   for (i = 0; i < 32; ++i)
+      keep[i] = (png_byte)(gamma_keep(i, pixel_bytes, alpha, sample_bytes) ?
+          0xff : 0);
+
+   return _mm256_loadu_si256((const __m256i*)(const void*)keep);
+}
+
+/* Eight pixels of each byte of the 32-bit lanes are looked up at once; bytes
+ * which are all alpha are not looked up.
+ */
+void PNG_AVX2_FUNCTION
+png_do_gamma_8_avx2(png_bytep row, size_t rowbytes, unsigned int pixel_bytes,
+    int alpha, png_const_uint_32p table)
+{
+   const int *base = (const int*)(const void*)table;
+   const __m256i keep = gamma_keep_mask(pixel_bytes, alpha, 1);
+   const __m256i low = _mm256_set1_epi32(0xff);
+   unsigned int look = 0, k;
+   size_t i;
+
+   for (k = 0; k < 4; ++k)
+      if (gamma_keep(k, pixel_bytes, alpha, 1) == 0)
+         look |= 1U << k;
+
+   for (i = 0; i + 32 <= rowbytes; i += 32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(row + i));
+      __m256i r = _mm256_and_si256(v, keep);
+
+      for (k = 0; k < 4; ++k)
+      {
+         const __m128i bits = _mm_cvtsi32_si128((int)(8 * k));
+
+         if ((look & (1U << k)) != 0)
+         {
+            __m256i index = _mm256_and_si256(_mm256_srl_epi32(v, bits), low);
+
+            r = _mm256_or_si256(r, _mm256_sll_epi32(
+                _mm256_i32gather_epi32(base, index, 4), bits));
+         }
+      }
+
+      _mm256_storeu_si256((__m256i*)(void*)(row + i), r);
+   }
+
+   for (; i < rowbytes; ++i)
+      if (gamma_keep(i, pixel_bytes, alpha, 1) == 0)
+         row[i] = (png_byte)table[row[i]];
+}
+
+/* The even and the odd samples are looked up separately; the table needs two
+ * bytes after the last entry, which the gather reads.
+ */
+void PNG_AVX2_FUNCTION
+png_do_gamma_16_avx2(png_bytep row, size_t rowbytes, unsigned int pixel_bytes,
+    int alpha, png_const_uint_16p table, int shift)
+{
+   const int *base = (const int*)(const void*)table;
+   const __m256i keep = gamma_keep_mask(pixel_bytes, alpha, 2);
+   const __m256i low = _mm256_set1_epi32(0xff);
+   const __m256i word = _mm256_set1_epi32(0xffff);
+   const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10,
+       13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+   const __m128i bits = _mm_cvtsi32_si128(8 + shift);
+   size_t i;
+
+   for (i = 0; i + 32 <= rowbytes; i += 32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(row + i));
+      __m256i even = _mm256_and_si256(v, word);
+      __m256i odd = _mm256_srli_epi32(v, 16);
+      __m256i r;
+
+      /* The samples are big-endian: the high byte is the low byte of the
+       * 16-bit lane.
+       */
+      even = _mm256_or_si256(_mm256_slli_epi32(_mm256_srl_epi32(even, bits), 8),
+          _mm256_and_si256(even, low));
+      odd = _mm256_or_si256(_mm256_slli_epi32(_mm256_srl_epi32(odd, bits), 8),
+          _mm256_and_si256(odd, low));
+      even = _mm256_and_si256(_mm256_i32gather_epi32(base, even, 2), word);
+      odd = _mm256_slli_epi32(_mm256_i32gather_epi32(base, odd, 2), 16);
+      r = _mm256_shuffle_epi8(_mm256_or_si256(even, odd), swap);
+      r = _mm256_blendv_epi8(r, v, keep);
+      _mm256_storeu_si256((__m256i*)(void*)(row + i), r);
+   }
+
+   for (; i + 1 < rowbytes; i += 2)
+   {
+      if (gamma_keep(i, pixel_bytes, alpha, 2) == 0)
+      {
+         png_uint_16 value = table[((row[i + 1] >> shift) << 8) + row[i]];
+
+         row[i] = (png_byte)(value >> 8);
+         row[i + 1] = (png_byte)(value & 0xff);
+      }
+   }
+}
+#endif /* READ_GAMMA */
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED)
+/* Alpha compositing of 8-bit GA and RGBA rows (see png_do_compose in
+ * pngrtran.c).  Without gamma each colour is blended with the background, which
+ * gives the colour itself for opaque pixels and the background for transparent
+ * ones.  With gamma 'tables' holds gamma_table, gamma_to_1 and gamma_from_1:
+ * opaque pixels are gamma corrected, transparent ones get the background and
+ * the others are blended with background_1 in linear light, then converted
+ * back with gamma_from_1 unless 'optimize' (PNG_ALPHA_OPTIMIZED) is set.
+ */
+static png_byte
+compose_sample(unsigned int c, unsigned int a, unsigned int background,
+    unsigned int background_1, png_const_uint_32p tables, int optimize)
+{
+   unsigned int t;
+
+   if (tables != NULL)
+   {
+      if (a == 255)
+         return (png_byte)tables[c];
+
+      if (a == 0)
+         return (png_byte)background;
+
+      c = tables[256 + c];
+      background = background_1;
+   }
+
+   t = c * a + background * (255 - a) + 128;
+   t = (t + (t >> 8)) >> 8;
+
+   if (tables != NULL && optimize == 0)
+      t = tables[512 + t];
+
+   return (png_byte)t;
+}
+
+/* (c * a + background * (255 - a)) / 255, rounded, in 32-bit lanes. */
+static __m256i PNG_AVX2_FUNCTION
+compose_blend(__m256i c, __m256i a, __m256i background)
+{
+   const __m256i t = _mm256_add_epi32(_mm256_add_epi32(
+       _mm256_mullo_epi16(c, a), _mm256_mullo_epi16(background,
+       _mm256_sub_epi32(_mm256_set1_epi32(255), a))), _mm256_set1_epi32(128));
+
+   return _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 8)), 8);
+}
+
+/* Each colour byte of the 32-bit lanes is done for eight lanes at once, with
+ * gathers for the tables.  Vectors which are all opaque or all transparent
+ * skip the work they do not need.
+ */
+void PNG_AVX2_FUNCTION
+png_do_compose_8_avx2(png_bytep row, size_t rowbytes, unsigned int pixel_bytes,
+    png_const_bytep background, png_const_bytep background_1,
+    png_const_uint_32p tables, int optimize)
+{
+   const int *base = (const int*)(const void*)tables;
+   const int rgba = pixel_bytes == 4;
+   const unsigned int colours = rgba ? 3 : 2; /* colour bytes in a lane */
+   const unsigned int alpha_bits = rgba ? 0x88888888U : 0xaaaaaaaaU;
+   const __m256i keep = _mm256_set1_epi32(rgba ? (int)0xff000000 :
+       (int)0xff00ff00);
+   const __m256i low = _mm256_set1_epi32(0xff);
+   const __m256i zero = _mm256_setzero_si256();
+   size_t i;
+   unsigned int j;
+
+   for (i = 0; i + 32 <= rowbytes; i += 32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(row + i));
+      __m256i r = _mm256_and_si256(v, keep);
+      const unsigned int solid = alpha_bits & (unsigned int)
+          _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(-1)));
+      const unsigned int clear = alpha_bits & (unsigned int)
+          _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+
+      if (solid == alpha_bits && tables == NULL)
+         continue;
+
+      for (j = 0; j < colours; ++j)
+      {
+         const unsigned int k = rgba ? j : 2 * j; /* the colour byte */
+         const __m128i bits = _mm_cvtsi32_si128((int)(8 * k));
+         const __m256i c = _mm256_and_si256(_mm256_srl_epi32(v, bits), low);
+         const __m256i a = _mm256_and_si256(_mm256_srl_epi32(v,
+             _mm_cvtsi32_si128((int)(rgba ? 24 : 8 * k + 8))), low);
+         const __m256i bg = _mm256_set1_epi32(background[rgba ? j : 0]);
+         __m256i res;
+
+         if (tables == NULL)
+            res = compose_blend(c, a, bg);
+
+         else if (solid == alpha_bits)
+            res = _mm256_i32gather_epi32(base, c, 4);
+
+         else if (clear == alpha_bits)
+            res = bg;
+
+         else
+         {
+            const __m256i bg_1 =
+                _mm256_set1_epi32(background_1[rgba ? j : 0]);
+
+            res = compose_blend(_mm256_i32gather_epi32(base + 256, c, 4), a,
+                bg_1);
+
+            if (optimize == 0)
+               res = _mm256_i32gather_epi32(base + 512, res, 4);
+
+            res = _mm256_blendv_epi8(res, _mm256_i32gather_epi32(base, c, 4),
+                _mm256_cmpeq_epi32(a, low));
+            res = _mm256_blendv_epi8(res, bg, _mm256_cmpeq_epi32(a, zero));
+         }
+
+         r = _mm256_or_si256(r, _mm256_sll_epi32(res, bits));
+      }
+
+      _mm256_storeu_si256((__m256i*)(void*)(row + i), r);
+   }
+
+   for (; i + pixel_bytes <= rowbytes; i += pixel_bytes)
+   {
+      const unsigned int a = row[i + pixel_bytes - 1];
+
+      for (j = 0; j + 1 < pixel_bytes; ++j)
+         row[i + j] = compose_sample(row[i + j], a, background[j],
+             background_1[j], tables, optimize);
+   }
+}
+#endif /* READ_BACKGROUND || READ_ALPHA_MODE */
+
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+/* RGB to gray (see png_do_rgb_to_gray in pngrtran.c) for eight pixels at a
+ * time.  'tables' is NULL, or gamma_table_wide with gamma_table, gamma_to_1
+ * and gamma_from_1 one after the other.  The row is converted in place: the
+ * output for eight pixels is written after they are read and before the
+ * next are, and it is shorter.
+ */
+static int
+rgb_to_gray_8_pixel(png_bytep dp, png_const_bytep sp, png_uint_32 rc,
+    png_uint_32 gc, png_uint_32 bc, png_const_uint_32p tables)
+{
+   unsigned int red = sp[0], green = sp[1], blue = sp[2];
+
+   if (red != green || red != blue)
+   {
+      if (tables != NULL)
+         *dp = (png_byte)tables[512 + ((rc*tables[256 + red] +
+             gc*tables[256 + green] + bc*tables[256 + blue] + 16384) >> 15)];
+
+      else
+         *dp = (png_byte)((rc*red + gc*green + bc*blue) >> 15);
+
+      return 1;
+   }
+
+   *dp = (png_byte)(tables != NULL ? tables[red] : red);
+   return 0;
+}
+
+int PNG_AVX2_FUNCTION
+png_do_rgb_to_gray_8_avx2(png_bytep row, png_uint_32 width, int alpha,
+    png_uint_32 rc, png_uint_32 gc, png_const_uint_32p tables)
+{
+   const int *base = (const int*)(const void*)tables;
+   const unsigned int in_bytes = alpha != 0 ? 4 : 3;
+   const png_uint_32 bc = 32768 - rc - gc;
+   const __m256i red_c = _mm256_set1_epi32((int)rc);
+   const __m256i green_c = _mm256_set1_epi32((int)gc);
+   const __m256i blue_c = _mm256_set1_epi32((int)bc);
+   const __m256i low = _mm256_set1_epi32(0xff);
+   const __m256i spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+   const __m256i get_red = _mm256_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1,
+       6, -1, -1, -1, 9, -1, -1, -1, 0, -1, -1, -1, 3, -1, -1, -1,
+       6, -1, -1, -1, 9, -1, -1, -1);
+   const __m256i one = _mm256_set1_epi32(1);
+   const __m256i two = _mm256_set1_epi32(2);
+   png_const_bytep sp = row;
+   png_bytep dp = row;
+   png_uint_32 i;
+   int rgb_error = 0;
+
+   for (i = 0; (size_t)(width - i) * in_bytes >= 32; i += 8)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)sp);
+      __m256i red, green, blue, gray, y;
+
+      if (alpha != 0)
+      {
+         red = _mm256_and_si256(v, low);
+         green = _mm256_and_si256(_mm256_srli_epi32(v, 8), low);
+         blue = _mm256_and_si256(_mm256_srli_epi32(v, 16), low);
+      }
+
+      else
+      {
+         /* Four pixels, twelve bytes, to each 128-bit lane. */
+         v = _mm256_permutevar8x32_epi32(v, spread);
+         red = _mm256_shuffle_epi8(v, get_red);
+         green = _mm256_shuffle_epi8(v, _mm256_add_epi32(get_red, one));
+         blue = _mm256_shuffle_epi8(v, _mm256_add_epi32(get_red, two));
+      }
+
+      gray = _mm256_and_si256(_mm256_cmpeq_epi32(red, green),
+          _mm256_cmpeq_epi32(red, blue));
+
+      if (_mm256_movemask_epi8(gray) != -1)
+      {
+         rgb_error = 1;
+
+         if (tables != NULL)
+         {
+            red = _mm256_i32gather_epi32(base + 256, red, 4);
+            green = _mm256_i32gather_epi32(base + 256, green, 4);
+            blue = _mm256_i32gather_epi32(base + 256, blue, 4);
+         }
+
+         y = _mm256_add_epi32(_mm256_add_epi32(
+             _mm256_mullo_epi32(red, red_c), _mm256_mullo_epi32(green,
+             green_c)), _mm256_mullo_epi32(blue, blue_c));
+
+         if (tables != NULL)
+            y = _mm256_i32gather_epi32(base + 512, _mm256_srli_epi32(
+                _mm256_add_epi32(y, _mm256_set1_epi32(16384)), 15), 4);
+
+         else
+            y = _mm256_srli_epi32(y, 15);
+
+         /* 'red' may have been replaced by gamma_to_1[red] */
+         red = alpha != 0 ? _mm256_and_si256(v, low) :
+             _mm256_shuffle_epi8(v, get_red);
+      }
+
+      else
+         y = red;
+
+      if (tables != NULL)
+         red = _mm256_i32gather_epi32(base, red, 4);
+
+      y = _mm256_blendv_epi8(y, red, gray);
+
+      if (alpha != 0)
+      {
+         y = _mm256_or_si256(y, _mm256_slli_epi32(_mm256_srli_epi32(v, 24),
+             8));
+         y = _mm256_permute4x64_epi64(_mm256_packus_epi32(y, y), 0x08);
+         _mm_storeu_si128((__m128i*)(void*)dp, _mm256_castsi256_si128(y));
+         dp += 16;
+      }
+
+      else
+      {
+         y = _mm256_packus_epi16(_mm256_packus_epi32(y, y), y);
+         _mm_storel_epi64((__m128i*)(void*)dp, _mm_unpacklo_epi32(
+             _mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1)));
+         dp += 8;
+      }
+
+      sp += 8 * in_bytes;
+   }
+
+   for (; i < width; ++i)
+   {
+      rgb_error |= rgb_to_gray_8_pixel(dp++, sp, rc, gc, bc, tables);
+
+      if (alpha != 0)
+         *(dp++) = sp[3];
+
+      sp += in_bytes;
+   }
+
+   return rgb_error;
+}
+
+/* The 16-bit samples are big-endian; gamma_table_wide has the gamma_table,
+ * gamma_16_to_1 and gamma_16_from_1 tables, each 'n' entries, one after the
+ * other.
+ */
+static png_uint_32
+rgb_to_gray_16_index(png_uint_32 value, int shift)
+{
+   return (((value & 0xff) >> shift) << 8) + (value >> 8);
+}
+
+static int
+rgb_to_gray_16_pixel(png_bytep dp, png_const_bytep sp, png_uint_32 rc,
+    png_uint_32 gc, png_uint_32 bc, png_const_uint_16p tables, int shift)
+{
+   png_uint_32 n = 256U << (8 - shift);
+   png_uint_32 red = png_get_uint_16(sp);
+   png_uint_32 green = png_get_uint_16(sp + 2);
+   png_uint_32 blue = png_get_uint_16(sp + 4);
+   png_uint_32 w;
+   int rgb_error = 0;
+
+   if (red != green || red != blue)
+   {
+      rgb_error = 1;
+
+      if (tables != NULL)
+      {
+         red = tables[n + rgb_to_gray_16_index(red, shift)];
+         green = tables[n + rgb_to_gray_16_index(green, shift)];
+         blue = tables[n + rgb_to_gray_16_index(blue, shift)];
+      }
+   }
+
+   if (rgb_error != 0 || tables == NULL)
+   {
+      w = (rc*red + gc*green + bc*blue + 16384) >> 15;
+
+      if (tables != NULL)
+         w = tables[2 * n + rgb_to_gray_16_index(w, shift)];
+   }
+
+   else
+      w = tables[rgb_to_gray_16_index(red, shift)];
+
+   dp[0] = (png_byte)(w >> 8);
+   dp[1] = (png_byte)(w & 0xff);
+   return rgb_error;
+}
+
+/* The shuffle which takes sample 'sample' of the two pixels in each 128-bit
+ * lane, 'stride' bytes apart, to the first two 32-bit values of the lane;
+ * byte swapped unless 'raw' is set.
+ */
+static __m256i PNG_AVX2_FUNCTION
+rgb_to_gray_16_shuffle(unsigned int stride, unsigned int sample, int raw)
+{
+   png_byte shuffle[32];
+   unsigned int i;
+
+   memset(shuffle, 0x80, sizeof shuffle);
+
+   for (i = 0; i < 32; i += 16)
+   {
+      shuffle[i + 0] = (png_byte)(2 * sample + (raw == 0));
+      shuffle[i + 1] = (png_byte)(2 * sample + (raw != 0));
+      shuffle[i + 4] = (png_byte)(stride + 2 * sample + (raw == 0));
+      shuffle[i + 5] = (png_byte)(stride + 2 * sample + (raw != 0));
+   }
+
+   return _mm256_loadu_si256((const __m256i*)(const void*)shuffle);
+}
+
+static __m256i PNG_AVX2_FUNCTION
+rgb_to_gray_16_lookup(const int *base, __m256i value, png_uint_32 offset,
+    int shift)
+{
+   const __m256i low = _mm256_set1_epi32(0xff);
+   __m256i index = _mm256_add_epi32(_mm256_or_si256(_mm256_slli_epi32(
+       _mm256_srl_epi32(_mm256_and_si256(value, low), _mm_cvtsi32_si128(
+       shift)), 8), _mm256_srli_epi32(value, 8)),
+       _mm256_set1_epi32((int)offset));
+
+   return _mm256_and_si256(_mm256_i32gather_epi32(base, index, 2),
+       _mm256_set1_epi32(0xffff));
+}
+
+int PNG_AVX2_FUNCTION
+png_do_rgb_to_gray_16_avx2(png_bytep row, png_uint_32 width, int alpha,
+    png_uint_32 rc, png_uint_32 gc, png_const_uint_16p tables, int shift)
+{
+   const int *base = (const int*)(const void*)tables;
+   const png_uint_32 n = 256U << (8 - shift);
+   const unsigned int in_bytes = alpha != 0 ? 8 : 6;
+   const png_uint_32 bc = 32768 - rc - gc;
+   const __m256i red_c = _mm256_set1_epi32((int)rc);
+   const __m256i green_c = _mm256_set1_epi32((int)gc);
+   const __m256i blue_c = _mm256_set1_epi32((int)bc);
+   const __m256i spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+   const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+   const __m256i get_red = rgb_to_gray_16_shuffle(in_bytes, 0, 0);
+   const __m256i get_green = rgb_to_gray_16_shuffle(in_bytes, 1, 0);
+   const __m256i get_blue = rgb_to_gray_16_shuffle(in_bytes, 2, 0);
+   const __m256i get_alpha = rgb_to_gray_16_shuffle(in_bytes, 3, 1);
+   png_const_bytep sp = row;
+   png_bytep dp = row;
+   png_uint_32 i;
+   int rgb_error = 0;
+
+   /* Four pixels are loaded at a time, two to each 128-bit lane, and the
+    * samples of eight pixels are combined in the order 0 1 4 5 2 3 6 7.
+    */
+   for (i = 0; (size_t)(width - i) * in_bytes >= 4 * in_bytes + 32; i += 8)
+   {
+      __m256i v0 = _mm256_loadu_si256((const __m256i*)(const void*)sp);
+      __m256i v1 = _mm256_loadu_si256(
+          (const __m256i*)(const void*)(sp + 4 * in_bytes));
+      __m256i red, green, blue, gray, y;
+
+      if (alpha == 0)
+      {
+         v0 = _mm256_permutevar8x32_epi32(v0, spread);
+         v1 = _mm256_permutevar8x32_epi32(v1, spread);
+      }
+
+      red = _mm256_unpacklo_epi64(_mm256_shuffle_epi8(v0, get_red),
+          _mm256_shuffle_epi8(v1, get_red));
+      green = _mm256_unpacklo_epi64(_mm256_shuffle_epi8(v0, get_green),
+          _mm256_shuffle_epi8(v1, get_green));
+      blue = _mm256_unpacklo_epi64(_mm256_shuffle_epi8(v0, get_blue),
+          _mm256_shuffle_epi8(v1, get_blue));
+
+      gray = _mm256_and_si256(_mm256_cmpeq_epi32(red, green),
+          _mm256_cmpeq_epi32(red, blue));
+
+      if (_mm256_movemask_epi8(gray) != -1 || tables == NULL)
+      {
+         __m256i r = red;
+
+         if (_mm256_movemask_epi8(gray) != -1)
+            rgb_error = 1;
+
+         if (tables != NULL)
+         {
+            r = rgb_to_gray_16_lookup(base, red, n, shift);
+            green = rgb_to_gray_16_lookup(base, green, n, shift);
+            blue = rgb_to_gray_16_lookup(base, blue, n, shift);
+         }
+
+         y = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(
+             _mm256_add_epi32(_mm256_mullo_epi32(r, red_c),
+             _mm256_mullo_epi32(green, green_c)),
+             _mm256_mullo_epi32(blue, blue_c)), _mm256_set1_epi32(16384)), 15);
+
+         if (tables != NULL)
+            y = rgb_to_gray_16_lookup(base, y, 2 * n, shift);
+      }
+
+      else
+         y = red;
+
+      if (tables != NULL)
+         y = _mm256_blendv_epi8(y, rgb_to_gray_16_lookup(base, red, 0, shift),
+             gray);
+
+      /* Back to big-endian and to the order of the pixels. */
+      y = _mm256_or_si256(_mm256_srli_epi32(y, 8),
+          _mm256_and_si256(_mm256_slli_epi32(y, 8), _mm256_set1_epi32(0xff00)));
+      y = _mm256_permutevar8x32_epi32(y, order);
+
+      if (alpha != 0)
+      {
+         __m256i a = _mm256_permutevar8x32_epi32(_mm256_unpacklo_epi64(
+             _mm256_shuffle_epi8(v0, get_alpha),
+             _mm256_shuffle_epi8(v1, get_alpha)), order);
+
+         _mm256_storeu_si256((__m256i*)(void*)dp,
+             _mm256_or_si256(y, _mm256_slli_epi32(a, 16)));
+         dp += 32;
+      }
+
+      else
+      {
+         y = _mm256_permute4x64_epi64(_mm256_packus_epi32(y, y), 0x08);
+         _mm_storeu_si128((__m128i*)(void*)dp, _mm256_castsi256_si128(y));
+         dp += 16;
+      }
+
+      sp += 8 * in_bytes;
+   }
+
+   for (; i < width; ++i)
+   {
+      rgb_error |= rgb_to_gray_16_pixel(dp, sp, rc, gc, bc, tables, shift);
+      dp += 2;
+
+      if (alpha != 0)
+      {
+         *(dp++) = sp[6];
+         *(dp++) = sp[7];
+      }
+
+      sp += in_bytes;
+   }
+
+   return rgb_error;
+}
+#endif /* READ_RGB_TO_GRAY */
+
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+/* png_do_scale_16_to_8 rounds V/257 as V's high byte plus a correction of -1,
+ * 0 or 1 from d = low - high + 128: -1 if d < 0 and +1 if d > 256.  The
+ * output is at half the offset of the input, so the vectors are stored behind
+ * the loads.
+ */
+static void
+scale_16_to_8_samples(png_bytep dp, png_const_bytep sp, size_t bytes)
+{
+   while (bytes >= 2)
+   {
+      png_int_32 tmp = *sp++;
+
+      tmp += (((int)*sp++ - tmp + 128) * 65535) >> 24;
+      *dp++ = (png_byte)tmp;
+      bytes -= 2;
+   }
+}
+
+void PNG_SSSE3_FUNCTION
+png_do_scale_16_to_8_ssse3(png_bytep row, size_t rowbytes)
+{
+   const __m128i high = _mm_setr_epi8(0, -128, 2, -128, 4, -128, 6, -128, 8,
+       -128, 10, -128, 12, -128, 14, -128);
+   const __m128i low = _mm_setr_epi8(1, -128, 3, -128, 5, -128, 7, -128, 9,
+       -128, 11, -128, 13, -128, 15, -128);
+   const __m128i half = _mm_set1_epi16(128);
+   const __m128i top = _mm_set1_epi16(256);
+   const __m128i zero = _mm_setzero_si128();
+   size_t i;
+
+   for (i = 0; i + 16 <= rowbytes; i += 16)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(row + i));
+      __m128i h = _mm_shuffle_epi8(v, high);
+      __m128i d = _mm_sub_epi16(_mm_add_epi16(_mm_shuffle_epi8(v, low), half),
+          h);
+
+      h = _mm_sub_epi16(h, _mm_cmpgt_epi16(d, top));
+      h = _mm_add_epi16(h, _mm_cmpgt_epi16(zero, d));
+      _mm_storel_epi64((__m128i*)(void*)(row + i / 2), _mm_packus_epi16(h, h));
+   }
+
+   scale_16_to_8_samples(row + i / 2, row + i, rowbytes - i);
+}
+
+void PNG_AVX2_FUNCTION
+png_do_scale_16_to_8_avx2(png_bytep row, size_t rowbytes)
+{
+   const __m256i high = _mm256_setr_epi8(0, -128, 2, -128, 4, -128, 6, -128, 8,
+       -128, 10, -128, 12, -128, 14, -128, 0, -128, 2, -128, 4, -128, 6, -128,
+       8, -128, 10, -128, 12, -128, 14, -128);
+   const __m256i low = _mm256_setr_epi8(1, -128, 3, -128, 5, -128, 7, -128, 9,
+       -128, 11, -128, 13, -128, 15, -128, 1, -128, 3, -128, 5, -128, 7, -128,
+       9, -128, 11, -128, 13, -128, 15, -128);
+   const __m256i half = _mm256_set1_epi16(128);
+   const __m256i top = _mm256_set1_epi16(256);
+   const __m256i zero = _mm256_setzero_si256();
+   size_t i;
+
+   for (i = 0; i + 32 <= rowbytes; i += 32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(row + i));
+      __m256i h = _mm256_shuffle_epi8(v, high);
+      __m256i d = _mm256_sub_epi16(
+          _mm256_add_epi16(_mm256_shuffle_epi8(v, low), half), h);
+
+      h = _mm256_sub_epi16(h, _mm256_cmpgt_epi16(d, top));
+      h = _mm256_add_epi16(h, _mm256_cmpgt_epi16(zero, d));
+      h = _mm256_permute4x64_epi64(_mm256_packus_epi16(h, h), 0x08);
+      _mm_storeu_si128((__m128i*)(void*)(row + i / 2),
+          _mm256_castsi256_si128(h));
+   }
+
+   scale_16_to_8_samples(row + i / 2, row + i, rowbytes - i);
+}
+#endif /* READ_SCALE_16_TO_8 */
+
+#ifdef PNG_READ_INTERLACING_SUPPORTED
+/* The pixels of an Adam7 pass are 'step' pixels apart in the row.  Each vector
+ * stores the pixels of the pass in 16 bytes of the row: PSHUFB moves them
+ * apart and the bytes of the pixels of the other passes are kept from the row.
+ * This only beats the single moves of png_do_read_deinterlace when a vector
+ * has four or more pixels of the pass, so it is used for 8-bit gray and
+ * palette rows and for 16-bit gray and 8-bit gray-alpha rows of passes with
+ * pixels up to four bytes apart.  The vectors do not reach past the last pixel
+ * of the pass in the row, or read past the end of the pass row; the pixels
+ * left over are left to png_do_read_deinterlace.
+ */
+png_uint_32 PNG_SSSE3_FUNCTION
+png_do_read_deinterlace_ssse3(png_bytep row, png_const_bytep sp,
+    png_uint_32 width, unsigned int pixel_bytes, int pass)
+{
+   const unsigned int step = PNG_PASS_COL_OFFSET(pass);
+   const unsigned int start = PNG_PASS_START_COL(pass);
+   const size_t span = (size_t)step * pixel_bytes;
+   size_t block, row_end, src_end, i, j;
+   png_byte control[16], keep[16];
+   __m128i shuffle, mask;
+
+   if (span > 4 || width == 0)
+      return 0;
+
+   block = 16 / span;
+
+   for (j = 0; j < 16; ++j)
+   {
+      const size_t pixel = j / pixel_bytes;
+
+      if (pixel % step == start)
+      {
+         control[j] = (png_byte)((pixel / step) * pixel_bytes +
+             j % pixel_bytes);
+         keep[j] = 0;
+      }
+
+      else
+      {
+         control[j] = 0x80;
+         keep[j] = 0xff;
+      }
+   }
+
+   shuffle = _mm_loadu_si128((const __m128i*)(const void*)control);
+   mask = _mm_loadu_si128((const __m128i*)(const void*)keep);
+   row_end = ((size_t)(width - 1) * step + start + 1) * pixel_bytes;
+   src_end = (size_t)width * pixel_bytes;
+
+   /* block * pixel_bytes is 8 or less, so eight bytes are loaded. */
+   for (i = 0; i * pixel_bytes + 8 <= src_end && i * span + 16 <= row_end;
+       i += block)
+   {
+      __m128i *dp = (__m128i*)(void*)(row + i * span);
+      __m128i s = _mm_loadl_epi64(
+          (const __m128i*)(const void*)(sp + i * pixel_bytes));
+
+      _mm_storeu_si128(dp, _mm_or_si128(
+          _mm_and_si128(_mm_loadu_si128(dp), mask),
+          _mm_shuffle_epi8(s, shuffle)));
+   }
+
+   return (png_uint_32)i;
+}
+
+/* Copy the bytes of sp selected by mask to dp. */
+static void
+blend_16(png_bytep dp, png_const_bytep sp, __m128i mask)
+{
+   __m128i *p = (__m128i*)(void*)dp;
+   __m128i s = _mm_loadu_si128((const __m128i*)(const void*)sp);
+
+   _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(mask, s),
+       _mm_andnot_si128(mask, _mm_loadu_si128(p))));
+}
+
+/* png_combine_row copies runs of 'copy' bytes 'jump' bytes apart.  When the
+ * runs are short and close together the row is blended with a constant mask
+ * instead: the pattern repeats every lcm(16, jump) bytes, which is one or
+ * three vectors.  This is faster than the single moves of png_combine_row for
+ * runs of one to three bytes with at least a quarter of the bytes copied,
+ * which are the later passes of 8-bit gray, palette and RGB rows and 16-bit
+ * gray and 8-bit gray-alpha rows.  The bytes after the last whole pattern are
+ * done one at a time.
+ */
+int
+png_combine_row_sse2(png_bytep dp, png_const_bytep sp, size_t row_bytes,
+    unsigned int offset, unsigned int copy, unsigned int jump)
+{
+   png_byte select[48];
+   __m128i mask[3];
+   size_t period, i;
+   unsigned int v, vectors;
+
+   if (copy >= 4 || jump > 8 || 4 * copy < jump)
+      return 0;
+
+   period = jump == 6 ? 48 : 16;
+   vectors = (unsigned int)(period / 16);
+
+   for (i = 0; i < period; ++i)
+      select[i] = (png_byte)((i + jump - offset) % jump < copy ? 0xff : 0);
+
+   for (v = 0; v < vectors; ++v)
+      mask[v] = _mm_loadu_si128((const __m128i*)(const void*)(select + 16*v));
+
+   for (i = 0; i + period <= row_bytes; i += period)
+      for (v = 0; v < vectors; ++v)
+         blend_16(dp + i + 16*v, sp + i + 16*v, mask[v]);
+
+   for (; i < row_bytes; ++i)
+      if (select[i % period] != 0)
+         dp[i] = sp[i];
+
+   return 1;
+}
+#endif /* READ_INTERLACING */
+
+#endif /* PNG_INTEL_CPUID_OPT > 0 */
+#endif /* READ_TRANSFORMS */
@@ -126,6 +126,432 @@ png_zfree(voidpf png_ptr, voidpf ptr)
    png_free(png_voidcast(png_const_structrp,png_ptr), ptr);
 }
 
+#ifdef PNG_PARALLEL_SUPPORTED
+/* Versions of the above for use by parallel jobs; png_malloc_warn cannot be
+ * used because it calls the application warning function.
+ */
+PNG_FUNCTION(voidpf /* PRIVATE */,
+png_parallel_zalloc,(voidpf png_ptr, uInt items, uInt size),PNG_ALLOCATED)
+{
+   if (png_ptr == NULL || items >= (~(png_alloc_size_t)0)/size)
+      return NULL;
+
+   return png_malloc_base(png_voidcast(png_const_structrp, png_ptr),
+       (png_alloc_size_t)items * size);
+}
+
+void /* PRIVATE */
+png_parallel_zfree(voidpf png_ptr, voidpf ptr)
+{
+   png_free(png_voidcast(png_const_structrp,png_ptr), ptr);
+}
+
+/* Adler-32 of a buffer which may be larger than zlib can handle at once. */
+uLong /* PRIVATE */
+png_adler32(png_const_bytep data, png_alloc_size_t size)
+{
+   uLong adler = adler32(0, Z_NULL, 0);
+
+   while (size > 0)
+   {
+      uInt len = ZLIB_IO_MAX;
+
+      if (len > size)
+         len = (uInt)size;
+
+      adler = adler32(adler, data, len);
+      data += len;
+      size -= len;
+   }
+
+   return adler;
+}
+
+void /* PRIVATE */
+png_run_parallel(png_const_structrp png_ptr, png_parallel_job_ptr job,
+    png_voidp job_arg, png_uint_32 job_count)
+{
+   if (png_ptr->parallel_fn != NULL)
+      png_ptr->parallel_fn(png_constcast(png_structp, png_ptr), job, job_arg,
+          job_count);
+
+   else
+   {
+      png_uint_32 i;
+
+      for (i = 0; i < job_count; ++i)
+         job(job_arg, i);
+   }
+}
+#endif /* PARALLEL */
+
+#ifdef PNG_DEFLATE_CODEC_SUPPORTED
+/* Whole-stream deflate codecs, see png_set_deflate_codec. */
+typedef struct
+{
+   png_structrp png_ptr;
+   int          compress;
+   z_stream     zs;
+} png_zlib_codec_state;
+
+typedef png_zlib_codec_state *png_zlib_codec_statep;
+
+static png_voidp
+png_zlib_codec_init(png_structrp png_ptr, int compress, int level,
+    int strategy)
+{
+   png_zlib_codec_statep state = png_voidcast(png_zlib_codec_statep,
+       png_malloc_base(png_ptr, (sizeof *state)));
+   int ret;
+
+   if (state == NULL)
+      return NULL;
+
+   memset(state, 0, (sizeof *state));
+   state->png_ptr = png_ptr;
+   state->compress = compress;
+   state->zs.zalloc = png_zalloc;
+   state->zs.zfree = png_zfree;
+   state->zs.opaque = png_ptr;
+
+   if (compress != 0)
+   {
+#ifdef PNG_WRITE_SUPPORTED
+      ret = deflateInit2(&state->zs, level, Z_DEFLATED,
+          png_ptr->zlib_window_bits, png_ptr->zlib_mem_level, strategy);
+#else
+      PNG_UNUSED(level)
+      PNG_UNUSED(strategy)
+      ret = Z_STREAM_ERROR;
+#endif
+   }
+
+   else
+      ret = inflateInit(&state->zs);
+
+   if (ret != Z_OK)
+   {
+      png_free(png_ptr, state);
+      return NULL;
+   }
+
+   return state;
+}
+
+static int
+png_zlib_codec_compress(png_voidp state_ptr, png_const_bytep input,
+    png_alloc_size_t input_size, png_bytepp output,
+    png_alloc_size_t *output_size)
+{
+   png_zlib_codec_statep state = png_voidcast(png_zlib_codec_statep,
+       state_ptr);
+   z_streamp zs = &state->zs;
+   png_alloc_size_t avail_in = input_size, size = 0, capacity;
+   png_bytep out;
+   int ret;
+
+   if ((uLong)input_size != input_size)
+      return 0;
+
+   capacity = deflateBound(zs, (uLong)input_size);
+   out = png_voidcast(png_bytep, png_malloc_base(state->png_ptr, capacity));
+
+   if (out == NULL)
+      return 0;
+
+   zs->next_in = PNGZ_INPUT_CAST(input);
+   zs->next_out = out;
+
+   do
+   {
+      uInt in = ZLIB_IO_MAX, avail_out = ZLIB_IO_MAX;
+
+      if (in > avail_in)
+         in = (uInt)avail_in;
+
+      if (avail_out > capacity - size)
+         avail_out = (uInt)(capacity - size);
+
+      zs->avail_in = in;
+      zs->avail_out = avail_out;
+      ret = deflate(zs, in == avail_in ? Z_FINISH : Z_NO_FLUSH);
+      avail_in -= in - zs->avail_in;
+      size += avail_out - zs->avail_out;
+   }
+   while (ret == Z_OK && size < capacity);
+
+   if (ret != Z_STREAM_END)
+   {
+      png_free(state->png_ptr, out);
+      return 0;
+   }
+
+   *output = out;
+   *output_size = size;
+   return 1;
+}
+
+static int
+png_zlib_codec_decompress(png_voidp state_ptr, png_const_bytep input,
+    png_alloc_size_t input_size, png_bytep output,
+    png_alloc_size_t output_size)
+{
+   png_zlib_codec_statep state = png_voidcast(png_zlib_codec_statep,
+       state_ptr);
+   z_streamp zs = &state->zs;
+   int ret;
+
+   zs->next_in = PNGZ_INPUT_CAST(input);
+   zs->next_out = output;
+
+   do
+   {
+      uInt in = ZLIB_IO_MAX, out = ZLIB_IO_MAX;
+
+      if (in > input_size)
+         in = (uInt)input_size;
+
+      if (out > output_size)
+         out = (uInt)output_size;
+
+      zs->avail_in = in;
+      zs->avail_out = out;
+      ret = inflate(zs, Z_NO_FLUSH);
+      input_size -= in - zs->avail_in;
+      output_size -= out - zs->avail_out;
+   }
+   while (ret == Z_OK);
+
+   return ret == Z_STREAM_END && input_size == 0 && output_size == 0;
+}
+
+static void
+png_zlib_codec_reset(png_voidp state_ptr)
+{
+   png_zlib_codec_statep state = png_voidcast(png_zlib_codec_statep,
+       state_ptr);
+
+   if (state->compress != 0)
+      (void)deflateReset(&state->zs);
+
+   else
+      (void)inflateReset(&state->zs);
+}
+
+static void
+png_zlib_codec_end(png_voidp state_ptr)
+{
+   png_zlib_codec_statep state = png_voidcast(png_zlib_codec_statep,
+       state_ptr);
+
+   if (state->compress != 0)
+      (void)deflateEnd(&state->zs);
+
+   else
+      (void)inflateEnd(&state->zs);
+
+   png_free(state->png_ptr, state);
+}
+
+static const png_deflate_codec png_zlib_codec =
+{
+   "zlib",
+   png_zlib_codec_init,
+   png_zlib_codec_compress,
+   png_zlib_codec_decompress,
+   png_zlib_codec_reset,
+   png_zlib_codec_end
+};
+
+#ifdef PNG_LIBDEFLATE
+/* libdeflate does not stream but is considerably faster than zlib on whole
+ * buffers.  It allocates its own (small) state with malloc; the allocator can
+ * only be changed for the whole process, so libpng does not do so.
+ */
+#include <libdeflate.h>
+
+typedef struct
+{
+   png_structrp                   png_ptr;
+   struct libdeflate_compressor   *compressor;
+   struct libdeflate_decompressor *decompressor;
+} png_libdeflate_codec_state;
+
+typedef png_libdeflate_codec_state *png_libdeflate_codec_statep;
+
+static png_voidp
+png_libdeflate_codec_init(png_structrp png_ptr, int compress, int level,
+    int strategy)
+{
+   png_libdeflate_codec_statep state;
+
+   /* libdeflate has no strategies; level 0 (store only) is left to zlib. */
+   PNG_UNUSED(strategy)
+
+   if (compress != 0)
+   {
+      if (level == 0)
+         return NULL;
+
+      else if (level < 0 || level > 12)
+         level = 6;
+   }
+
+   state = png_voidcast(png_libdeflate_codec_statep,
+       png_malloc_base(png_ptr, (sizeof *state)));
+
+   if (state == NULL)
+      return NULL;
+
+   memset(state, 0, (sizeof *state));
+   state->png_ptr = png_ptr;
+
+   if (compress != 0)
+      state->compressor = libdeflate_alloc_compressor(level);
+
+   else
+      state->decompressor = libdeflate_alloc_decompressor();
+
+   if (state->compressor == NULL && state->decompressor == NULL)
+   {
+      png_free(png_ptr, state);
+      return NULL;
+   }
+
+   return state;
+}
+
+static int
+png_libdeflate_codec_compress(png_voidp state_ptr, png_const_bytep input,
+    png_alloc_size_t input_size, png_bytepp output,
+    png_alloc_size_t *output_size)
+{
+   png_libdeflate_codec_statep state = png_voidcast(
+       png_libdeflate_codec_statep, state_ptr);
+   size_t capacity = libdeflate_zlib_compress_bound(state->compressor,
+       input_size);
+   png_bytep out = png_voidcast(png_bytep,
+       png_malloc_base(state->png_ptr, capacity));
+   size_t size;
+
+   if (out == NULL)
+      return 0;
+
+   size = libdeflate_zlib_compress(state->compressor, input, input_size, out,
+       capacity);
+
+   if (size == 0)
+   {
+      png_free(state->png_ptr, out);
+      return 0;
+   }
+
+   *output = out;
+   *output_size = size;
+   return 1;
+}
+
+static int
+png_libdeflate_codec_decompress(png_voidp state_ptr, png_const_bytep input,
+    png_alloc_size_t input_size, png_bytep output,
+    png_alloc_size_t output_size)
+{
+   png_libdeflate_codec_statep state = png_voidcast(
+       png_libdeflate_codec_statep, state_ptr);
+   size_t in = 0, out = 0;
+
+   return libdeflate_zlib_decompress_ex(state->decompressor, input,
+       input_size, output, output_size, &in, &out) == LIBDEFLATE_SUCCESS &&
+       in == input_size && out == output_size;
+}
+
+static void
+png_libdeflate_codec_reset(png_voidp state_ptr)
+{
+   /* Nothing is kept between calls. */
+   PNG_UNUSED(state_ptr)
+}
+
+static void
+png_libdeflate_codec_end(png_voidp state_ptr)
+{
+   png_libdeflate_codec_statep state = png_voidcast(
+       png_libdeflate_codec_statep, state_ptr);
+
+   if (state->compressor != NULL)
+      libdeflate_free_compressor(state->compressor);
+
+   if (state->decompressor != NULL)
+      libdeflate_free_decompressor(state->decompressor);
+
+   png_free(state->png_ptr, state);
+}
+
+static const png_deflate_codec png_libdeflate_codec =
+{
+   "libdeflate",
+   png_libdeflate_codec_init,
+   png_libdeflate_codec_compress,
+   png_libdeflate_codec_decompress,
+   png_libdeflate_codec_reset,
+   png_libdeflate_codec_end
+};
+#endif /* LIBDEFLATE */
+
+void /* PRIVATE */
+png_deflate_codec_end(png_structrp png_ptr)
+{
+   if (png_ptr->deflate_codec_state != NULL)
+   {
+      png_voidp state = png_ptr->deflate_codec_state;
+
+      png_ptr->deflate_codec_state = NULL;
+      png_ptr->deflate_codec->end(state);
+   }
+}
+
+/* This function was added to libpng 1.6.49 */
+int PNGAPI
+png_set_deflate_codec(png_structrp png_ptr, int codec)
+{
+   const png_deflate_codec *deflate_codec;
+
+   png_debug(1, "in png_set_deflate_codec");
+
+   /* The codec cannot be changed once the IDAT stream has started. */
+   if (png_ptr == NULL || png_ptr->zowner == png_IDAT)
+      return 0;
+
+   switch (codec)
+   {
+      case PNG_DEFLATE_CODEC_STREAM:
+         deflate_codec = NULL;
+         break;
+
+      case PNG_DEFLATE_CODEC_ZLIB:
+         deflate_codec = &png_zlib_codec;
+         break;
+
+#ifdef PNG_LIBDEFLATE
+      case PNG_DEFLATE_CODEC_LIBDEFLATE:
+         deflate_codec = &png_libdeflate_codec;
+         break;
+#endif
+
+      default:
+         return 0;
+   }
+
+   png_deflate_codec_end(png_ptr);
+   png_ptr->deflate_codec = deflate_codec;
+
+   if (deflate_codec != NULL)
+      png_debug1(1, "using the %s deflate codec", deflate_codec->name);
+
+   return 1;
+}
+#endif /* DEFLATE_CODEC */
+
 /* Reset the CRC variable to 32 bits of 1's.  Care must be taken
  * in case CRC is > 32 bits to leave the top bits 0.
  */
@@ -168,6 +594,21 @@ png_calculate_crc(png_structrp png_ptr, png_const_bytep ptr, size_t length)
    {
       uLong crc = png_ptr->crc; /* Should never issue a warning */
 
+#ifdef PNG_CRC32_OPTIMIZATIONS
+      /* The hardware CRC handles the whole 16 byte blocks; zlib does the
+       * rest, or everything for short chunks.
+       */
+      if (png_ptr->crc32_blocks != NULL && length >= 64)
+      {
+         size_t blocks = length & ~(size_t)15;
+
+         crc = png_ptr->crc32_blocks((png_uint_32)crc, ptr, blocks);
+         ptr += blocks;
+         length -= blocks;
+      }
+
+      if (length > 0)
+#endif
       do
       {
          uInt safe_length = (uInt)length;
@@ -299,6 +740,11 @@ png_create_png_struct,(png_const_charp user_png_ver, png_voidp error_ptr,
       PNG_UNUSED(free_fn)
 #  endif
 
+   /* Select the CRC-32 implementation; this only checks the hardware. */
+#  ifdef PNG_CRC32_OPTIMIZATIONS
+      PNG_CRC32_OPTIMIZATIONS(&create_struct);
+#  endif
+
    /* (*error_fn) can return control to the caller after the error_ptr is set,
     * this will result in a memory leak unless the error_fn does something
     * extremely sophisticated.  The design lacks merit but is implicit in the
@@ -3363,6 +3809,285 @@ png_gamma_correct(png_structrp png_ptr, unsigned int value,
 #endif /* 16BIT */
 }
 
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+/* The gamma cache.  A table depends only on its kind, 'shift' and gamma value
+ * and is never changed once built, so when the PNG_GAMMA_CACHE option is on
+ * the tables are shared by all the png_structs in the process.  An entry
+ * outlives the png_struct which made it, so the entries are allocated with
+ * malloc and a png_struct with its own memory functions does not use the
+ * cache.  An entry is kept after its last user goes until more than
+ * PNG_GAMMA_CACHE_MAX entries are unused, or png_free_gamma_cache is called.
+ * The list is protected by a spin lock made from the compiler's atomic
+ * operations; without them the cache is not used.  The tables are built
+ * outside the lock, which is only held to walk the list.
+ */
+#if defined(_MSC_VER) || defined(__GNUC__)
+#  define PNG_GAMMA_CACHE_ATOMIC 1
+#  ifdef _MSC_VER
+#     include <intrin.h>
+#  endif
+#else
+#  define PNG_GAMMA_CACHE_ATOMIC 0
+#endif
+
+/* Let the CPU know the loop is spinning, or failing that give up the rest of
+ * the time slice.
+ */
+#if defined(__i386__) || defined(__x86_64__) || \
+    defined(_M_IX86) || defined(_M_X64)
+#  ifndef _MSC_VER
+#     include <immintrin.h>
+#  endif
+#  define PNG_GAMMA_CACHE_SPIN() _mm_pause()
+#elif defined(__unix__) || defined(__APPLE__)
+#  include <sched.h>
+#  define PNG_GAMMA_CACHE_SPIN() ((void)sched_yield())
+#else
+#  define PNG_GAMMA_CACHE_SPIN() ((void)0)
+#endif
+
+#define PNG_GAMMA_CACHE_MAX 8
+
+#define PNG_GAMMA_TABLE_8BIT  0
+#define PNG_GAMMA_TABLE_16BIT 1 /* png_build_16bit_table */
+#define PNG_GAMMA_TABLE_16TO8 2 /* png_build_16to8_table */
+
+typedef struct png_gamma_cache_entry
+{
+   struct png_gamma_cache_entry *next; /* most recently used first */
+   png_voidp       table;  /* png_bytep or png_uint_16pp, after the entry */
+   png_fixed_point gamma_val;
+   unsigned int    kind, shift;
+   unsigned int    users;
+} png_gamma_cache_entry;
+
+static png_gamma_cache_entry *png_gamma_cache = NULL;
+static volatile long png_gamma_cache_locked = 0;
+
+static void
+png_gamma_cache_lock(void)
+{
+#if PNG_GAMMA_CACHE_ATOMIC
+#  ifdef _MSC_VER
+   while (_InterlockedExchange(&png_gamma_cache_locked, 1) != 0)
+      PNG_GAMMA_CACHE_SPIN();
+#  else
+   while (__atomic_exchange_n(&png_gamma_cache_locked, 1, __ATOMIC_ACQUIRE)
+       != 0)
+      PNG_GAMMA_CACHE_SPIN();
+#  endif
+#endif
+}
+
+static void
+png_gamma_cache_unlock(void)
+{
+#if PNG_GAMMA_CACHE_ATOMIC
+#  ifdef _MSC_VER
+   _InterlockedExchange(&png_gamma_cache_locked, 0);
+#  else
+   __atomic_store_n(&png_gamma_cache_locked, 0, __ATOMIC_RELEASE);
+#  endif
+#endif
+}
+
+/* Unlink the unused entries after the first 'keep'; the caller frees them once
+ * the lock is released.
+ */
+static png_gamma_cache_entry *
+png_gamma_cache_trim(unsigned int keep)
+{
+   png_gamma_cache_entry **link = &png_gamma_cache;
+   png_gamma_cache_entry *unlinked = NULL;
+   unsigned int unused = 0;
+
+   while (*link != NULL)
+   {
+      png_gamma_cache_entry *entry = *link;
+
+      if (entry->users == 0 && ++unused > keep)
+      {
+         *link = entry->next;
+         entry->next = unlinked;
+         unlinked = entry;
+      }
+
+      else
+         link = &entry->next;
+   }
+
+   return unlinked;
+}
+
+static void
+png_gamma_cache_free(png_gamma_cache_entry *entry)
+{
+   while (entry != NULL)
+   {
+      png_gamma_cache_entry *next = entry->next;
+
+      free(entry);
+      entry = next;
+   }
+}
+
+/* Return the cached table, counting one more user, or NULL. */
+static png_voidp
+png_gamma_cache_find(png_const_structrp png_ptr, unsigned int kind,
+    unsigned int shift, png_fixed_point gamma_val)
+{
+   png_gamma_cache_entry **link;
+   png_voidp table = NULL;
+
+   if (png_ptr->gamma_cached == 0)
+      return NULL;
+
+   png_gamma_cache_lock();
+
+   for (link = &png_gamma_cache; *link != NULL; link = &(*link)->next)
+   {
+      png_gamma_cache_entry *entry = *link;
+
+      if (entry->kind == kind && entry->shift == shift &&
+          entry->gamma_val == gamma_val)
+      {
+         ++entry->users;
+         table = entry->table;
+
+         /* Move it to the front. */
+         *link = entry->next;
+         entry->next = png_gamma_cache;
+         png_gamma_cache = entry;
+         break;
+      }
+   }
+
+   png_gamma_cache_unlock();
+
+   return table;
+}
+
+/* Add the table just built to the cache and return the cached copy, with one
+ * user; the table itself is freed.  If the copy cannot be allocated the table
+ * is returned.
+ */
+static png_voidp
+png_gamma_cache_add(png_structrp png_ptr, unsigned int kind,
+    unsigned int shift, png_fixed_point gamma_val, png_voidp table)
+{
+   const size_t num = kind == PNG_GAMMA_TABLE_8BIT ? 0 : 1U << (8U - shift);
+   png_gamma_cache_entry *entry, *found, *unused;
+
+   if (png_ptr->gamma_cached == 0)
+      return table;
+
+   entry = png_voidcast(png_gamma_cache_entry*, malloc((sizeof *entry) +
+       (num == 0 ? 256 : num * ((sizeof (png_uint_16p)) + 512))));
+
+   if (entry == NULL)
+      return table;
+
+   entry->gamma_val = gamma_val;
+   entry->kind = kind;
+   entry->shift = shift;
+   entry->users = 1;
+
+   if (num == 0)
+   {
+      entry->table = entry + 1;
+      memcpy(entry->table, table, 256);
+      png_free(png_ptr, table);
+   }
+
+   else
+   {
+      png_uint_16pp rows = (png_uint_16pp)(png_voidp)(entry + 1);
+      png_uint_16pp old = png_voidcast(png_uint_16pp, table);
+      png_uint_16p data = (png_uint_16p)(png_voidp)(rows + num);
+      size_t i;
+
+      for (i = 0; i < num; ++i)
+      {
+         rows[i] = data + 256 * i;
+         memcpy(rows[i], old[i], 512);
+         png_free(png_ptr, old[i]);
+      }
+
+      png_free(png_ptr, old);
+      entry->table = rows;
+   }
+
+   png_gamma_cache_lock();
+
+   /* Another png_struct may have added the same table in the meantime. */
+   for (found = png_gamma_cache; found != NULL; found = found->next)
+      if (found->kind == kind && found->shift == shift &&
+          found->gamma_val == gamma_val)
+         break;
+
+   if (found != NULL)
+   {
+      ++found->users;
+      table = found->table;
+      entry->next = NULL;
+      unused = entry;
+   }
+
+   else
+   {
+      entry->next = png_gamma_cache;
+      png_gamma_cache = entry;
+      table = entry->table;
+      unused = png_gamma_cache_trim(PNG_GAMMA_CACHE_MAX);
+   }
+
+   png_gamma_cache_unlock();
+   png_gamma_cache_free(unused);
+
+   return table;
+}
+
+/* If 'table' is cached count one user less and return 1, else return 0. */
+static int
+png_gamma_cache_release(png_const_structrp png_ptr, png_const_voidp table)
+{
+   png_gamma_cache_entry *entry, *unused = NULL;
+
+   if (png_ptr->gamma_cached == 0 || table == NULL)
+      return 0;
+
+   png_gamma_cache_lock();
+
+   for (entry = png_gamma_cache; entry != NULL; entry = entry->next)
+   {
+      if (entry->table == table)
+      {
+         --entry->users;
+         unused = png_gamma_cache_trim(PNG_GAMMA_CACHE_MAX);
+         break;
+      }
+   }
+
+   png_gamma_cache_unlock();
+   png_gamma_cache_free(unused);
+
+   return entry != NULL;
+}
+
+void PNGAPI
+png_free_gamma_cache(void)
+{
+   png_gamma_cache_entry *unused;
+
+   png_debug(1, "in png_free_gamma_cache");
+
+   png_gamma_cache_lock();
+   unused = png_gamma_cache_trim(0);
+   png_gamma_cache_unlock();
+   png_gamma_cache_free(unused);
+}
+#endif /* GAMMA_CACHE */
+
 #ifdef PNG_16BIT_SUPPORTED
 /* Internal function to build a single 16-bit table - the table consists of
  * 'num' 256 entry subtables, where 'num' is determined by 'shift' - the amount
@@ -3387,8 +4112,17 @@ png_build_16bit_table(png_structrp png_ptr, png_uint_16pp *ptable,
    unsigned int max = (1U << (16U - shift)) - 1U;
    unsigned int max_by_2 = 1U << (15U - shift);
    unsigned int i;
+   png_uint_16pp table;
+
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   *ptable = png_voidcast(png_uint_16pp, png_gamma_cache_find(png_ptr,
+       PNG_GAMMA_TABLE_16BIT, shift, gamma_val));
 
-   png_uint_16pp table = *ptable =
+   if (*ptable != NULL)
+      return;
+#endif
+
+   table = *ptable =
        (png_uint_16pp)png_calloc(png_ptr, num * (sizeof (png_uint_16p)));
 
    for (i = 0; i < num; i++)
@@ -3444,6 +4178,11 @@ png_build_16bit_table(png_structrp png_ptr, png_uint_16pp *ptable,
          }
       }
    }
+
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   *ptable = png_voidcast(png_uint_16pp, png_gamma_cache_add(png_ptr,
+       PNG_GAMMA_TABLE_16BIT, shift, gamma_val, table));
+#endif
 }
 
 /* NOTE: this function expects the *inverse* of the overall gamma transformation
@@ -3457,8 +4196,17 @@ png_build_16to8_table(png_structrp png_ptr, png_uint_16pp *ptable,
    unsigned int max = (1U << (16U - shift))-1U;
    unsigned int i;
    png_uint_32 last;
+   png_uint_16pp table;
+
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   *ptable = png_voidcast(png_uint_16pp, png_gamma_cache_find(png_ptr,
+       PNG_GAMMA_TABLE_16TO8, shift, gamma_val));
 
-   png_uint_16pp table = *ptable =
+   if (*ptable != NULL)
+      return;
+#endif
+
+   table = *ptable =
        (png_uint_16pp)png_calloc(png_ptr, num * (sizeof (png_uint_16p)));
 
    /* 'num' is the number of tables and also the number of low bits of low
@@ -3510,6 +4258,11 @@ png_build_16to8_table(png_structrp png_ptr, png_uint_16pp *ptable,
       table[last & (0xff >> shift)][last >> (8U - shift)] = 65535U;
       last++;
    }
+
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   *ptable = png_voidcast(png_uint_16pp, png_gamma_cache_add(png_ptr,
+       PNG_GAMMA_TABLE_16TO8, shift, gamma_val, table));
+#endif
 }
 #endif /* 16BIT */
 
@@ -3522,7 +4275,17 @@ png_build_8bit_table(png_structrp png_ptr, png_bytepp ptable,
     png_fixed_point gamma_val)
 {
    unsigned int i;
-   png_bytep table = *ptable = (png_bytep)png_malloc(png_ptr, 256);
+   png_bytep table;
+
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   *ptable = png_voidcast(png_bytep, png_gamma_cache_find(png_ptr,
+       PNG_GAMMA_TABLE_8BIT, 0, gamma_val));
+
+   if (*ptable != NULL)
+      return;
+#endif
+
+   table = *ptable = (png_bytep)png_malloc(png_ptr, 256);
 
    if (png_gamma_significant(gamma_val) != 0)
       for (i=0; i<256; i++)
@@ -3531,19 +4294,34 @@ png_build_8bit_table(png_structrp png_ptr, png_bytepp ptable,
    else
       for (i=0; i<256; ++i)
          table[i] = (png_byte)(i & 0xff);
+
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   *ptable = png_voidcast(png_bytep, png_gamma_cache_add(png_ptr,
+       PNG_GAMMA_TABLE_8BIT, 0, gamma_val, table));
+#endif
 }
 
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+#  define PNG_GAMMA_CACHED(table) png_gamma_cache_release(png_ptr, table)
+#else
+#  define PNG_GAMMA_CACHED(table) 0
+#endif
+
 /* Used from png_read_destroy and below to release the memory used by the gamma
- * tables.
+ * tables.  Tables from the gamma cache are released, not freed.
  */
 void /* PRIVATE */
 png_destroy_gamma_table(png_structrp png_ptr)
 {
-   png_free(png_ptr, png_ptr->gamma_table);
+   if (PNG_GAMMA_CACHED(png_ptr->gamma_table) == 0)
+      png_free(png_ptr, png_ptr->gamma_table);
    png_ptr->gamma_table = NULL;
+   png_free(png_ptr, png_ptr->gamma_table_wide);
+   png_ptr->gamma_table_wide = NULL;
 
 #ifdef PNG_16BIT_SUPPORTED
-   if (png_ptr->gamma_16_table != NULL)
+   if (png_ptr->gamma_16_table != NULL &&
+       PNG_GAMMA_CACHED(png_ptr->gamma_16_table) == 0)
    {
       int i;
       int istop = (1 << (8 - png_ptr->gamma_shift));
@@ -3552,20 +4330,23 @@ png_destroy_gamma_table(png_structrp png_ptr)
          png_free(png_ptr, png_ptr->gamma_16_table[i]);
       }
    png_free(png_ptr, png_ptr->gamma_16_table);
-   png_ptr->gamma_16_table = NULL;
    }
+   png_ptr->gamma_16_table = NULL;
 #endif /* 16BIT */
 
 #if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
    defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
    defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
-   png_free(png_ptr, png_ptr->gamma_from_1);
+   if (PNG_GAMMA_CACHED(png_ptr->gamma_from_1) == 0)
+      png_free(png_ptr, png_ptr->gamma_from_1);
    png_ptr->gamma_from_1 = NULL;
-   png_free(png_ptr, png_ptr->gamma_to_1);
+   if (PNG_GAMMA_CACHED(png_ptr->gamma_to_1) == 0)
+      png_free(png_ptr, png_ptr->gamma_to_1);
    png_ptr->gamma_to_1 = NULL;
 
 #ifdef PNG_16BIT_SUPPORTED
-   if (png_ptr->gamma_16_from_1 != NULL)
+   if (png_ptr->gamma_16_from_1 != NULL &&
+       PNG_GAMMA_CACHED(png_ptr->gamma_16_from_1) == 0)
    {
       int i;
       int istop = (1 << (8 - png_ptr->gamma_shift));
@@ -3574,9 +4355,10 @@ png_destroy_gamma_table(png_structrp png_ptr)
          png_free(png_ptr, png_ptr->gamma_16_from_1[i]);
       }
    png_free(png_ptr, png_ptr->gamma_16_from_1);
-   png_ptr->gamma_16_from_1 = NULL;
    }
-   if (png_ptr->gamma_16_to_1 != NULL)
+   png_ptr->gamma_16_from_1 = NULL;
+   if (png_ptr->gamma_16_to_1 != NULL &&
+       PNG_GAMMA_CACHED(png_ptr->gamma_16_to_1) == 0)
    {
       int i;
       int istop = (1 << (8 - png_ptr->gamma_shift));
@@ -3585,8 +4367,8 @@ png_destroy_gamma_table(png_structrp png_ptr)
          png_free(png_ptr, png_ptr->gamma_16_to_1[i]);
       }
    png_free(png_ptr, png_ptr->gamma_16_to_1);
-   png_ptr->gamma_16_to_1 = NULL;
    }
+   png_ptr->gamma_16_to_1 = NULL;
 #endif /* 16BIT */
 #endif /* READ_BACKGROUND || READ_ALPHA_MODE || RGB_TO_GRAY */
 }
@@ -3630,6 +4412,14 @@ png_build_gamma_table(png_structrp png_ptr, int bit_depth)
       png_destroy_gamma_table(png_ptr);
    }
 
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   png_ptr->gamma_cached = (png_byte)(PNG_GAMMA_CACHE_ATOMIC &&
+#  ifdef PNG_USER_MEM_SUPPORTED
+       png_ptr->malloc_fn == NULL &&
+#  endif
+       ((png_ptr->options >> PNG_GAMMA_CACHE) & 3) == PNG_OPTION_ON);
+#endif
+
    /* The following fields are set, finally, in png_init_read_transformations.
     * If file_gamma is 0 (unset) nothing can be done otherwise if screen_gamma
     * is 0 (unset) there is no gamma correction but to/from linear is possible.
@@ -3945,6 +4735,102 @@ const png_byte png_sRGB_delta[512] =
    7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
    7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7
 };
+
+#if defined(PNG_SIMPLIFIED_WRITE_SUPPORTED) &&\
+   defined(PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS)
+/* The two tables above packed into one, as png_sRGB_base | (png_sRGB_delta <<
+ * 16), for the SIMD linear to sRGB code.
+ */
+const png_uint_32 png_sRGB_base_delta[512] =
+{
+   0x00cf0080,0x00c906f6,0x009e0d37,0x00811224,0x0071162b,0x006419a4,
+   0x005a1cbd,0x00521f8a,0x004d221c,0x00482482,0x004426c1,0x004028df,
+   0x003d2ae1,0x003b2cca,0x00382e9f,0x00363060,0x00343210,0x003233b1,
+   0x00313542,0x002f36c8,0x002e3842,0x002d39b1,0x002b3b15,0x002a3c71,
+   0x00293dc4,0x00283f0e,0x00274052,0x0027418d,0x002642c2,0x002543f1,
+   0x0024451a,0x0024463d,0x0023475a,0x00224872,0x00224986,0x00214a95,
+   0x00214b9f,0x00204ca5,0x00204da7,0x001f4ea5,0x001f4f9f,0x001e5096,
+   0x001e5189,0x001e5279,0x001d5365,0x001d544f,0x001c5535,0x001c5619,
+   0x001c56f9,0x001b57d7,0x001b58b3,0x001b598b,0x001b5a62,0x001a5b36,
+   0x001a5c07,0x001a5cd7,0x00195da4,0x00195e6f,0x00195f38,0x00195fff,
+   0x001860c4,0x00186187,0x00186248,0x00186308,0x001763c6,0x00176482,
+   0x0017653c,0x001765f5,0x001766ac,0x00166761,0x00166815,0x001668c7,
+   0x00166978,0x00166a28,0x00166ad6,0x00156b83,0x00156c2f,0x00156cd9,
+   0x00156d82,0x00156e29,0x00156ed0,0x00146f75,0x00147019,0x001470bc,
+   0x0014715d,0x001471fe,0x0014729d,0x0014733c,0x001473d9,0x00137475,
+   0x00137511,0x001375ab,0x00137644,0x001376dd,0x00137774,0x0013780a,
+   0x001378a0,0x00127934,0x001279c8,0x00127a5b,0x00127aed,0x00127b7e,
+   0x00127c0e,0x00127c9e,0x00127d2d,0x00127dba,0x00127e47,0x00117ed4,
+   0x00117f5f,0x00117fea,0x00118074,0x001180fd,0x00118186,0x0011820e,
+   0x00118295,0x0011831c,0x001183a1,0x00118427,0x001084ab,0x0010852f,
+   0x001085b2,0x00108635,0x001086b6,0x00108738,0x001087b8,0x00108839,
+   0x001088b8,0x00108937,0x001089b5,0x00108a33,0x00108ab0,0x00108b2d,
+   0x000f8ba9,0x000f8c24,0x000f8c9f,0x000f8d1a,0x000f8d94,0x000f8e0d,
+   0x000f8e86,0x000f8efe,0x000f8f76,0x000f8fed,0x000f9064,0x000f90db,
+   0x000f9151,0x000f91c6,0x000f923b,0x000f92af,0x000e9324,0x000e9397,
+   0x000e940a,0x000e947d,0x000e94ef,0x000e9561,0x000e95d2,0x000e9643,
+   0x000e96b4,0x000e9724,0x000e9793,0x000e9803,0x000e9872,0x000e98e0,
+   0x000e994e,0x000e99bc,0x000e9a29,0x000e9a96,0x000e9b02,0x000d9b6e,
+   0x000d9bda,0x000d9c45,0x000d9cb0,0x000d9d1b,0x000d9d85,0x000d9def,
+   0x000d9e59,0x000d9ec2,0x000d9f2b,0x000d9f93,0x000d9ffb,0x000da063,
+   0x000da0cb,0x000da132,0x000da199,0x000da1ff,0x000da265,0x000da2cb,
+   0x000da331,0x000da396,0x000da3fb,0x000da45f,0x000ca4c3,0x000ca527,
+   0x000ca58b,0x000ca5ee,0x000ca651,0x000ca6b4,0x000ca717,0x000ca779,
+   0x000ca7db,0x000ca83c,0x000ca89d,0x000ca8fe,0x000ca95f,0x000ca9c0,
+   0x000caa20,0x000caa80,0x000caadf,0x000cab3f,0x000cab9e,0x000cabfc,
+   0x000cac5b,0x000cacb9,0x000cad17,0x000cad75,0x000cadd3,0x000cae30,
+   0x000cae8d,0x000caeea,0x000caf46,0x000cafa2,0x000baffe,0x000bb05a,
+   0x000bb0b6,0x000bb111,0x000bb16c,0x000bb1c7,0x000bb221,0x000bb27c,
+   0x000bb2d6,0x000bb330,0x000bb389,0x000bb3e3,0x000bb43c,0x000bb495,
+   0x000bb4ee,0x000bb546,0x000bb59e,0x000bb5f7,0x000bb64e,0x000bb6a6,
+   0x000bb6fe,0x000bb755,0x000bb7ac,0x000bb803,0x000bb859,0x000bb8b0,
+   0x000bb906,0x000bb95c,0x000bb9b2,0x000bba07,0x000bba5d,0x000bbab2,
+   0x000bbb07,0x000bbb5c,0x000bbbb0,0x000bbc05,0x000bbc59,0x000abcad,
+   0x000abd01,0x000abd54,0x000abda8,0x000abdfb,0x000abe4e,0x000abea1,
+   0x000abef4,0x000abf46,0x000abf98,0x000abfeb,0x000ac03d,0x000ac08e,
+   0x000ac0e0,0x000ac132,0x000ac183,0x000ac1d4,0x000ac225,0x000ac276,
+   0x000ac2c6,0x000ac317,0x000ac367,0x000ac3b7,0x000ac407,0x000ac457,
+   0x000ac4a6,0x000ac4f6,0x000ac545,0x000ac594,0x000ac5e3,0x000ac632,
+   0x000ac680,0x000ac6cf,0x000ac71d,0x000ac76b,0x000ac7b9,0x000ac807,
+   0x000ac855,0x000ac8a2,0x000ac8ef,0x000ac93d,0x000ac98a,0x000ac9d7,
+   0x000aca23,0x000aca70,0x000acabc,0x000acb09,0x000acb55,0x0009cba1,
+   0x0009cbed,0x0009cc38,0x0009cc84,0x0009ccd0,0x0009cd1b,0x0009cd66,
+   0x0009cdb1,0x0009cdfc,0x0009ce47,0x0009ce91,0x0009cedc,0x0009cf26,
+   0x0009cf70,0x0009cfba,0x0009d004,0x0009d04e,0x0009d098,0x0009d0e1,
+   0x0009d12a,0x0009d174,0x0009d1bd,0x0009d206,0x0009d24f,0x0009d297,
+   0x0009d2e0,0x0009d328,0x0009d371,0x0009d3b9,0x0009d401,0x0009d449,
+   0x0009d491,0x0009d4d9,0x0009d520,0x0009d568,0x0009d5af,0x0009d5f6,
+   0x0009d63d,0x0009d684,0x0009d6cb,0x0009d712,0x0009d759,0x0009d79f,
+   0x0009d7e5,0x0009d82c,0x0009d872,0x0009d8b8,0x0009d8fe,0x0009d944,
+   0x0009d989,0x0009d9cf,0x0009da14,0x0009da5a,0x0009da9f,0x0009dae4,
+   0x0009db29,0x0009db6e,0x0009dbb3,0x0009dbf7,0x0009dc3c,0x0009dc80,
+   0x0009dcc5,0x0009dd09,0x0009dd4d,0x0008dd91,0x0008ddd5,0x0008de19,
+   0x0008de5c,0x0008dea0,0x0008dee3,0x0008df27,0x0008df6a,0x0008dfad,
+   0x0008dff0,0x0008e033,0x0008e076,0x0008e0b9,0x0008e0fb,0x0008e13e,
+   0x0008e180,0x0008e1c3,0x0008e205,0x0008e247,0x0008e289,0x0008e2cb,
+   0x0008e30d,0x0008e34f,0x0008e390,0x0008e3d2,0x0008e413,0x0008e455,
+   0x0008e496,0x0008e4d7,0x0008e518,0x0008e559,0x0008e59a,0x0008e5db,
+   0x0008e61c,0x0008e65c,0x0008e69d,0x0008e6dd,0x0008e71d,0x0008e75e,
+   0x0008e79e,0x0008e7de,0x0008e81e,0x0008e85e,0x0008e89d,0x0008e8dd,
+   0x0008e91d,0x0008e95c,0x0008e99c,0x0008e9db,0x0008ea1a,0x0008ea59,
+   0x0008ea98,0x0008ead7,0x0008eb16,0x0008eb55,0x0008eb94,0x0008ebd2,
+   0x0008ec11,0x0008ec4f,0x0008ec8e,0x0008eccc,0x0008ed0a,0x0008ed48,
+   0x0008ed86,0x0008edc4,0x0008ee02,0x0008ee40,0x0008ee7e,0x0008eebb,
+   0x0008eef9,0x0008ef36,0x0008ef74,0x0008efb1,0x0008efee,0x0008f02b,
+   0x0008f068,0x0008f0a5,0x0008f0e2,0x0008f11f,0x0008f15c,0x0008f198,
+   0x0008f1d5,0x0008f211,0x0008f24e,0x0008f28a,0x0008f2c6,0x0008f303,
+   0x0008f33f,0x0007f37b,0x0007f3b7,0x0007f3f2,0x0007f42e,0x0007f46a,
+   0x0007f4a6,0x0007f4e1,0x0007f51d,0x0007f558,0x0007f593,0x0007f5cf,
+   0x0007f60a,0x0007f645,0x0007f680,0x0007f6bb,0x0007f6f6,0x0007f731,
+   0x0007f76c,0x0007f7a6,0x0007f7e1,0x0007f81b,0x0007f856,0x0007f890,
+   0x0007f8cb,0x0007f905,0x0007f93f,0x0007f979,0x0007f9b3,0x0007f9ed,
+   0x0007fa27,0x0007fa61,0x0007fa9b,0x0007fad4,0x0007fb0e,0x0007fb48,
+   0x0007fb81,0x0007fbbb,0x0007fbf4,0x0007fc2d,0x0007fc66,0x0007fca0,
+   0x0007fcd9,0x0007fd12,0x0007fd4b,0x0007fd84,0x0007fdbc,0x0007fdf5,
+   0x0007fe2e,0x0007fe66,0x0007fe9f,0x0007fed7,0x0007ff10,0x0007ff48,
+   0x0007ff81,0x0007ffb9
+};
+#endif
 #endif /* SIMPLIFIED READ/WRITE sRGB support */
 
 /* SIMPLIFIED READ/WRITE SUPPORT */
@@ -3977,6 +4863,11 @@ png_image_free_function(png_voidp argument)
             (void)fclose(fp);
          }
       }
+
+#     ifdef PNG_SIMPLIFIED_READ_SUPPORTED
+         if (cp->mapped_file != NULL)
+            png_image_unmap_file(cp);
+#     endif
 #  endif
 
    /* Copy the control structure so that the original, allocated, version can be
@@ -638,6 +638,19 @@ typedef const png_unknown_chunk * png_const_unknown_chunkp;
 typedef png_unknown_chunk * * png_unknown_chunkpp;
 #endif
 
+#ifdef PNG_READ_PROBE_SUPPORTED
+/* png_chunk_location records where png_read_probe found a chunk. */
+typedef struct png_chunk_location_t
+{
+   png_byte name[5];        /* Textual chunk name with '\0' terminator */
+   png_uint_32 length;      /* Length of the chunk data */
+   png_alloc_size_t offset; /* Of the chunk length, from the start of the PNG */
+}
+png_chunk_location;
+
+typedef png_chunk_location * png_chunk_locationp;
+#endif
+
 /* Flag values for the unknown chunk location byte. */
 #define PNG_HAVE_IHDR  0x01
 #define PNG_HAVE_PLTE  0x02
@@ -821,6 +834,21 @@ typedef PNG_CALLBACK(void, *png_user_transform_ptr, (png_structp, png_row_infop,
 typedef PNG_CALLBACK(int, *png_user_chunk_ptr, (png_structp,
     png_unknown_chunkp));
 #endif
+#ifdef PNG_PARALLEL_SUPPORTED
+/* Parallel processing support.  libpng does not create threads itself;
+ * instead some operations are split into independent jobs which are passed
+ * to an application supplied 'parallel' function.  This must arrange for
+ * job(job_arg, n) to be called once for each n in [0,job_count), in any
+ * order and on any thread, and must not return until all the calls have
+ * returned.  The jobs never call back into the application (other than
+ * through the memory allocation functions) and never call png_error.
+ */
+typedef PNG_CALLBACK(void, *png_parallel_job_ptr, (png_voidp job_arg,
+    png_uint_32 job_number));
+typedef PNG_CALLBACK(void, *png_parallel_ptr, (png_structp,
+    png_parallel_job_ptr job, png_voidp job_arg, png_uint_32 job_count));
+#endif
+
 #ifdef PNG_UNKNOWN_CHUNKS_SUPPORTED
 /* not used anywhere */
 /* typedef PNG_CALLBACK(void, *png_unknown_chunk_ptr, (png_structp)); */
@@ -1036,6 +1064,21 @@ PNG_EXPORT(22, void, png_read_info,
     (png_structrp png_ptr, png_inforp info_ptr));
 #endif
 
+#ifdef PNG_READ_PROBE_SUPPORTED
+/* Read the chunks before the image data like png_read_info, but read no more
+ * than max_bytes bytes of the PNG (including the signature) and skip, without
+ * decompressing, every ancillary chunk not named in chunk_list (num_chunks
+ * 5-byte entries as for png_set_keep_unknown_chunks).  Up to *num_locations
+ * chunks, including the first IDAT, are recorded in locations and
+ * *num_locations is set to the number recorded.  Returns 1 if the first IDAT
+ * was reached, when the image can be read as after png_read_info, and 0 if
+ * max_bytes was reached first, when the read cannot continue.
+ */
+PNG_EXPORT(270, int, png_read_probe, (png_structrp png_ptr, png_inforp info_ptr,
+    png_alloc_size_t max_bytes, png_const_bytep chunk_list, int num_chunks,
+    png_chunk_locationp locations, int *num_locations));
+#endif
+
 #ifdef PNG_TIME_RFC1123_SUPPORTED
    /* Convert to a US string format: there is no localization support in this
     * routine.  The original implementation used a 29 character buffer in
@@ -1373,6 +1416,17 @@ PNG_EXPORT(51, void, png_set_flush, (png_structrp png_ptr, int nrows));
 PNG_EXPORT(52, void, png_write_flush, (png_structrp png_ptr));
 #endif
 
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+/* Compress IDAT in independent bands of 'band_rows' rows, up to 'max_jobs'
+ * bands at a time, using the function set by png_set_parallel_fn.  Each band
+ * ends with a zlib full flush, so the result can also be decoded in parallel
+ * (see PNG_PARALLEL_INFLATE).  0 rows turns this off, 0 jobs selects the
+ * default (PNG_DEFAULT_BAND_JOBS).
+ */
+PNG_EXPORT(262, void, png_set_compression_bands, (png_structrp png_ptr,
+    png_uint_32 band_rows, png_uint_32 max_jobs));
+#endif
+
 /* Optional update palette with requested transformations */
 PNG_EXPORT(53, void, png_start_read_image, (png_structrp png_ptr));
 
@@ -1386,6 +1440,26 @@ PNG_EXPORT(55, void, png_read_rows, (png_structrp png_ptr, png_bytepp row,
     png_bytepp display_row, png_uint_32 num_rows));
 #endif
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* Read rows of image data into memory, each row_stride bytes after the last
+ * (this may be negative).  The same as png_read_rows with a NULL display_row
+ * but without an array of row pointers.
+ */
+PNG_EXPORT(265, void, png_read_rows_into, (png_structrp png_ptr,
+    png_voidp rows, png_ptrdiff_t row_stride, png_uint_32 num_rows));
+#endif
+
+#ifdef PNG_READ_REGION_SUPPORTED
+/* Read only the given rectangle of a non-interlaced image.  Call this after
+ * png_read_info and before png_read_update_info, which then reports the size
+ * of the rectangle.  Rows above it are decompressed and unfiltered but not
+ * transformed; the image data after it is skipped.  Returns 0 if the region
+ * is outside the image or the image is interlaced.
+ */
+PNG_EXPORT(266, int, png_set_read_region, (png_structrp png_ptr,
+    png_uint_32 x, png_uint_32 y, png_uint_32 width, png_uint_32 height));
+#endif
+
 #ifdef PNG_SEQUENTIAL_READ_SUPPORTED
 /* Read a row of data. */
 PNG_EXPORT(56, void, png_read_row, (png_structrp png_ptr, png_bytep row,
@@ -1604,6 +1678,15 @@ PNG_EXPORT(77, void, png_set_write_fn, (png_structrp png_ptr, png_voidp io_ptr,
 PNG_EXPORT(78, void, png_set_read_fn, (png_structrp png_ptr, png_voidp io_ptr,
     png_rw_ptr read_data_fn));
 
+#ifdef PNG_READ_SUPPORTED
+/* Read the PNG from a buffer holding the whole file.  The buffer must not be
+ * changed or freed until reading is finished.  IDAT data is decompressed
+ * straight from the buffer.
+ */
+PNG_EXPORT(263, void, png_set_read_memory, (png_structrp png_ptr,
+    png_const_voidp memory, size_t size));
+#endif
+
 /* Return the user pointer associated with the I/O functions */
 PNG_EXPORT(79, png_voidp, png_get_io_ptr, (png_const_structrp png_ptr));
 
@@ -1724,6 +1807,34 @@ PNG_EXPORT(220, png_uint_32, png_process_data_skip, (png_structrp));
  */
 PNG_EXPORT(93, void, png_progressive_combine_row, (png_const_structrp png_ptr,
     png_bytep old_row, png_const_bytep new_row));
+
+#ifdef PNG_PULL_READ_SUPPORTED
+/* The pull interface to the progressive reader: instead of callbacks the
+ * application gives libpng data with png_pull_data then calls png_pull_row
+ * until it returns PNG_PULL_NEED_DATA.  Errors are returned as PNG_PULL_ERROR,
+ * png_error does not longjmp out of these functions.
+ */
+#define PNG_PULL_ERROR     0 /* png_error was called, the read has failed */
+#define PNG_PULL_NEED_DATA 1 /* all the data has been used, call png_pull_data */
+#define PNG_PULL_INFO      2 /* the chunks before the image data have been read */
+#define PNG_PULL_ROW       3 /* *row is the next row */
+#define PNG_PULL_END       4 /* the IEND chunk has been read */
+
+/* The data is not copied; it must stay valid until png_pull_row returns
+ * PNG_PULL_NEED_DATA.  Returns 0 if the read has already failed.
+ */
+PNG_EXPORT(268, int, png_pull_data, (png_structrp png_ptr,
+    png_const_bytep buffer, size_t buffer_size));
+
+/* Returns one of the PNG_PULL_ values above.  For PNG_PULL_ROW, *row points
+ * to the transformed row, valid until the next call, and row_number and pass
+ * (either may be NULL) are set as for the progressive row callback.  Rows
+ * which have not changed in a pass when interlace handling is on are not
+ * returned.
+ */
+PNG_EXPORT(269, int, png_pull_row, (png_structrp png_ptr, png_inforp info_ptr,
+    png_bytepp row, png_uint_32p row_number, int *pass));
+#endif /* PULL_READ */
 #endif /* PROGRESSIVE_READ */
 
 PNG_EXPORTA(94, png_voidp, png_malloc, (png_const_structrp png_ptr,
@@ -3073,6 +3184,25 @@ typedef struct
     * because that call initializes the 'flags' field.
     */
 
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+#define PNG_IMAGE_FLAG_PARALLEL 0x08
+   /* On write compress the image data in independent bands of about 256KB
+    * (see png_set_compression_bands).  The PNG file will be slightly larger
+    * but it can be decoded in parallel; the simplified API does not have a
+    * way to set a parallel function so the bands are compressed one after the
+    * other.  This flag has no effect on read.
+    */
+#endif
+
+#define PNG_IMAGE_FLAG_MAP_FILE 0x10
+   /* On read set this before calling png_image_begin_read_from_file to map the
+    * file into memory, where the system supports this, instead of reading it
+    * through stdio.  The file must not be truncated while it is being read; on
+    * most systems reading a page of the mapping that is past the new end of
+    * the file raises SIGBUS, which ends the process.  The flag has no effect on
+    * write or with the other png_image_begin_read_ functions.
+    */
+
 #ifdef PNG_SIMPLIFIED_READ_SUPPORTED
 /* READ APIs
  * ---------
@@ -3096,6 +3226,17 @@ PNG_EXPORT(236, int, png_image_begin_read_from_memory, (png_imagep image,
    png_const_voidp memory, size_t size));
    /* The PNG header is read from the given memory buffer. */
 
+#ifdef PNG_READ_REGION_SUPPORTED
+PNG_EXPORT(267, int, png_image_set_read_region, (png_imagep image,
+   png_uint_32 x, png_uint_32 y, png_uint_32 width, png_uint_32 height));
+   /* Optionally called before png_image_finish_read to read just the given
+    * rectangle of the image, in pixels from the top left of the whole image.
+    * image->width and image->height are set to the size of the rectangle, so
+    * the buffer size macros give the size of the region.  Interlaced images
+    * are not supported.
+    */
+#endif
+
 PNG_EXPORT(237, int, png_image_finish_read, (png_imagep image,
    png_const_colorp background, void *buffer, png_int_32 row_stride,
    void *colormap));
@@ -3340,8 +3481,28 @@ PNG_EXPORT(245, int, png_image_write_to_memory, (png_imagep image, void *memory,
 #  define PNG_RISCV_RVV 14
 #endif
 
+/* SOFTWARE: Inflate IDAT in parallel from full-flush restart points */
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+#  define PNG_PARALLEL_INFLATE 16
+#endif
+
+/* HARDWARE: x86 SSSE3, SSE4.1 and AVX2 instructions, which are used when the
+ * CPU has them unless turned off; turning off one level turns off the levels
+ * above it.
+ */
+#ifdef PNG_INTEL_SSE_API_SUPPORTED
+#  define PNG_INTEL_SSSE3 18
+#  define PNG_INTEL_SSE4_1 20
+#  define PNG_INTEL_AVX2 22
+#endif
+
+/* SOFTWARE: Share the gamma tables with other png_structs in the process */
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+#  define PNG_GAMMA_CACHE 24
+#endif
+
 /* Next option - numbers must be even */
-#define PNG_OPTION_NEXT 16
+#define PNG_OPTION_NEXT 26
 
 /* Return values: NOTE: there are four values and 'off' is *not* zero */
 #define PNG_OPTION_UNSET   0 /* Unset - defaults to off */
@@ -3353,6 +3514,43 @@ PNG_EXPORT(244, int, png_set_option, (png_structrp png_ptr, int option,
    int onoff));
 #endif /* SET_OPTION */
 
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+/* Free the gamma tables kept by the PNG_GAMMA_CACHE option which no png_struct
+ * is using.  The cache belongs to the process, not to any png_struct, and its
+ * memory comes from malloc; call this after destroying the last png_struct
+ * which used the cache to release all of it.
+ */
+PNG_EXPORT(271, void, png_free_gamma_cache, (void));
+#endif
+
+#ifdef PNG_PARALLEL_SUPPORTED
+/* Set the function used to run independent jobs, see png_parallel_ptr above.
+ * If this is not called, or 'parallel_fn' is NULL, the jobs are run one after
+ * the other on the calling thread.  The memory allocation functions must be
+ * thread safe if a function is set which uses more than one thread.
+ */
+PNG_EXPORT(260, void, png_set_parallel_fn, (png_structrp png_ptr,
+    png_voidp parallel_ptr, png_parallel_ptr parallel_fn));
+PNG_EXPORT(261, png_voidp, png_get_parallel_ptr,
+    (png_const_structrp png_ptr));
+#endif /* PARALLEL */
+
+#ifdef PNG_DEFLATE_CODEC_SUPPORTED
+/* Select how IDAT is compressed or decompressed.  By default (STREAM) zlib
+ * processes the data a row at a time.  The other codecs handle the whole zlib
+ * stream in one call, which is faster but needs memory for all the filtered
+ * image data and the compressed data at once; they are used by the sequential
+ * reader and by the writer, where png_write_flush then has no effect.  If a
+ * codec cannot handle a stream the default is used.  Returns 0 if the codec is
+ * not available in this build, or if called after the IDAT stream has started.
+ */
+#define PNG_DEFLATE_CODEC_STREAM     0 /* zlib, a row at a time (default) */
+#define PNG_DEFLATE_CODEC_ZLIB       1 /* zlib, the whole stream at once */
+#define PNG_DEFLATE_CODEC_LIBDEFLATE 2 /* libdeflate, if built with it */
+PNG_EXPORT(264, int, png_set_deflate_codec, (png_structrp png_ptr,
+    int codec));
+#endif
+
 /*******************************************************************************
  *  END OF HARDWARE AND SOFTWARE OPTIONS
  ******************************************************************************/
@@ -3365,7 +3563,7 @@ PNG_EXPORT(244, int, png_set_option, (png_structrp png_ptr, int option,
  * one to use is one more than this.)
  */
 #ifdef PNG_EXPORT_LAST_ORDINAL
-  PNG_EXPORT_LAST_ORDINAL(259);
+  PNG_EXPORT_LAST_ORDINAL(271);
 #endif
 
 #ifdef __cplusplus
@@ -1339,6 +1339,15 @@ png_get_chunk_malloc_max(png_const_structrp png_ptr)
 }
 #endif /* SET_USER_LIMITS */
 
+#ifdef PNG_PARALLEL_SUPPORTED
+/* This function was added to libpng 1.6.49 */
+png_voidp PNGAPI
+png_get_parallel_ptr(png_const_structrp png_ptr)
+{
+   return (png_ptr ? png_ptr->parallel_ptr : NULL);
+}
+#endif /* PARALLEL */
+
 /* These functions were added to libpng 1.4.0 */
 #ifdef PNG_IO_STATE_SUPPORTED
 png_uint_32 PNGAPI
@@ -263,6 +263,13 @@ png_push_read_chunk(png_structrp png_ptr, png_inforp info_ptr)
       png_ptr->idat_size = png_ptr->push_length;
       png_ptr->process_mode = PNG_READ_IDAT_MODE;
       png_push_have_info(png_ptr, info_ptr);
+#ifdef PNG_PULL_READ_SUPPORTED
+      /* png_pull_row returns here so that the application can set up the
+       * transformations; it sets up the output buffer on the next call.
+       */
+      if (png_ptr->pull_state != 0)
+         return;
+#endif
       png_ptr->zstream.avail_out =
           (uInt) PNG_ROWBYTES(png_ptr->pixel_depth,
           png_ptr->iwidth) + 1;
@@ -325,24 +332,16 @@ png_push_fill_buffer(png_structp png_ptr, png_bytep buffer, size_t length)
 void /* PRIVATE */
 png_push_save_buffer(png_structrp png_ptr)
 {
-   if (png_ptr->save_buffer_size != 0)
-   {
-      if (png_ptr->save_buffer_ptr != png_ptr->save_buffer)
-      {
-         size_t i, istop;
-         png_bytep sp;
-         png_bytep dp;
+   /* Only the bytes not yet consumed are kept; move them to the start of the
+    * buffer so that the space freed by earlier reads is reused.
+    */
+   if (png_ptr->save_buffer_size != 0 &&
+       png_ptr->save_buffer_ptr != png_ptr->save_buffer)
+      memmove(png_ptr->save_buffer, png_ptr->save_buffer_ptr,
+          png_ptr->save_buffer_size);
 
-         istop = png_ptr->save_buffer_size;
-         for (i = 0, sp = png_ptr->save_buffer_ptr, dp = png_ptr->save_buffer;
-             i < istop; i++, sp++, dp++)
-         {
-            *dp = *sp;
-         }
-      }
-   }
-   if (png_ptr->save_buffer_size + png_ptr->current_buffer_size >
-       png_ptr->save_buffer_max)
+   if (png_ptr->current_buffer_size >
+       png_ptr->save_buffer_max - png_ptr->save_buffer_size)
    {
       size_t new_max;
       png_bytep old_buffer;
@@ -354,6 +353,15 @@ png_push_save_buffer(png_structrp png_ptr)
       }
 
       new_max = png_ptr->save_buffer_size + png_ptr->current_buffer_size + 256;
+
+      /* A chunk that arrives in many small pieces is appended to here once per
+       * call to png_process_data; grow the buffer geometrically so that the
+       * cost of copying it stays linear in the size of the chunk.
+       */
+      if (png_ptr->save_buffer_max < PNG_SIZE_MAX / 2 &&
+          new_max < 2 * png_ptr->save_buffer_max)
+         new_max = 2 * png_ptr->save_buffer_max;
+
       old_buffer = png_ptr->save_buffer;
       png_ptr->save_buffer = (png_bytep)png_malloc_warn(png_ptr,
           (size_t)new_max);
@@ -436,19 +444,24 @@ png_push_read_IDAT(png_structrp png_ptr)
       if (idat_size < save_size)
          save_size = (size_t)idat_size;
 
-      else
-         idat_size = (png_uint_32)save_size;
+      save_size = png_process_IDAT_data(png_ptr, png_ptr->save_buffer_ptr,
+          save_size);
+      idat_size = (png_uint_32)save_size;
 
       png_calculate_crc(png_ptr, png_ptr->save_buffer_ptr, save_size);
 
-      png_process_IDAT_data(png_ptr, png_ptr->save_buffer_ptr, save_size);
-
       png_ptr->idat_size -= idat_size;
       png_ptr->buffer_size -= save_size;
       png_ptr->save_buffer_size -= save_size;
       png_ptr->save_buffer_ptr += save_size;
    }
 
+#ifdef PNG_PULL_READ_SUPPORTED
+   /* png_pull_row returns the rows already decoded before using more data. */
+   if (png_ptr->pull_rows != 0)
+      return;
+#endif
+
    if (png_ptr->idat_size != 0 && png_ptr->current_buffer_size != 0)
    {
       size_t save_size = png_ptr->current_buffer_size;
@@ -462,13 +475,12 @@ png_push_read_IDAT(png_structrp png_ptr)
       if (idat_size < save_size)
          save_size = (size_t)idat_size;
 
-      else
-         idat_size = (png_uint_32)save_size;
+      save_size = png_process_IDAT_data(png_ptr, png_ptr->current_buffer_ptr,
+          save_size);
+      idat_size = (png_uint_32)save_size;
 
       png_calculate_crc(png_ptr, png_ptr->current_buffer_ptr, save_size);
 
-      png_process_IDAT_data(png_ptr, png_ptr->current_buffer_ptr, save_size);
-
       png_ptr->idat_size -= idat_size;
       png_ptr->buffer_size -= save_size;
       png_ptr->current_buffer_size -= save_size;
@@ -485,7 +497,7 @@ png_push_read_IDAT(png_structrp png_ptr)
    }
 }
 
-void /* PRIVATE */
+size_t /* PRIVATE */
 png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
     size_t buffer_length)
 {
@@ -555,7 +567,7 @@ png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
          }
 
          /* Skip the check on unprocessed input */
-         return;
+         return buffer_length;
       }
 
       /* Did inflate output any data? */
@@ -576,7 +588,7 @@ png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
             /* Do no more processing; skip the unprocessed
              * input check below.
              */
-            return;
+            return buffer_length;
          }
 
          /* Do we have a complete row? */
@@ -587,6 +599,14 @@ png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
       /* And check for the end of the stream. */
       if (ret == Z_STREAM_END)
          png_ptr->flags |= PNG_FLAG_ZSTREAM_ENDED;
+
+#ifdef PNG_PULL_READ_SUPPORTED
+      /* Stop after a row for png_pull_row; the rest of the data is passed
+       * in again when it asks for the next row.
+       */
+      if (png_ptr->pull_rows != 0)
+         return buffer_length - png_ptr->zstream.avail_in;
+#endif
    }
 
    /* All the data should have been processed, if anything
@@ -595,6 +615,8 @@ png_process_IDAT_data(png_structrp png_ptr, png_bytep buffer,
     */
    if (png_ptr->zstream.avail_in > 0)
       png_warning(png_ptr, "Extra compression data in IDAT");
+
+   return buffer_length;
 }
 
 void /* PRIVATE */
@@ -875,6 +897,11 @@ png_read_push_finish_row(png_structrp png_ptr)
 void /* PRIVATE */
 png_push_have_info(png_structrp png_ptr, png_inforp info_ptr)
 {
+#ifdef PNG_PULL_READ_SUPPORTED
+   if (png_ptr->pull_state != 0)
+      png_ptr->pull_state = PNG_PULL_INFO;
+#endif
+
    if (png_ptr->info_fn != NULL)
       (*(png_ptr->info_fn))(png_ptr, info_ptr);
 }
@@ -889,6 +916,20 @@ png_push_have_end(png_structrp png_ptr, png_inforp info_ptr)
 void /* PRIVATE */
 png_push_have_row(png_structrp png_ptr, png_bytep row)
 {
+#ifdef PNG_PULL_READ_SUPPORTED
+   /* Within one call to png_push_process_row the rows with data come first
+    * and have consecutive numbers in the same pass, so a count is enough.
+    */
+   if (png_ptr->pull_state != 0 && row != NULL)
+   {
+      if (png_ptr->pull_rows++ == 0)
+      {
+         png_ptr->pull_row_number = png_ptr->row_number;
+         png_ptr->pull_pass = png_ptr->pass;
+      }
+   }
+#endif
+
    if (png_ptr->row_fn != NULL)
       (*(png_ptr->row_fn))(png_ptr, row, png_ptr->row_number,
           (int)png_ptr->pass);
@@ -934,4 +975,173 @@ png_get_progressive_ptr(png_const_structrp png_ptr)
 
    return png_ptr->io_ptr;
 }
+
+#ifdef PNG_PULL_READ_SUPPORTED
+/* Call function(png_ptr, info_ptr, arg) with png_error returning here;
+ * after an error the progressive reader stays in PNG_ERROR_MODE.
+ */
+static int
+png_pull_safe(png_structrp png_ptr, png_inforp info_ptr, png_voidp arg,
+    int (*function)(png_structrp, png_inforp, png_voidp))
+{
+   jmp_buf safe_jmpbuf;
+   jmp_buf *const saved_jmp_buf = png_ptr->jmp_buf_ptr;
+   const size_t saved_jmp_buf_size = png_ptr->jmp_buf_size;
+   const png_longjmp_ptr saved_longjmp_fn = png_ptr->longjmp_fn;
+   int result;
+
+   if (png_ptr->process_mode == PNG_ERROR_MODE)
+      return PNG_PULL_ERROR;
+
+   if (setjmp(safe_jmpbuf) == 0)
+   {
+      png_ptr->jmp_buf_ptr = &safe_jmpbuf;
+      png_ptr->jmp_buf_size = 0;
+      png_ptr->longjmp_fn = longjmp;
+      result = function(png_ptr, info_ptr, arg);
+   }
+
+   else
+   {
+      png_ptr->process_mode = PNG_ERROR_MODE;
+      png_ptr->buffer_size = 0;
+      png_ptr->pull_rows = 0;
+      result = PNG_PULL_ERROR;
+   }
+
+   png_ptr->jmp_buf_ptr = saved_jmp_buf;
+   png_ptr->jmp_buf_size = saved_jmp_buf_size;
+   png_ptr->longjmp_fn = saved_longjmp_fn;
+
+   return result;
+}
+
+static int
+png_pull_save(png_structrp png_ptr, png_inforp info_ptr, png_voidp arg)
+{
+   /* Keep what is left of the last buffer; the application is about to reuse
+    * it.  This is only needed when png_pull_data is called before
+    * png_pull_row has returned PNG_PULL_NEED_DATA.
+    */
+   png_push_save_buffer(png_ptr);
+
+   PNG_UNUSED(info_ptr)
+   PNG_UNUSED(arg)
+   return PNG_PULL_NEED_DATA;
+}
+
+int PNGAPI
+png_pull_data(png_structrp png_ptr, png_const_bytep buffer, size_t buffer_size)
+{
+   if (png_ptr == NULL)
+      return 0;
+
+   if (png_ptr->pull_state == 0)
+   {
+      png_set_read_fn(png_ptr, png_ptr->io_ptr, png_push_fill_buffer);
+      png_ptr->pull_state = PNG_PULL_NEED_DATA;
+   }
+
+   if (png_ptr->buffer_size != 0 &&
+       png_pull_safe(png_ptr, NULL, NULL, png_pull_save) == PNG_PULL_ERROR)
+      return 0;
+
+   if (png_ptr->process_mode == PNG_ERROR_MODE)
+      return 0;
+
+   png_push_restore_buffer(png_ptr, png_constcast(png_bytep, buffer),
+       buffer_size);
+
+   return 1;
+}
+
+static int
+png_pull_next(png_structrp png_ptr, png_inforp info_ptr, png_voidp arg)
+{
+   png_bytepp row = png_voidcast(png_bytepp, arg);
+
+   if (png_ptr->pull_state == PNG_PULL_ROW)
+   {
+      /* Undo the changes made to return the last row. */
+      png_ptr->row_number = png_ptr->pull_saved_row_number;
+      png_ptr->pass = png_ptr->pull_saved_pass;
+   }
+
+   else if (png_ptr->pull_state == PNG_PULL_INFO)
+   {
+      /* As in png_push_read_chunk; the application has had the chance to
+       * call png_read_update_info.
+       */
+      if ((png_ptr->flags & PNG_FLAG_ROW_INIT) == 0)
+         png_read_start_row(png_ptr);
+
+      png_ptr->zstream.avail_out =
+          (uInt) PNG_ROWBYTES(png_ptr->pixel_depth,
+          png_ptr->iwidth) + 1;
+      png_ptr->zstream.next_out = png_ptr->row_buf;
+   }
+
+   png_ptr->pull_state = PNG_PULL_NEED_DATA;
+
+   for (;;)
+   {
+      if (png_ptr->pull_rows != 0)
+      {
+         /* png_struct::row_number and pass are those of the returned row
+          * until the next call so that png_progressive_combine_row and
+          * png_get_current_pass_number work as they do in a row callback.
+          */
+         png_ptr->pull_saved_row_number = png_ptr->row_number;
+         png_ptr->pull_saved_pass = png_ptr->pass;
+         png_ptr->row_number = png_ptr->pull_row_number++;
+         png_ptr->pass = png_ptr->pull_pass;
+         png_ptr->pull_rows--;
+         *row = png_ptr->row_buf + 1;
+         return png_ptr->pull_state = PNG_PULL_ROW;
+      }
+
+      if (png_ptr->process_mode == PNG_READ_DONE_MODE)
+         return PNG_PULL_END;
+
+      if (png_ptr->buffer_size == 0)
+         return PNG_PULL_NEED_DATA;
+
+      png_process_some_data(png_ptr, info_ptr);
+
+      if (png_ptr->pull_state == PNG_PULL_INFO)
+         return PNG_PULL_INFO;
+   }
+}
+
+int PNGAPI
+png_pull_row(png_structrp png_ptr, png_inforp info_ptr, png_bytepp row,
+    png_uint_32p row_number, int *pass)
+{
+   png_bytep new_row = NULL;
+   int result;
+
+   if (png_ptr == NULL || info_ptr == NULL)
+      return PNG_PULL_ERROR;
+
+   /* Nothing has been given to png_pull_data yet. */
+   if (png_ptr->pull_state == 0)
+      return PNG_PULL_NEED_DATA;
+
+   result = png_pull_safe(png_ptr, info_ptr, &new_row, png_pull_next);
+
+   if (result == PNG_PULL_ROW)
+   {
+      if (row_number != NULL)
+         *row_number = png_ptr->row_number;
+
+      if (pass != NULL)
+         *pass = png_ptr->pass;
+   }
+
+   if (row != NULL)
+      *row = new_row;
+
+   return result;
+}
+#endif /* PULL_READ */
 #endif /* PROGRESSIVE_READ */
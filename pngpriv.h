@@ -254,6 +254,39 @@
 #   define PNG_INTEL_SSE_IMPLEMENTATION 0
 #endif
 
+/* Instructions beyond the compile time SSE level (PCLMULQDQ and AVX2) are
+ * used by individual functions compiled for them and selected at run time
+ * after checking CPUID.  This needs a compiler that can target instruction
+ * sets function by function; define PNG_INTEL_CPUID_OPT to 0 to disable it.
+ */
+#ifndef PNG_INTEL_CPUID_OPT
+#  if PNG_INTEL_SSE_IMPLEMENTATION > 0 &&\
+      (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||\
+       defined(_M_IX86)) &&\
+      (defined(_MSC_VER) || defined(__clang__) || (defined(__GNUC__) &&\
+       (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#     define PNG_INTEL_CPUID_OPT 1
+#  else
+#     define PNG_INTEL_CPUID_OPT 0
+#  endif
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0 && !defined(PNG_CRC32_OPTIMIZATIONS)
+#  define PNG_CRC32_OPTIMIZATIONS png_init_crc32_intel
+#endif
+
+#if PNG_INTEL_SSE_IMPLEMENTATION > 0 && !defined(PNG_WRITE_FILTER_OPTIMIZATIONS)
+#  define PNG_WRITE_FILTER_OPTIMIZATIONS png_init_write_filter_functions_sse2
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0 && !defined(PNG_READ_TRANSFORM_OPTIMIZATIONS)
+#  define PNG_READ_TRANSFORM_OPTIMIZATIONS png_init_read_transforms_intel
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0 && !defined(PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS)
+#  define PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS png_init_simplified_write_intel
+#endif
+
 #if PNG_MIPS_MSA_OPT > 0
 #  ifndef PNG_MIPS_MSA_IMPLEMENTATION
 #     if defined(__mips_msa)
@@ -698,10 +731,10 @@
 /* Flags for the png_ptr->flags rather than declaring a byte for each one */
 #define PNG_FLAG_ZLIB_CUSTOM_STRATEGY     0x0001U
 #define PNG_FLAG_ZSTREAM_INITIALIZED      0x0002U /* Added to libpng-1.6.0 */
-                                  /*      0x0004U    unused */
+#define PNG_FLAG_CHUNK_HEADER_PENDING     0x0004U /* Added to libpng-1.6.49 */
 #define PNG_FLAG_ZSTREAM_ENDED            0x0008U /* Added to libpng-1.6.0 */
-                                  /*      0x0010U    unused */
-                                  /*      0x0020U    unused */
+#define PNG_FLAG_IDAT_GATHERED            0x0010U /* Added to libpng-1.6.49 */
+#define PNG_FLAG_IDAT_PARTIAL             0x0020U /* Added to libpng-1.6.49 */
 #define PNG_FLAG_ROW_INIT                 0x0040U
 #define PNG_FLAG_FILLER_AFTER             0x0080U
 #define PNG_FLAG_CRC_ANCILLARY_USE        0x0100U
@@ -719,7 +752,7 @@
 #define PNG_FLAG_BENIGN_ERRORS_WARN     0x100000U /* Added to libpng-1.4.0 */
 #define PNG_FLAG_APP_WARNINGS_WARN      0x200000U /* Added to libpng-1.6.0 */
 #define PNG_FLAG_APP_ERRORS_WARN        0x400000U /* Added to libpng-1.6.0 */
-                                  /*    0x800000U    unused */
+#define PNG_FLAG_FUSED_ROWS             0x800000U /* Added to libpng-1.6.49 */
                                   /*   0x1000000U    unused */
                                   /*   0x2000000U    unused */
                                   /*   0x4000000U    unused */
@@ -1058,6 +1091,14 @@ PNG_INTERNAL_DATA(const png_uint_16, png_sRGB_table, [256]);
 PNG_INTERNAL_DATA(const png_uint_16, png_sRGB_base, [512]);
 PNG_INTERNAL_DATA(const png_byte, png_sRGB_delta, [512]);
 
+#if defined(PNG_SIMPLIFIED_WRITE_SUPPORTED) &&\
+   defined(PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS)
+PNG_INTERNAL_DATA(const png_uint_32, png_sRGB_base_delta, [512]);
+   /* png_sRGB_base | (png_sRGB_delta << 16), so that a vector gather can
+    * fetch both with one index.
+    */
+#endif
+
 #define PNG_sRGB_FROM_LINEAR(linear) \
   ((png_byte)(0xff & ((png_sRGB_base[(linear)>>15] \
    + ((((linear) & 0x7fff)*png_sRGB_delta[(linear)>>15])>>12)) >> 8)))
@@ -1226,6 +1267,10 @@ PNG_INTERNAL_FUNCTION(png_uint_32,png_read_chunk_header,(png_structrp png_ptr),
 PNG_INTERNAL_FUNCTION(void,png_read_data,(png_structrp png_ptr, png_bytep data,
     size_t length),PNG_EMPTY);
 
+/* Return a pointer to the next bytes of the png_set_read_memory buffer */
+PNG_INTERNAL_FUNCTION(png_const_bytep,png_read_data_in_place,
+    (png_structrp png_ptr, size_t length),PNG_EMPTY);
+
 /* Read bytes into buf, and update png_ptr->crc */
 PNG_INTERNAL_FUNCTION(void,png_crc_read,(png_structrp png_ptr, png_bytep buf,
     png_uint_32 length),PNG_EMPTY);
@@ -1434,6 +1479,14 @@ PNG_INTERNAL_FUNCTION(void,png_combine_row,(png_const_structrp png_ptr,
  */
 PNG_INTERNAL_FUNCTION(void,png_do_read_interlace,(png_row_infop row_info,
     png_bytep row, int pass, png_uint_32 transformations),PNG_EMPTY);
+
+/* Store the pixels of a transformed pass row, in the png_struct row buffer,
+ * at their places in the full width 'row', leaving the pixels of the other
+ * passes unchanged.  This is png_do_read_interlace followed by
+ * png_combine_row with 'display' 0, without the replication.
+ */
+PNG_INTERNAL_FUNCTION(void,png_do_read_deinterlace,(png_const_structrp png_ptr,
+    png_row_infop row_info, png_bytep row),PNG_EMPTY);
 #endif
 
 /* GRR TO DO (2.0 or whenever):  simplify other internal calling interfaces */
@@ -1533,6 +1586,33 @@ PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth4_sse2,(png_row_infop
     row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
 #endif
 
+#if PNG_INTEL_CPUID_OPT > 0
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth3_ssse3,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth4_ssse3,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth3_sse41,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth4_sse41,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_sub3_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_sub4_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_sub6_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_sub8_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_avg6_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_avg8_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth6_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void,png_read_filter_row_paeth8_avx2,(png_row_infop
+    row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
+#endif
+
 #if PNG_LOONGARCH_LSX_IMPLEMENTATION == 1
 PNG_INTERNAL_FUNCTION(void,png_read_filter_row_up_lsx,(png_row_infop
     row_info, png_bytep row, png_const_bytep prev_row),PNG_EMPTY);
@@ -1683,6 +1763,10 @@ PNG_INTERNAL_FUNCTION(int,png_chunk_unknown_handling,
 #ifdef PNG_READ_TRANSFORMS_SUPPORTED
 PNG_INTERNAL_FUNCTION(void,png_do_read_transformations,(png_structrp png_ptr,
    png_row_infop row_info),PNG_EMPTY);
+
+/* Resolve the transformations into the list of steps run for each row. */
+PNG_INTERNAL_FUNCTION(void,png_build_read_transformations,
+   (png_structrp png_ptr),PNG_EMPTY);
 #endif
 #ifdef PNG_WRITE_TRANSFORMS_SUPPORTED
 PNG_INTERNAL_FUNCTION(void,png_do_write_transformations,(png_structrp png_ptr,
@@ -1705,8 +1789,11 @@ PNG_INTERNAL_FUNCTION(void,png_push_save_buffer,(png_structrp png_ptr),
 PNG_INTERNAL_FUNCTION(void,png_push_restore_buffer,(png_structrp png_ptr,
     png_bytep buffer, size_t buffer_length),PNG_EMPTY);
 PNG_INTERNAL_FUNCTION(void,png_push_read_IDAT,(png_structrp png_ptr),PNG_EMPTY);
-PNG_INTERNAL_FUNCTION(void,png_process_IDAT_data,(png_structrp png_ptr,
+PNG_INTERNAL_FUNCTION(size_t,png_process_IDAT_data,(png_structrp png_ptr,
     png_bytep buffer, size_t buffer_length),PNG_EMPTY);
+   /* Returns the number of bytes used; less than buffer_length only when the
+    * pull reader stops to return a row.
+    */
 PNG_INTERNAL_FUNCTION(void,png_push_process_row,(png_structrp png_ptr),
     PNG_EMPTY);
 PNG_INTERNAL_FUNCTION(void,png_push_have_info,(png_structrp png_ptr,
@@ -2093,8 +2180,8 @@ typedef struct png_control
    png_infop   info_ptr;
    png_voidp   error_buf;           /* Always a jmp_buf at present. */
 
-   png_const_bytep memory;          /* Memory buffer. */
-   size_t          size;            /* Size of the memory buffer. */
+   png_voidp   mapped_file;         /* The input file mapped into memory */
+   size_t      mapped_size;         /* Size of the mapping */
 
    unsigned int for_write       :1; /* Otherwise it is a read structure */
    unsigned int owned_file      :1; /* We own the file in io_ptr */
@@ -2132,6 +2219,11 @@ PNG_INTERNAL_FUNCTION(int,png_safe_execute,(png_imagep image,
 PNG_INTERNAL_FUNCTION(int,png_image_error,(png_imagep image,
    png_const_charp error_message),PNG_EMPTY);
 
+#if defined(PNG_SIMPLIFIED_READ_SUPPORTED) && defined(PNG_STDIO_SUPPORTED)
+/* Release the file mapping made by png_image_begin_read_from_file */
+PNG_INTERNAL_FUNCTION(void,png_image_unmap_file,(png_controlp cp),PNG_EMPTY);
+#endif
+
 #ifndef PNG_SIMPLIFIED_READ_SUPPORTED
 /* png_image_free is used by the write code but not exported */
 PNG_INTERNAL_FUNCTION(void, png_image_free, (png_imagep image), PNG_EMPTY);
@@ -2184,6 +2276,126 @@ PNG_INTERNAL_FUNCTION(void, png_init_filter_functions_rvv,
    (png_structp png_ptr, unsigned int bpp), PNG_EMPTY);
 #endif
 
+/* The CRC-32 optimization works the same way using PNG_CRC32_OPTIMIZATIONS; the
+ * function sets png_struct::crc32_blocks if the hardware supports it.
+ */
+#ifdef PNG_CRC32_OPTIMIZATIONS
+PNG_INTERNAL_FUNCTION(void, PNG_CRC32_OPTIMIZATIONS, (png_structp png_ptr),
+   PNG_EMPTY);
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0
+PNG_INTERNAL_FUNCTION(png_uint_32, png_crc32_pclmul, (png_uint_32 crc,
+   png_const_bytep buf, size_t length), PNG_EMPTY);
+#endif
+
+/* PNG_WRITE_FILTER_OPTIMIZATIONS sets png_struct::write_filter_sums and
+ * write_filter_row, which png_write_find_filter uses in place of trying each
+ * filter in turn.
+ */
+#ifdef PNG_WRITE_FILTER_SUPPORTED
+#ifdef PNG_WRITE_FILTER_OPTIMIZATIONS
+PNG_INTERNAL_FUNCTION(void, PNG_WRITE_FILTER_OPTIMIZATIONS,
+   (png_structp png_ptr), PNG_EMPTY);
+#endif
+
+#if PNG_INTEL_SSE_IMPLEMENTATION > 0
+PNG_INTERNAL_FUNCTION(void, png_write_filter_sums_sse2, (png_const_bytep row,
+   png_const_bytep prev_row, size_t row_bytes, unsigned int bpp,
+   size_t *sums), PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void, png_write_filter_row_sse2, (png_bytep
+   filtered_row, png_const_bytep row, png_const_bytep prev_row,
+   size_t row_bytes, unsigned int bpp, int filter), PNG_EMPTY);
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0
+PNG_INTERNAL_FUNCTION(void, png_write_filter_sums_avx2, (png_const_bytep row,
+   png_const_bytep prev_row, size_t row_bytes, unsigned int bpp,
+   size_t *sums), PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void, png_write_filter_row_avx2, (png_bytep
+   filtered_row, png_const_bytep row, png_const_bytep prev_row,
+   size_t row_bytes, unsigned int bpp, int filter), PNG_EMPTY);
+#endif
+#endif /* WRITE_FILTER */
+
+/* PNG_READ_TRANSFORM_OPTIMIZATIONS sets png_struct::read_byte_map,
+ * read_palette_map and the other row kernels, which png_do_read_transformations
+ * uses in place of the portable code.
+ */
+#ifdef PNG_READ_TRANSFORMS_SUPPORTED
+#ifdef PNG_READ_TRANSFORM_OPTIMIZATIONS
+PNG_INTERNAL_FUNCTION(void, PNG_READ_TRANSFORM_OPTIMIZATIONS,
+   (png_structp png_ptr), PNG_EMPTY);
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0
+PNG_INTERNAL_FUNCTION(void, png_do_byte_map_ssse3, (png_bytep row,
+   png_uint_32 width, unsigned int in_bytes, unsigned int out_bytes,
+   png_const_bytep src, png_const_bytep value), PNG_EMPTY);
+#ifdef PNG_READ_EXPAND_SUPPORTED
+PNG_INTERNAL_FUNCTION(void, png_do_palette_map_ssse3, (png_bytep row,
+   png_uint_32 width, unsigned int out_bytes, png_const_bytep palette_map),
+   PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void, png_do_palette_map_avx2, (png_bytep row,
+   png_uint_32 width, unsigned int out_bytes, png_const_bytep palette_map),
+   PNG_EMPTY);
+#endif
+#ifdef PNG_READ_GAMMA_SUPPORTED
+PNG_INTERNAL_FUNCTION(void, png_do_gamma_8_avx2, (png_bytep row,
+   size_t rowbytes, unsigned int pixel_bytes, int alpha,
+   png_const_uint_32p table), PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void, png_do_gamma_16_avx2, (png_bytep row,
+   size_t rowbytes, unsigned int pixel_bytes, int alpha,
+   png_const_uint_16p table, int shift), PNG_EMPTY);
+#endif
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED)
+PNG_INTERNAL_FUNCTION(void, png_do_compose_8_avx2, (png_bytep row,
+   size_t rowbytes, unsigned int pixel_bytes, png_const_bytep background,
+   png_const_bytep background_1, png_const_uint_32p tables, int optimize),
+   PNG_EMPTY);
+#endif
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+PNG_INTERNAL_FUNCTION(int, png_do_rgb_to_gray_8_avx2, (png_bytep row,
+   png_uint_32 width, int alpha, png_uint_32 rc, png_uint_32 gc,
+   png_const_uint_32p tables), PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(int, png_do_rgb_to_gray_16_avx2, (png_bytep row,
+   png_uint_32 width, int alpha, png_uint_32 rc, png_uint_32 gc,
+   png_const_uint_16p tables, int shift), PNG_EMPTY);
+#endif
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+PNG_INTERNAL_FUNCTION(void, png_do_scale_16_to_8_ssse3, (png_bytep row,
+   size_t rowbytes), PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(void, png_do_scale_16_to_8_avx2, (png_bytep row,
+   size_t rowbytes), PNG_EMPTY);
+#endif
+#ifdef PNG_READ_INTERLACING_SUPPORTED
+PNG_INTERNAL_FUNCTION(png_uint_32, png_do_read_deinterlace_ssse3,
+   (png_bytep row, png_const_bytep sp, png_uint_32 width,
+   unsigned int pixel_bytes, int pass), PNG_EMPTY);
+PNG_INTERNAL_FUNCTION(int, png_combine_row_sse2, (png_bytep dp,
+   png_const_bytep sp, size_t row_bytes, unsigned int offset,
+   unsigned int copy, unsigned int jump), PNG_EMPTY);
+#endif
+#endif
+#endif /* READ_TRANSFORMS */
+
+/* PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS sets png_struct::write_sRGB_8, which
+ * png_write_image_8bit uses for the 16-bit linear to 8-bit sRGB conversion.
+ */
+#ifdef PNG_SIMPLIFIED_WRITE_SUPPORTED
+#ifdef PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS
+PNG_INTERNAL_FUNCTION(void, PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS,
+   (png_structp png_ptr), PNG_EMPTY);
+#endif
+
+#if PNG_INTEL_CPUID_OPT > 0
+PNG_INTERNAL_FUNCTION(png_uint_32, png_write_sRGB_8_avx2, (png_bytep out,
+   png_const_uint_16p in, png_uint_32 width, unsigned int channels,
+   int alpha), PNG_EMPTY);
+#endif
+#endif /* SIMPLIFIED_WRITE */
+
 PNG_INTERNAL_FUNCTION(png_uint_32, png_check_keyword, (png_structrp png_ptr,
    png_const_charp key, png_bytep new_key), PNG_EMPTY);
 
@@ -2210,6 +2422,67 @@ PNG_INTERNAL_FUNCTION(int,
                       PNG_EMPTY);
 #endif
 
+#ifdef PNG_PARALLEL_SUPPORTED
+/* Run job(job_arg, n) for n in [0,job_count) using the application's parallel
+ * function, if set, else serially.  Returns once all the jobs have finished.
+ */
+PNG_INTERNAL_FUNCTION(void,png_run_parallel,(png_const_structrp png_ptr,
+   png_parallel_job_ptr job, png_voidp job_arg, png_uint_32 job_count),
+   PNG_EMPTY);
+
+/* zlib allocators for use inside parallel jobs; these never issue warnings or
+ * errors, they just return NULL on failure.
+ */
+PNG_INTERNAL_FUNCTION(voidpf,png_parallel_zalloc,(voidpf png_ptr, uInt items,
+   uInt size),PNG_ALLOCATED);
+PNG_INTERNAL_FUNCTION(void,png_parallel_zfree,(voidpf png_ptr, voidpf ptr),
+   PNG_EMPTY);
+
+PNG_INTERNAL_FUNCTION(uLong,png_adler32,(png_const_bytep data,
+   png_alloc_size_t size),PNG_EMPTY);
+#endif /* PARALLEL */
+
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+/* Release the memory used by the band-parallel IDAT writer. */
+PNG_INTERNAL_FUNCTION(void,png_write_free_IDAT_bands,(png_structrp png_ptr),
+   PNG_EMPTY);
+#endif
+
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+/* Release the memory used by the parallel IDAT reader. */
+PNG_INTERNAL_FUNCTION(void,png_read_free_IDAT_data,(png_structrp png_ptr),
+   PNG_EMPTY);
+#endif
+
+#ifdef PNG_DEFLATE_CODEC_SUPPORTED
+/* A deflate codec handles a whole zlib stream in one call.  'init' returns
+ * the state for compression or decompression, or NULL if the codec cannot be
+ * used with these settings; 'reset' is called after each stream and 'end'
+ * frees the state.  'compress' returns the stream in memory allocated with
+ * png_malloc_base, which the caller frees.  'decompress' only succeeds if the
+ * stream is valid, ends exactly at the end of the input and exactly fills the
+ * output.  Both return 0 on failure; none of these call png_error.
+ */
+typedef struct png_deflate_codec_struct
+{
+   png_const_charp name;
+   png_voidp (*init)(png_structrp png_ptr, int compress, int level,
+       int strategy);
+   int (*compress)(png_voidp state, png_const_bytep input,
+       png_alloc_size_t input_size, png_bytepp output,
+       png_alloc_size_t *output_size);
+   int (*decompress)(png_voidp state, png_const_bytep input,
+       png_alloc_size_t input_size, png_bytep output,
+       png_alloc_size_t output_size);
+   void (*reset)(png_voidp state);
+   void (*end)(png_voidp state);
+} png_deflate_codec;
+
+/* Free png_struct::deflate_codec_state. */
+PNG_INTERNAL_FUNCTION(void,png_deflate_codec_end,(png_structrp png_ptr),
+   PNG_EMPTY);
+#endif
+
 /* Maintainer: Put new private prototypes here ^ */
 
 #include "pngdebug.h"
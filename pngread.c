@@ -13,9 +13,33 @@
  * read a PNG file or stream.
  */
 
+/* png_image_begin_read_from_file can map the file into memory on systems with
+ * POSIX.1-2001 mmap and posix_madvise.  The feature test macro has to be set
+ * before pngpriv.h includes any system header.  Define PNG_MMAP_INPUT to 0 to
+ * always use stdio.
+ */
+#ifndef PNG_MMAP_INPUT
+#  if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) ||\
+      defined(__NetBSD__) || defined(__OpenBSD__)
+#     define PNG_MMAP_INPUT 1
+#  else
+#     define PNG_MMAP_INPUT 0
+#  endif
+#endif
+
+#if PNG_MMAP_INPUT > 0 && !defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "pngpriv.h"
 #if defined(PNG_SIMPLIFIED_READ_SUPPORTED) && defined(PNG_STDIO_SUPPORTED)
 #  include <errno.h>
+#  if PNG_MMAP_INPUT > 0
+#     include <fcntl.h>
+#     include <sys/mman.h>
+#     include <sys/stat.h>
+#     include <unistd.h>
+#  endif
 #endif
 
 #ifdef PNG_READ_SUPPORTED
@@ -165,6 +189,124 @@ png_read_info(png_structrp png_ptr, png_inforp info_ptr)
 }
 #endif /* SEQUENTIAL_READ */
 
+#ifdef PNG_READ_PROBE_SUPPORTED
+static int
+png_probe_chunk_listed(png_uint_32 chunk_name, png_const_bytep chunk_list,
+    int num_chunks)
+{
+   png_byte name[5];
+
+   PNG_CSTRING_FROM_CHUNK(name, chunk_name);
+
+   for (; num_chunks > 0; --num_chunks, chunk_list += 5)
+      if (memcmp(chunk_list, name, 4) == 0)
+         return 1;
+
+   return 0;
+}
+
+/* Like png_read_info but stops within max_bytes of the stream and skips the
+ * ancillary chunks the application has not asked for.
+ */
+int PNGAPI
+png_read_probe(png_structrp png_ptr, png_inforp info_ptr,
+    png_alloc_size_t max_bytes, png_const_bytep chunk_list, int num_chunks,
+    png_chunk_locationp locations, int *num_locations)
+{
+   png_alloc_size_t offset = 8; /* the chunks start after the signature */
+   int max_locations = 0, count = 0, found_IDAT = 0;
+
+   png_debug(1, "in png_read_probe");
+
+   if (num_locations != NULL)
+   {
+      if (locations != NULL)
+         max_locations = *num_locations;
+
+      *num_locations = 0;
+   }
+
+   if (png_ptr == NULL || info_ptr == NULL || max_bytes < offset)
+      return 0;
+
+   if (chunk_list == NULL)
+      num_chunks = 0;
+
+   png_read_sig(png_ptr, info_ptr);
+
+   /* Every chunk is 8 bytes of length and type, the data and a 4 byte CRC;
+    * nothing is read unless all of it is within max_bytes, except that the
+    * header is read to find the length.
+    */
+   while (max_bytes - offset >= 8)
+   {
+      png_uint_32 length = png_read_chunk_header(png_ptr);
+      png_uint_32 chunk_name = png_ptr->chunk_name;
+
+      if (count < max_locations)
+      {
+         PNG_CSTRING_FROM_CHUNK(locations[count].name, chunk_name);
+         locations[count].length = length;
+         locations[count].offset = offset;
+         *num_locations = ++count;
+      }
+
+      offset += 8;
+
+      if (chunk_name == png_IDAT)
+      {
+         /* As in png_read_info; the data is left for png_read_row. */
+         if ((png_ptr->mode & PNG_HAVE_IHDR) == 0)
+            png_chunk_error(png_ptr, "Missing IHDR before IDAT");
+
+         else if (png_ptr->color_type == PNG_COLOR_TYPE_PALETTE &&
+             (png_ptr->mode & PNG_HAVE_PLTE) == 0)
+            png_chunk_error(png_ptr, "Missing PLTE before IDAT");
+
+         png_ptr->mode |= PNG_HAVE_IDAT;
+         png_ptr->idat_size = length;
+         found_IDAT = 1;
+         break;
+      }
+
+      if (max_bytes - offset < (png_alloc_size_t)length + 4)
+         break;
+
+      offset += (png_alloc_size_t)length + 4;
+
+      if (PNG_CHUNK_ANCILLARY(chunk_name) != 0 &&
+          png_probe_chunk_listed(chunk_name, chunk_list, num_chunks) == 0)
+         png_crc_finish(png_ptr, length);
+
+      else if (chunk_name == png_IHDR || chunk_name == png_IEND)
+         png_handle_chunk(png_ptr, info_ptr, length);
+
+#ifdef PNG_HANDLE_AS_UNKNOWN_SUPPORTED
+      else
+      {
+         int keep = png_chunk_unknown_handling(png_ptr, chunk_name);
+
+         if (keep != 0)
+         {
+            png_handle_unknown(png_ptr, info_ptr, length, keep);
+
+            if (chunk_name == png_PLTE)
+               png_ptr->mode |= PNG_HAVE_PLTE;
+         }
+
+         else
+            png_handle_chunk(png_ptr, info_ptr, length);
+      }
+#else
+      else
+         png_handle_chunk(png_ptr, info_ptr, length);
+#endif
+   }
+
+   return found_IDAT;
+}
+#endif /* READ_PROBE */
+
 /* Optional call to update the users info_ptr structure */
 void PNGAPI
 png_read_update_info(png_structrp png_ptr, png_inforp info_ptr)
@@ -282,13 +424,75 @@ png_do_read_intrapixel(png_row_infop row_info, png_bytep row)
 }
 #endif /* MNG_FEATURES */
 
-void PNGAPI
-png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
+/* Read the next row into row_buf and unfilter it, then keep a copy in prev_row
+ * for the row after.
+ */
+static void
+png_read_filtered_row(png_structrp png_ptr, png_row_infop row_info)
 {
-   png_row_info row_info;
+   png_ptr->row_buf[0]=255; /* to force error if no data was found */
+   png_read_IDAT_data(png_ptr, png_ptr->row_buf, row_info->rowbytes + 1);
 
-   if (png_ptr == NULL)
-      return;
+   if (png_ptr->row_buf[0] > PNG_FILTER_VALUE_NONE)
+   {
+      if (png_ptr->row_buf[0] < PNG_FILTER_VALUE_LAST)
+         png_read_filter_row(png_ptr, row_info, png_ptr->row_buf + 1,
+             png_ptr->prev_row + 1, png_ptr->row_buf[0]);
+      else
+         png_error(png_ptr, "bad adaptive filter value");
+   }
+
+   /* libpng 1.5.6: the following line was copying png_ptr->rowbytes before
+    * 1.5.6, while the buffer really is this big in current versions of libpng
+    * it may not be in the future, so this was changed just to copy the
+    * interlaced count:
+    */
+   memcpy(png_ptr->prev_row, png_ptr->row_buf, row_info->rowbytes + 1);
+}
+
+#ifdef PNG_READ_REGION_SUPPORTED
+/* Move the columns of the region to the start of the row, before any
+ * transformation, so only they are transformed.  Pixels of less than a byte
+ * are shifted to start at the first bit.
+ */
+static void
+png_read_crop_row(png_const_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   unsigned int pixel_depth = row_info->pixel_depth;
+   size_t rowbytes = PNG_ROWBYTES(pixel_depth, png_ptr->region_width);
+   size_t start = (size_t)png_ptr->region_x * pixel_depth;
+   unsigned int shift = (unsigned int)(start & 7);
+   png_const_bytep sp = row + (start >> 3);
+
+   if (shift == 0)
+      memmove(row, sp, rowbytes);
+
+   else
+   {
+      /* The last byte may take bits from the one after the end of the image
+       * row; they are unused bits at the end of the region row and row_buf
+       * has room for them.
+       */
+      size_t i;
+
+      for (i = 0; i < rowbytes; i++)
+         row[i] = (png_byte)((sp[i] << shift) | (sp[i+1] >> (8 - shift)));
+   }
+
+   row_info->width = png_ptr->region_width;
+   row_info->rowbytes = rowbytes;
+}
+#endif /* READ_REGION */
+
+/* png_read_row without the check for a left over PNG_FLAG_FUSED_ROWS; only
+ * png_read_image and png_read_rows_into, which own the flag, call this
+ * directly.
+ */
+static void
+png_read_one_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
+{
+   png_row_info row_info;
 
    png_debug2(1, "in png_read_row (row %lu, pass %d)",
        (unsigned long)png_ptr->row_number, png_ptr->pass);
@@ -441,25 +645,77 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
    if ((png_ptr->mode & PNG_HAVE_IDAT) == 0)
       png_error(png_ptr, "Invalid attempt to read row data");
 
-   /* Fill the row with IDAT data: */
-   png_ptr->row_buf[0]=255; /* to force error if no data was found */
-   png_read_IDAT_data(png_ptr, png_ptr->row_buf, row_info.rowbytes + 1);
+   /* If the row overlaps the one before, as with repeated row pointers or a
+    * stride less than a row, decompressing into it would overwrite the
+    * previous row; unfilter in prev_row again from here on.
+    */
+   if ((png_ptr->flags & PNG_FLAG_FUSED_ROWS) != 0 &&
+       png_ptr->fused_prev_row != NULL && row != NULL &&
+       row < png_ptr->fused_prev_row + row_info.rowbytes &&
+       png_ptr->fused_prev_row < row + row_info.rowbytes)
+   {
+      memcpy(png_ptr->prev_row + 1, png_ptr->fused_prev_row,
+          row_info.rowbytes);
+      png_ptr->fused_prev_row = NULL;
+      png_ptr->flags &= ~PNG_FLAG_FUSED_ROWS;
+   }
 
-   if (png_ptr->row_buf[0] > PNG_FILTER_VALUE_NONE)
+   if ((png_ptr->flags & PNG_FLAG_FUSED_ROWS) != 0 && row != NULL &&
+       dsp_row == NULL)
    {
-      if (png_ptr->row_buf[0] < PNG_FILTER_VALUE_LAST)
-         png_read_filter_row(png_ptr, &row_info, png_ptr->row_buf + 1,
-             png_ptr->prev_row + 1, png_ptr->row_buf[0]);
-      else
-         png_error(png_ptr, "bad adaptive filter value");
+      /* The row needs no transformation or de-interlacing, so decompress it
+       * straight into the caller's buffer and unfilter it there against the
+       * previous row of the caller's image.  The first row, which has no
+       * previous row in the image, uses prev_row; this is zero at the start
+       * of the image.
+       */
+      png_byte filter = 255; /* to force error if no data was found */
+      png_const_bytep prev = png_ptr->fused_prev_row;
+
+      png_read_IDAT_data(png_ptr, &filter, 1);
+      png_read_IDAT_data(png_ptr, row, row_info.rowbytes);
+
+      if (prev == NULL)
+         prev = png_ptr->prev_row + 1;
+
+      if (filter > PNG_FILTER_VALUE_NONE)
+      {
+         if (filter < PNG_FILTER_VALUE_LAST)
+            png_read_filter_row(png_ptr, &row_info, row, prev, filter);
+         else
+            png_error(png_ptr, "bad adaptive filter value");
+      }
+
+      png_ptr->fused_prev_row = row;
+      png_ptr->transformed_pixel_depth = row_info.pixel_depth;
+      png_read_finish_row(png_ptr);
+
+      if (png_ptr->read_row_fn != NULL)
+         (*(png_ptr->read_row_fn))(png_ptr, png_ptr->row_number,
+             png_ptr->pass);
+
+      return;
    }
 
-   /* libpng 1.5.6: the following line was copying png_ptr->rowbytes before
-    * 1.5.6, while the buffer really is this big in current versions of libpng
-    * it may not be in the future, so this was changed just to copy the
-    * interlaced count:
-    */
-   memcpy(png_ptr->prev_row, png_ptr->row_buf, row_info.rowbytes + 1);
+#ifdef PNG_READ_REGION_SUPPORTED
+   /* Rows above the region are only unfiltered, for the rows after them. */
+   if (png_ptr->region_width != 0)
+   {
+      while (png_ptr->row_number < png_ptr->region_y)
+      {
+         png_read_filtered_row(png_ptr, &row_info);
+         png_read_finish_row(png_ptr);
+      }
+   }
+#endif
+
+   /* Fill the row with IDAT data: */
+   png_read_filtered_row(png_ptr, &row_info);
+
+#ifdef PNG_READ_REGION_SUPPORTED
+   if (png_ptr->region_width != 0)
+      png_read_crop_row(png_ptr, &row_info, png_ptr->row_buf + 1);
+#endif
 
 #ifdef PNG_MNG_FEATURES_SUPPORTED
    if ((png_ptr->mng_features_permitted & PNG_FLAG_MNG_FILTER_64) != 0 &&
@@ -495,15 +751,26 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
    if (png_ptr->interlaced != 0 &&
       (png_ptr->transformations & PNG_INTERLACE) != 0)
    {
-      if (png_ptr->pass < 6)
-         png_do_read_interlace(&row_info, png_ptr->row_buf + 1, png_ptr->pass,
-             png_ptr->transformations);
+      /* Without a display row the pixels of the pass need not be replicated;
+       * they are stored straight into their places in the row.
+       */
+      if (dsp_row == NULL)
+      {
+         if (row != NULL)
+            png_do_read_deinterlace(png_ptr, &row_info, row);
+      }
+
+      else
+      {
+         if (png_ptr->pass < 6)
+            png_do_read_interlace(&row_info, png_ptr->row_buf + 1,
+                png_ptr->pass, png_ptr->transformations);
 
-      if (dsp_row != NULL)
          png_combine_row(png_ptr, dsp_row, 1/*display*/);
 
-      if (row != NULL)
-         png_combine_row(png_ptr, row, 0/*row*/);
+         if (row != NULL)
+            png_combine_row(png_ptr, row, 0/*row*/);
+      }
    }
 
    else
@@ -517,6 +784,20 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
    }
    png_read_finish_row(png_ptr);
 
+#ifdef PNG_READ_REGION_SUPPORTED
+   /* After the last row of the region the rest of the IDAT data is skipped
+    * without being decompressed, as if the zlib stream had ended.
+    */
+   if (png_ptr->region_width != 0 &&
+       png_ptr->row_number == png_ptr->region_y + png_ptr->region_height &&
+       png_ptr->row_number < png_ptr->num_rows)
+   {
+      png_ptr->mode |= PNG_AFTER_IDAT;
+      png_ptr->flags |= PNG_FLAG_ZSTREAM_ENDED;
+      png_read_finish_IDAT(png_ptr);
+   }
+#endif
+
    if (png_ptr->read_row_fn != NULL)
       (*(png_ptr->read_row_fn))(png_ptr, png_ptr->row_number, png_ptr->pass);
 
@@ -524,6 +805,63 @@ png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
 #endif /* SEQUENTIAL_READ */
 
 #ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+/* Start and end reading the whole of an image into rows supplied all at once,
+ * so each row stays intact in the caller's memory while the next is read.  If
+ * the rows need no further processing this allows png_read_row to unfilter
+ * them in place.  This excludes transforms, interlacing, MNG intrapixel
+ * differencing, the check for invalid palette indices (a transform) and
+ * pixels of less than a byte, where png_combine_row preserves the unused bits
+ * at the end of the row.
+ */
+static void
+png_read_fused_start(png_structrp png_ptr)
+{
+   png_ptr->fused_prev_row = NULL;
+
+   if ((png_ptr->flags & PNG_FLAG_ROW_INIT) == 0 || png_ptr->interlaced != 0 ||
+       png_ptr->transformations != 0 || png_ptr->pixel_depth < 8)
+      return;
+
+#ifdef PNG_READ_REGION_SUPPORTED
+   if (png_ptr->region_width != 0)
+      return;
+#endif
+
+#ifdef PNG_READ_CHECK_FOR_INVALID_INDEX_SUPPORTED
+   if (png_ptr->color_type == PNG_COLOR_TYPE_PALETTE &&
+       png_ptr->num_palette_max >= 0)
+      return;
+#endif
+
+#ifdef PNG_MNG_FEATURES_SUPPORTED
+   if ((png_ptr->mng_features_permitted & PNG_FLAG_MNG_FILTER_64) != 0 &&
+       (png_ptr->filter_type == PNG_INTRAPIXEL_DIFFERENCING))
+      return;
+#endif
+
+   png_ptr->flags |= PNG_FLAG_FUSED_ROWS;
+}
+
+static void
+png_read_fused_end(png_structrp png_ptr)
+{
+   png_ptr->flags &= ~PNG_FLAG_FUSED_ROWS;
+   png_ptr->fused_prev_row = NULL;
+}
+
+void PNGAPI
+png_read_row(png_structrp png_ptr, png_bytep row, png_bytep dsp_row)
+{
+   if (png_ptr == NULL)
+      return;
+
+   /* The flag is only set while png_read_image or png_read_rows_into runs; if
+    * one of them was ended by png_error the previous row may have been freed.
+    */
+   png_read_fused_end(png_ptr);
+   png_read_one_row(png_ptr, row, dsp_row);
+}
+
 /* Read one or more rows of image data.  If the image is interlaced,
  * and png_set_interlace_handling() has been called, the rows need to
  * contain the contents of the rows from the previous pass.  If the
@@ -588,6 +926,94 @@ png_read_rows(png_structrp png_ptr, png_bytepp row,
          dp++;
       }
 }
+
+/* Read num_rows rows into memory starting at 'rows', each row_stride bytes
+ * after the one before (the stride may be negative).  This is png_read_rows
+ * without a display row or an array of row pointers.  Because the rows of one
+ * call are all in the caller's memory, rows which need no transformation are
+ * unfiltered in place there; the last one is copied to prev_row at the end
+ * because the next call, or png_read_row, may use a different buffer.
+ */
+void PNGAPI
+png_read_rows_into(png_structrp png_ptr, png_voidp rows,
+    png_ptrdiff_t row_stride, png_uint_32 num_rows)
+{
+   png_bytep row = png_voidcast(png_bytep, rows);
+
+   png_debug(1, "in png_read_rows_into");
+
+   if (png_ptr == NULL || row == NULL)
+      return;
+
+   if ((png_ptr->flags & PNG_FLAG_ROW_INIT) == 0)
+      png_read_start_row(png_ptr);
+
+   /* Rows closer together than a row overlap, so cannot be unfiltered in
+    * place.
+    */
+   if (num_rows < 2 || (row_stride >= 0 ?
+       (size_t)row_stride >= png_ptr->rowbytes :
+       (size_t)-(row_stride + 1) >= png_ptr->rowbytes - 1))
+      png_read_fused_start(png_ptr);
+
+   else
+      png_read_fused_end(png_ptr);
+
+   for (; num_rows > 0; --num_rows)
+   {
+      png_read_one_row(png_ptr, row, NULL);
+      row += row_stride;
+   }
+
+   if (png_ptr->fused_prev_row != NULL)
+      memcpy(png_ptr->prev_row + 1, png_ptr->fused_prev_row,
+          png_ptr->rowbytes);
+
+   png_read_fused_end(png_ptr);
+}
+
+#ifdef PNG_READ_REGION_SUPPORTED
+int PNGAPI
+png_set_read_region(png_structrp png_ptr, png_uint_32 x, png_uint_32 y,
+    png_uint_32 width, png_uint_32 height)
+{
+   png_debug(1, "in png_set_read_region");
+
+   if (png_ptr == NULL)
+      return 0;
+
+   if ((png_ptr->flags & PNG_FLAG_ROW_INIT) != 0)
+      png_app_error(png_ptr,
+          "png_set_read_region: invalid after the rows are started");
+
+   else if ((png_ptr->mode & PNG_HAVE_IHDR) == 0)
+      png_app_error(png_ptr, "png_set_read_region: invalid before IHDR");
+
+   else if (png_ptr->interlaced != PNG_INTERLACE_NONE)
+      png_app_error(png_ptr, "png_set_read_region: image is interlaced");
+
+   else if (width == 0 || height == 0 || width > png_ptr->width ||
+       x > png_ptr->width - width || height > png_ptr->height ||
+       y > png_ptr->height - height)
+      png_app_error(png_ptr, "png_set_read_region: region outside image");
+
+   else
+   {
+      png_ptr->region_x = x;
+      png_ptr->region_y = y;
+      png_ptr->region_width = width;
+      png_ptr->region_height = height;
+
+      /* The whole image is not a region. */
+      if (width == png_ptr->width && height == png_ptr->height)
+         png_ptr->region_width = 0;
+
+      return 1;
+   }
+
+   return 0;
+}
+#endif /* READ_REGION */
 #endif /* SEQUENTIAL_READ */
 
 #ifdef PNG_SEQUENTIAL_READ_SUPPORTED
@@ -652,15 +1078,25 @@ png_read_image(png_structrp png_ptr, png_bytepp image)
 
    image_height=png_ptr->height;
 
+#ifdef PNG_READ_REGION_SUPPORTED
+   if (png_ptr->region_width != 0)
+      image_height = png_ptr->region_height;
+#endif
+
+   if (pass == 1)
+      png_read_fused_start(png_ptr);
+
    for (j = 0; j < pass; j++)
    {
       rp = image;
       for (i = 0; i < image_height; i++)
       {
-         png_read_row(png_ptr, *rp, NULL);
+         png_read_one_row(png_ptr, *rp, NULL);
          rp++;
       }
    }
+
+   png_read_fused_end(png_ptr);
 }
 #endif /* SEQUENTIAL_READ */
 
@@ -681,6 +1117,8 @@ png_read_end(png_structrp png_ptr, png_inforp info_ptr)
    if (png_ptr == NULL)
       return;
 
+   png_read_fused_end(png_ptr);
+
    /* If png_read_end is called in the middle of reading the rows there may
     * still be pending IDAT data and an owned zstream.  Deal with this here.
     */
@@ -766,6 +1204,19 @@ png_read_destroy(png_structrp png_ptr)
    png_free(png_ptr, png_ptr->read_buffer);
    png_ptr->read_buffer = NULL;
 
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+   png_read_free_IDAT_data(png_ptr);
+#endif
+
+#ifdef PNG_DEFLATE_CODEC_SUPPORTED
+   png_deflate_codec_end(png_ptr);
+#endif
+
+#ifdef PNG_READ_TRANSFORMS_SUPPORTED
+   png_free(png_ptr, png_ptr->read_transforms);
+   png_ptr->read_transforms = NULL;
+#endif
+
 #ifdef PNG_READ_QUANTIZE_SUPPORTED
    png_free(png_ptr, png_ptr->palette_lookup);
    png_ptr->palette_lookup = NULL;
@@ -1328,6 +1779,53 @@ png_image_read_header(png_voidp argument)
 }
 
 #ifdef PNG_STDIO_SUPPORTED
+#  if PNG_MMAP_INPUT > 0
+/* Map the whole of a regular file for reading, returning NULL if it cannot
+ * be mapped.  The file is read from start to end, so tell the system to read
+ * ahead.
+ */
+static png_voidp
+png_image_map_file(const char *file_name, size_t *size)
+{
+   png_voidp map = NULL;
+   int fd = open(file_name, O_RDONLY);
+
+   if (fd >= 0)
+   {
+      struct stat st;
+
+      if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+          (off_t)(size_t)st.st_size == st.st_size)
+      {
+         map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+         if (map == MAP_FAILED)
+            map = NULL;
+
+         else
+         {
+            *size = (size_t)st.st_size;
+            (void)posix_madvise(map, *size, POSIX_MADV_SEQUENTIAL);
+         }
+      }
+
+      (void)close(fd);
+   }
+
+   return map;
+}
+#  endif /* MMAP_INPUT */
+
+void /* PRIVATE */
+png_image_unmap_file(png_controlp cp)
+{
+#  if PNG_MMAP_INPUT > 0
+   (void)munmap(cp->mapped_file, cp->mapped_size);
+#  endif
+   cp->mapped_file = NULL;
+   cp->mapped_size = 0;
+}
+
 int PNGAPI
 png_image_begin_read_from_stdio(png_imagep image, FILE *file)
 {
@@ -1365,7 +1863,40 @@ png_image_begin_read_from_file(png_imagep image, const char *file_name)
    {
       if (file_name != NULL)
       {
-         FILE *fp = fopen(file_name, "rb");
+         FILE *fp;
+
+#  if PNG_MMAP_INPUT > 0
+         /* If asked, map a regular file into memory and read it in place;
+          * anything else, or a failure to map the file, falls back to stdio.
+          * This is not the default because a file truncated while it is being
+          * read raises SIGBUS instead of a png_error.
+          */
+         if ((image->flags & PNG_IMAGE_FLAG_MAP_FILE) != 0)
+         {
+            size_t size;
+            png_voidp map = png_image_map_file(file_name, &size);
+
+            if (map != NULL)
+            {
+               if (png_image_read_init(image) != 0)
+               {
+                  png_controlp cp = image->opaque;
+
+                  cp->mapped_file = map;
+                  cp->mapped_size = size;
+                  cp->png_ptr->io_ptr = image;
+                  png_set_read_memory(cp->png_ptr, map, size);
+                  return png_safe_execute(image, png_image_read_header,
+                      image);
+               }
+
+               (void)munmap(map, size);
+               return 0;
+            }
+         }
+#  endif
+
+         fp = fopen(file_name, "rb");
 
          if (fp != NULL)
          {
@@ -1397,36 +1928,6 @@ png_image_begin_read_from_file(png_imagep image, const char *file_name)
 }
 #endif /* STDIO */
 
-static void PNGCBAPI
-png_image_memory_read(png_structp png_ptr, png_bytep out, size_t need)
-{
-   if (png_ptr != NULL)
-   {
-      png_imagep image = png_voidcast(png_imagep, png_ptr->io_ptr);
-      if (image != NULL)
-      {
-         png_controlp cp = image->opaque;
-         if (cp != NULL)
-         {
-            png_const_bytep memory = cp->memory;
-            size_t size = cp->size;
-
-            if (memory != NULL && size >= need)
-            {
-               memcpy(out, memory, need);
-               cp->memory = memory + need;
-               cp->size = size - need;
-               return;
-            }
-
-            png_error(png_ptr, "read beyond end of data");
-         }
-      }
-
-      png_error(png_ptr, "invalid memory read");
-   }
-}
-
 int PNGAPI png_image_begin_read_from_memory(png_imagep image,
     png_const_voidp memory, size_t size)
 {
@@ -1436,14 +1937,12 @@ int PNGAPI png_image_begin_read_from_memory(png_imagep image,
       {
          if (png_image_read_init(image) != 0)
          {
-            /* Now set the IO functions to read from the memory buffer and
-             * store it into io_ptr.  Again do this in-place to avoid calling a
-             * libpng function that requires error handling.
+            /* Now set the IO functions to read from the memory buffer; this
+             * lets the IDAT data be decompressed in place.
+             * png_set_read_memory does not need error handling.
              */
-            image->opaque->memory = png_voidcast(png_const_bytep, memory);
-            image->opaque->size = size;
             image->opaque->png_ptr->io_ptr = image;
-            image->opaque->png_ptr->read_data_fn = png_image_memory_read;
+            png_set_read_memory(image->opaque->png_ptr, memory, size);
 
             return png_safe_execute(image, png_image_read_header, image);
          }
@@ -3106,19 +3605,9 @@ png_image_read_colormapped(png_voidp argument)
 
    else
    {
-      png_alloc_size_t row_bytes = (png_alloc_size_t)display->row_bytes;
-
       while (--passes >= 0)
-      {
-         png_uint_32      y = image->height;
-         png_bytep        row = png_voidcast(png_bytep, display->first_row);
-
-         for (; y > 0; --y)
-         {
-            png_read_row(png_ptr, row, NULL);
-            row += row_bytes;
-         }
-      }
+         png_read_rows_into(png_ptr, display->first_row, display->row_bytes,
+             image->height);
 
       return 1;
    }
@@ -3954,23 +4443,55 @@ png_image_read_direct(png_voidp argument)
 
    else
    {
-      png_alloc_size_t row_bytes = (png_alloc_size_t)display->row_bytes;
-
       while (--passes >= 0)
+         png_read_rows_into(png_ptr, display->first_row, display->row_bytes,
+             image->height);
+
+      return 1;
+   }
+}
+
+#ifdef PNG_READ_REGION_SUPPORTED
+int PNGAPI
+png_image_set_read_region(png_imagep image, png_uint_32 x, png_uint_32 y,
+    png_uint_32 width, png_uint_32 height)
+{
+   if (image != NULL && image->version == PNG_IMAGE_VERSION)
+   {
+      if (image->opaque != NULL)
       {
-         png_uint_32      y = image->height;
-         png_bytep        row = png_voidcast(png_bytep, display->first_row);
+         png_structrp png_ptr = image->opaque->png_ptr;
 
-         for (; y > 0; --y)
-         {
-            png_read_row(png_ptr, row, NULL);
-            row += row_bytes;
-         }
+         /* Checked here so that png_set_read_region does not fail. */
+         if (png_ptr->interlaced != PNG_INTERLACE_NONE)
+            return png_image_error(image,
+                "png_image_set_read_region: image is interlaced");
+
+         if (width == 0 || height == 0 || width > png_ptr->width ||
+             x > png_ptr->width - width || height > png_ptr->height ||
+             y > png_ptr->height - height)
+            return png_image_error(image,
+                "png_image_set_read_region: region outside image");
+
+         (void)png_set_read_region(png_ptr, x, y, width, height);
+
+         image->width = width;
+         image->height = height;
+         return 1;
       }
 
-      return 1;
+      else
+         return png_image_error(image,
+             "png_image_set_read_region: invalid argument");
    }
+
+   else if (image != NULL)
+      return png_image_error(image,
+          "png_image_set_read_region: damaged PNG_IMAGE_VERSION");
+
+   return 0;
 }
+#endif /* READ_REGION */
 
 int PNGAPI
 png_image_finish_read(png_imagep image, png_const_colorp background,
@@ -63,6 +63,35 @@ png_default_read_data(png_structp png_ptr, png_bytep data, size_t length)
 }
 #endif
 
+/* Reading from a buffer set with png_set_read_memory(). */
+static void PNGCBAPI
+png_memory_read_data(png_structp png_ptr, png_bytep data, size_t length)
+{
+   if (png_ptr == NULL)
+      return;
+
+   memcpy(data, png_read_data_in_place(png_ptr, length), length);
+}
+
+/* Return a pointer to the next 'length' bytes of the memory buffer and skip
+ * over them.  The caller must have checked that the buffer is in use.
+ */
+png_const_bytep /* PRIVATE */
+png_read_data_in_place(png_structrp png_ptr, size_t length)
+{
+   png_const_bytep data = png_ptr->read_memory;
+
+   png_debug1(4, "reading %d bytes in place", (int)length);
+
+   if (data == NULL || png_ptr->read_memory_size < length)
+      png_error(png_ptr, "read beyond end of data");
+
+   png_ptr->read_memory = data + length;
+   png_ptr->read_memory_size -= length;
+
+   return data;
+}
+
 /* This function allows the application to supply a new input function
  * for libpng if standard C streams aren't being used.
  *
@@ -90,6 +119,8 @@ png_set_read_fn(png_structrp png_ptr, png_voidp io_ptr,
       return;
 
    png_ptr->io_ptr = io_ptr;
+   png_ptr->read_memory = NULL;
+   png_ptr->read_memory_size = 0;
 
 #ifdef PNG_STDIO_SUPPORTED
    if (read_data_fn != NULL)
@@ -112,6 +143,28 @@ png_set_read_fn(png_structrp png_ptr, png_voidp io_ptr,
    }
 #endif
 
+#ifdef PNG_WRITE_FLUSH_SUPPORTED
+   png_ptr->output_flush_fn = NULL;
+#endif
+}
+
+/* This function makes libpng read the PNG from a buffer holding the whole
+ * file.  The buffer must remain valid, and unchanged, until reading has
+ * finished.  Because all the data is already present the IDAT data is
+ * decompressed directly from the buffer without first being copied; the
+ * io_ptr is left unchanged.  A later call to png_set_read_fn() cancels the
+ * buffer.
+ */
+void PNGAPI
+png_set_read_memory(png_structrp png_ptr, png_const_voidp memory, size_t size)
+{
+   if (png_ptr == NULL)
+      return;
+
+   png_ptr->read_memory = png_voidcast(png_const_bytep, memory);
+   png_ptr->read_memory_size = memory != NULL ? size : 0;
+   png_ptr->read_data_fn = png_memory_read_data;
+
 #ifdef PNG_WRITE_FLUSH_SUPPORTED
    png_ptr->output_flush_fn = NULL;
 #endif
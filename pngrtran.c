@@ -467,6 +467,119 @@ png_set_alpha_mode(png_structrp png_ptr, int mode, double output_gamma)
 #endif
 
 #ifdef PNG_READ_QUANTIZE_SUPPORTED
+/* The full_quantize lookup table maps each RGB cube cell to the nearest
+ * palette entry, the first one if several are as near.  The red planes of
+ * the cube are independent, so each is a job for png_run_parallel.  Within a
+ * plane no entry can be nearer to a cell in a row than dm + dt (below), so
+ * rows where every cell already has a nearer entry are skipped.
+ */
+#define PNG_QUANTIZE_PLANE_BITS \
+   (PNG_QUANTIZE_GREEN_BITS + PNG_QUANTIZE_BLUE_BITS)
+
+typedef struct
+{
+   png_const_colorp palette;
+   int              num_palette;
+   png_bytep        palette_lookup;
+} png_quantize_lookup;
+
+static void PNGCBAPI
+png_quantize_plane(png_voidp job_arg, png_uint_32 job_number)
+{
+   const png_quantize_lookup *lookup =
+       png_voidcast(const png_quantize_lookup *, job_arg);
+   png_bytep plane = lookup->palette_lookup +
+       ((size_t)job_number << PNG_QUANTIZE_PLANE_BITS);
+   png_byte distance[1 << PNG_QUANTIZE_PLANE_BITS];
+   png_byte row_max[1 << PNG_QUANTIZE_GREEN_BITS];
+   int ir = (int)job_number;
+   int num_green = (1 << PNG_QUANTIZE_GREEN_BITS);
+   int num_blue = (1 << PNG_QUANTIZE_BLUE_BITS);
+   int i;
+
+   memset(plane, 0, sizeof distance);
+   memset(distance, 0xff, sizeof distance);
+   memset(row_max, 0xff, sizeof row_max);
+
+   for (i = 0; i < lookup->num_palette; i++)
+   {
+      int ig;
+      int r = (lookup->palette[i].red >> (8 - PNG_QUANTIZE_RED_BITS));
+      int g = (lookup->palette[i].green >> (8 - PNG_QUANTIZE_GREEN_BITS));
+      int b = (lookup->palette[i].blue >> (8 - PNG_QUANTIZE_BLUE_BITS));
+      /* int dr = abs(ir - r); */
+      int dr = ((ir > r) ? ir - r : r - ir);
+
+      for (ig = 0; ig < num_green; ig++)
+      {
+         /* int dg = abs(ig - g); */
+         int dg = ((ig > g) ? ig - g : g - ig);
+         int dt = dr + dg;
+         int dm = ((dr > dg) ? dr : dg);
+         png_bytep d_row = distance + (ig << PNG_QUANTIZE_BLUE_BITS);
+         png_bytep l_row = plane + (ig << PNG_QUANTIZE_BLUE_BITS);
+         int ib, max;
+
+         if (dm + dt >= (int)row_max[ig])
+            continue;
+
+         /* Written without branches so that the compiler can vectorize it */
+         for (ib = 0, max = 0; ib < num_blue; ib++)
+         {
+            /* int db = abs(ib - b); */
+            int db = ((ib > b) ? ib - b : b - ib);
+            int dmax = ((dm > db) ? dm : db);
+            int d = dmax + dt + db;
+            int old = d_row[ib];
+            int nearer = -(d < old); /* all ones or zero */
+
+            l_row[ib] = (png_byte)((i & nearer) | (l_row[ib] & ~nearer));
+            d = (d < old) ? d : old;
+            d_row[ib] = (png_byte)d;
+            max = (max > d) ? max : d;
+         }
+
+         row_max[ig] = (png_byte)max;
+      }
+   }
+}
+
+/* Point the quantize_index entries for colors at or after maximum_colors in
+ * the palette to the closest of the colors before it.
+ */
+static void
+png_quantize_unused(png_structrp png_ptr, png_const_colorp palette,
+    int num_palette, int maximum_colors)
+{
+   int i;
+
+   for (i = 0; i < num_palette; i++)
+   {
+      if ((int)png_ptr->quantize_index[i] >= maximum_colors)
+      {
+         int min_d, k, min_k, d_index;
+
+         /* Find the closest color to one we threw out */
+         d_index = png_ptr->quantize_index[i];
+         min_d = PNG_COLOR_DIST(palette[d_index], palette[0]);
+         for (k = 1, min_k = 0; k < maximum_colors; k++)
+         {
+            int d;
+
+            d = PNG_COLOR_DIST(palette[d_index], palette[k]);
+
+            if (d < min_d)
+            {
+               min_d = d;
+               min_k = k;
+            }
+         }
+         /* Point to closest color */
+         png_ptr->quantize_index[i] = (png_byte)min_k;
+      }
+   }
+}
+
 /* Dither file to 8-bit.  Supply a palette, the current number
  * of elements in the palette, the maximum number of elements
  * allowed, and a histogram if possible.  If the current number
@@ -604,31 +717,7 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
             }
 
             /* Find closest color for those colors we are not using */
-            for (i = 0; i < num_palette; i++)
-            {
-               if ((int)png_ptr->quantize_index[i] >= maximum_colors)
-               {
-                  int min_d, k, min_k, d_index;
-
-                  /* Find the closest color to one we threw out */
-                  d_index = png_ptr->quantize_index[i];
-                  min_d = PNG_COLOR_DIST(palette[d_index], palette[0]);
-                  for (k = 1, min_k = 0; k < maximum_colors; k++)
-                  {
-                     int d;
-
-                     d = PNG_COLOR_DIST(palette[d_index], palette[k]);
-
-                     if (d < min_d)
-                     {
-                        min_d = d;
-                        min_k = k;
-                     }
-                  }
-                  /* Point to closest color */
-                  png_ptr->quantize_index[i] = (png_byte)min_k;
-               }
-            }
+            png_quantize_unused(png_ptr, palette, num_palette, maximum_colors);
          }
          png_free(png_ptr, png_ptr->quantize_sort);
          png_ptr->quantize_sort = NULL;
@@ -646,8 +735,9 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
          int i;
          int max_d;
          int num_new_palette;
-         png_dsortp t;
+         png_dsortp t, pool;
          png_dsortpp hash;
+         size_t pool_used;
 
          t = NULL;
 
@@ -667,6 +757,15 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
          hash = (png_dsortpp)png_calloc(png_ptr, (png_alloc_size_t)(769 *
              (sizeof (png_dsortp))));
 
+         /* Room for every pair of colors, so the pairs within max_d need not
+          * be allocated one at a time.  If this fails each pair is allocated
+          * on its own, as before.
+          */
+         pool = (png_dsortp)png_malloc_warn(png_ptr,
+             (png_alloc_size_t)num_palette * (num_palette - 1) / 2 *
+             (sizeof (png_dsort)));
+         pool_used = 0;
+
          num_new_palette = num_palette;
 
          /* Initial wild guess at how far apart the farthest pixel
@@ -681,6 +780,8 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
 
          while (num_new_palette > maximum_colors)
          {
+            int start_palette = num_new_palette;
+
             for (i = 0; i < num_new_palette - 1; i++)
             {
                int j;
@@ -693,12 +794,17 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
 
                   if (d <= max_d)
                   {
+                     if (pool != NULL)
+                        t = pool + pool_used++;
 
-                     t = (png_dsortp)png_malloc_warn(png_ptr,
-                         (png_alloc_size_t)(sizeof (png_dsort)));
+                     else
+                     {
+                        t = (png_dsortp)png_malloc_warn(png_ptr,
+                            (png_alloc_size_t)(sizeof (png_dsort)));
 
-                     if (t == NULL)
-                         break;
+                        if (t == NULL)
+                           break;
+                     }
 
                      t->next = hash[d];
                      t->left = (png_byte)i;
@@ -710,8 +816,9 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
                   break;
             }
 
+            /* PNG_COLOR_DIST is at most 765, the last hash entry */
             if (t != NULL)
-            for (i = 0; i <= max_d; i++)
+            for (i = 0; i <= max_d && i < 769; i++)
             {
                if (hash[i] != NULL)
                {
@@ -778,6 +885,14 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
                }
             }
 
+            if (pool != NULL)
+            {
+               memset(hash, 0, 769 * (sizeof (png_dsortp)));
+               pool_used = 0;
+               t = NULL;
+            }
+
+            else
             for (i = 0; i < 769; i++)
             {
                if (hash[i] != NULL)
@@ -792,8 +907,21 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
                }
                hash[i] = 0;
             }
+
+            /* Once every pair is in the hash table a pass which removes no
+             * color will never remove one; the colors which are left over
+             * are mapped to the nearest kept color below.
+             */
+            if (max_d >= 765 && num_new_palette == start_palette)
+               break;
+
             max_d += 96;
          }
+
+         if (num_new_palette > maximum_colors && full_quantize == 0)
+            png_quantize_unused(png_ptr, palette, num_palette, maximum_colors);
+
+         png_free(png_ptr, pool);
          png_free(png_ptr, hash);
          png_free(png_ptr, png_ptr->palette_to_index);
          png_free(png_ptr, png_ptr->index_to_palette);
@@ -810,63 +938,26 @@ png_set_quantize(png_structrp png_ptr, png_colorp palette,
 
    if (full_quantize != 0)
    {
-      int i;
-      png_bytep distance;
-      int total_bits = PNG_QUANTIZE_RED_BITS + PNG_QUANTIZE_GREEN_BITS +
-          PNG_QUANTIZE_BLUE_BITS;
-      int num_red = (1 << PNG_QUANTIZE_RED_BITS);
-      int num_green = (1 << PNG_QUANTIZE_GREEN_BITS);
-      int num_blue = (1 << PNG_QUANTIZE_BLUE_BITS);
-      size_t num_entries = ((size_t)1 << total_bits);
+      png_quantize_lookup lookup;
+      png_uint_32 num_red = 1U << PNG_QUANTIZE_RED_BITS;
 
-      png_ptr->palette_lookup = (png_bytep)png_calloc(png_ptr,
-          (png_alloc_size_t)(num_entries));
+      png_ptr->palette_lookup = (png_bytep)png_malloc(png_ptr,
+          (png_alloc_size_t)num_red << PNG_QUANTIZE_PLANE_BITS);
 
-      distance = (png_bytep)png_malloc(png_ptr, (png_alloc_size_t)num_entries);
+      lookup.palette = palette;
+      lookup.num_palette = num_palette;
+      lookup.palette_lookup = png_ptr->palette_lookup;
 
-      memset(distance, 0xff, num_entries);
-
-      for (i = 0; i < num_palette; i++)
+#ifdef PNG_PARALLEL_SUPPORTED
+      png_run_parallel(png_ptr, png_quantize_plane, &lookup, num_red);
+#else
       {
-         int ir, ig, ib;
-         int r = (palette[i].red >> (8 - PNG_QUANTIZE_RED_BITS));
-         int g = (palette[i].green >> (8 - PNG_QUANTIZE_GREEN_BITS));
-         int b = (palette[i].blue >> (8 - PNG_QUANTIZE_BLUE_BITS));
+         png_uint_32 ir;
 
          for (ir = 0; ir < num_red; ir++)
-         {
-            /* int dr = abs(ir - r); */
-            int dr = ((ir > r) ? ir - r : r - ir);
-            int index_r = (ir << (PNG_QUANTIZE_BLUE_BITS +
-                PNG_QUANTIZE_GREEN_BITS));
-
-            for (ig = 0; ig < num_green; ig++)
-            {
-               /* int dg = abs(ig - g); */
-               int dg = ((ig > g) ? ig - g : g - ig);
-               int dt = dr + dg;
-               int dm = ((dr > dg) ? dr : dg);
-               int index_g = index_r | (ig << PNG_QUANTIZE_BLUE_BITS);
-
-               for (ib = 0; ib < num_blue; ib++)
-               {
-                  int d_index = index_g | ib;
-                  /* int db = abs(ib - b); */
-                  int db = ((ib > b) ? ib - b : b - ib);
-                  int dmax = ((dm > db) ? dm : db);
-                  int d = dmax + dt + db;
-
-                  if (d < (int)distance[d_index])
-                  {
-                     distance[d_index] = (png_byte)d;
-                     png_ptr->palette_lookup[d_index] = (png_byte)i;
-                  }
-               }
-            }
-         }
+            png_quantize_plane(&lookup, ir);
       }
-
-      png_free(png_ptr, distance);
+#endif
    }
 }
 #endif /* READ_QUANTIZE */
@@ -2205,6 +2296,14 @@ defined(PNG_READ_USER_TRANSFORM_SUPPORTED)
    info_ptr->pixel_depth = (png_byte)(info_ptr->channels *
        info_ptr->bit_depth);
 
+#ifdef PNG_READ_REGION_SUPPORTED
+   if (png_ptr->region_width != 0)
+   {
+      info_ptr->width = png_ptr->region_width;
+      info_ptr->height = png_ptr->region_height;
+   }
+#endif
+
    info_ptr->rowbytes = PNG_ROWBYTES(info_ptr->pixel_depth, info_ptr->width);
 
    /* Adding in 1.5.4: cache the above value in png_struct so that we can later
@@ -4282,107 +4381,120 @@ png_do_encode_alpha(png_row_infop row_info, png_bytep row, png_structrp png_ptr)
 #endif
 
 #ifdef PNG_READ_EXPAND_SUPPORTED
-/* Expands a palette row to an RGB or RGBA row depending
- * upon whether you supply trans and num_trans.
+/* Unpacks the indices of a palette row of less than 8 bits per pixel into one
+ * byte per pixel.
  */
 static void
-png_do_expand_palette(png_structrp png_ptr, png_row_infop row_info,
-    png_bytep row, png_const_colorp palette, png_const_bytep trans_alpha,
-    int num_trans)
+png_do_expand_palette_index(png_row_infop row_info, png_bytep row)
 {
    int shift, value;
    png_bytep sp, dp;
    png_uint_32 i;
    png_uint_32 row_width=row_info->width;
 
-   png_debug(1, "in png_do_expand_palette");
-
-   if (row_info->color_type == PNG_COLOR_TYPE_PALETTE)
+   if (row_info->bit_depth < 8)
    {
-      if (row_info->bit_depth < 8)
+      switch (row_info->bit_depth)
       {
-         switch (row_info->bit_depth)
+         case 1:
          {
-            case 1:
+            sp = row + (size_t)((row_width - 1) >> 3);
+            dp = row + (size_t)row_width - 1;
+            shift = 7 - (int)((row_width + 7) & 0x07);
+            for (i = 0; i < row_width; i++)
             {
-               sp = row + (size_t)((row_width - 1) >> 3);
-               dp = row + (size_t)row_width - 1;
-               shift = 7 - (int)((row_width + 7) & 0x07);
-               for (i = 0; i < row_width; i++)
-               {
-                  if ((*sp >> shift) & 0x01)
-                     *dp = 1;
+               if ((*sp >> shift) & 0x01)
+                  *dp = 1;
 
-                  else
-                     *dp = 0;
+               else
+                  *dp = 0;
 
-                  if (shift == 7)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
+               if (shift == 7)
+               {
+                  shift = 0;
+                  sp--;
+               }
 
-                  else
-                     shift++;
+               else
+                  shift++;
 
-                  dp--;
-               }
-               break;
+               dp--;
             }
+            break;
+         }
 
-            case 2:
+         case 2:
+         {
+            sp = row + (size_t)((row_width - 1) >> 2);
+            dp = row + (size_t)row_width - 1;
+            shift = (int)((3 - ((row_width + 3) & 0x03)) << 1);
+            for (i = 0; i < row_width; i++)
             {
-               sp = row + (size_t)((row_width - 1) >> 2);
-               dp = row + (size_t)row_width - 1;
-               shift = (int)((3 - ((row_width + 3) & 0x03)) << 1);
-               for (i = 0; i < row_width; i++)
+               value = (*sp >> shift) & 0x03;
+               *dp = (png_byte)value;
+               if (shift == 6)
                {
-                  value = (*sp >> shift) & 0x03;
-                  *dp = (png_byte)value;
-                  if (shift == 6)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
+                  shift = 0;
+                  sp--;
+               }
 
-                  else
-                     shift += 2;
+               else
+                  shift += 2;
 
-                  dp--;
-               }
-               break;
+               dp--;
             }
+            break;
+         }
 
-            case 4:
+         case 4:
+         {
+            sp = row + (size_t)((row_width - 1) >> 1);
+            dp = row + (size_t)row_width - 1;
+            shift = (int)((row_width & 0x01) << 2);
+            for (i = 0; i < row_width; i++)
             {
-               sp = row + (size_t)((row_width - 1) >> 1);
-               dp = row + (size_t)row_width - 1;
-               shift = (int)((row_width & 0x01) << 2);
-               for (i = 0; i < row_width; i++)
+               value = (*sp >> shift) & 0x0f;
+               *dp = (png_byte)value;
+               if (shift == 4)
                {
-                  value = (*sp >> shift) & 0x0f;
-                  *dp = (png_byte)value;
-                  if (shift == 4)
-                  {
-                     shift = 0;
-                     sp--;
-                  }
+                  shift = 0;
+                  sp--;
+               }
 
-                  else
-                     shift += 4;
+               else
+                  shift += 4;
 
-                  dp--;
-               }
-               break;
+               dp--;
             }
-
-            default:
-               break;
+            break;
          }
-         row_info->bit_depth = 8;
-         row_info->pixel_depth = 8;
-         row_info->rowbytes = row_width;
+
+         default:
+            break;
       }
+      row_info->bit_depth = 8;
+      row_info->pixel_depth = 8;
+      row_info->rowbytes = row_width;
+   }
+}
+
+/* Expands a palette row to an RGB or RGBA row depending
+ * upon whether you supply trans and num_trans.
+ */
+static void
+png_do_expand_palette(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row, png_const_colorp palette, png_const_bytep trans_alpha,
+    int num_trans)
+{
+   png_bytep sp, dp;
+   png_uint_32 i;
+   png_uint_32 row_width=row_info->width;
+
+   png_debug(1, "in png_do_expand_palette");
+
+   if (row_info->color_type == PNG_COLOR_TYPE_PALETTE)
+   {
+      png_do_expand_palette_index(row_info, row);
 
       if (row_info->bit_depth == 8)
       {
@@ -4812,101 +4924,1069 @@ png_do_quantize(png_row_infop row_info, png_bytep row,
 }
 #endif /* READ_QUANTIZE */
 
-/* Transform the row.  The order of transformations is significant,
- * and is very touchy.  If you add a transformation, take care to
- * decide how it fits in with the other transformations here.
+/* The row transformations.  png_build_read_transformations resolves the
+ * transformations that apply to this image into a list of steps when the
+ * read starts, so the tests on png_struct::transformations and the rest are
+ * made once, not for every row.  Runs of steps which only move, copy or drop
+ * bytes (or insert a filler byte) are fused into a single pass over the row
+ * with a per-pixel byte map.
  */
-void /* PRIVATE */
-png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
+typedef void (*png_read_transform_fn)(png_structrp png_ptr,
+    png_row_infop row_info, png_bytep row);
+
+#define PNG_READ_TRANSFORMS_MAX 24 /* steps in png_do_read_transformations */
+#define PNG_BYTE_MAP_STEPS_MAX  10 /* byte map steps */
+
+typedef struct
 {
-   png_debug(1, "in png_do_read_transformations");
+   png_read_transform_fn fn;    /* the step, NULL for a byte map */
+   unsigned int          steps; /* steps fused in the byte map */
+   png_read_transform_fn step[PNG_BYTE_MAP_STEPS_MAX];
 
-   if (png_ptr->row_buf == NULL)
-   {
-      /* Prior to 1.5.4 this output row/pass where the NULL pointer is, but this
-       * error is incredibly rare and incredibly easy to debug without this
-       * information.
-       */
-      png_error(png_ptr, "NULL row buffer");
-   }
+   /* If 'palette' is set the first step is the palette expansion and the map
+    * is png_read_transforms::palette_map; the other fields are for the byte
+    * map of the other steps.
+    */
+   png_byte    palette;
 
-   /* The following is debugging; prior to 1.5.4 the code was never compiled in;
-    * in 1.5.4 PNG_FLAG_DETECT_UNINITIALIZED was added and the macro
-    * PNG_WARN_UNINITIALIZED_ROW removed.  In 1.6 the new flag is set only for
-    * all transformations, however in practice the ROW_INIT always gets done on
-    * demand, if necessary.
+   /* The map is made for the format of the first row and remade if the format
+    * changes.  'usable' is 0 if the steps are not a byte map for this format,
+    * in which case they are run one after the other.
     */
-   if ((png_ptr->flags & PNG_FLAG_DETECT_UNINITIALIZED) != 0 &&
-       (png_ptr->flags & PNG_FLAG_ROW_INIT) == 0)
-   {
-      /* Application has failed to call either png_read_start_image() or
-       * png_read_update_info() after setting transforms that expand pixels.
-       * This check added to libpng-1.2.19 (but not enabled until 1.5.4).
-       */
-      png_error(png_ptr, "Uninitialized row");
-   }
+   png_byte    made;
+   png_byte    usable;
+   png_byte    in_color_type, in_bit_depth, in_channels;
+   png_byte    out_color_type, out_bit_depth, out_channels;
+   png_byte    in_bytes, out_bytes; /* bytes per pixel */
+   png_byte    src[8];   /* output byte i is byte src[i] of the input pixel,
+                          * or value[src[i]-8] if src[i] is 8 or more */
+   png_byte    value[8];
+} png_read_transform;
+
+typedef struct
+{
+   unsigned int       count;
+   png_read_transform step[PNG_READ_TRANSFORMS_MAX];
+
+   /* The output pixel of each palette index after the palette expansion and
+    * the byte map steps after it, in 4 byte entries; pixels of less than 4
+    * bytes are at the end of the entry.
+    */
+   png_byte           palette_map[256 * 4];
+} png_read_transforms;
+
+typedef png_read_transforms *png_read_transformsp;
 
 #ifdef PNG_READ_EXPAND_SUPPORTED
-   if ((png_ptr->transformations & PNG_EXPAND) != 0)
-   {
-      if (row_info->color_type == PNG_COLOR_TYPE_PALETTE)
-      {
+static void
+png_read_step_expand_palette(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
 #ifdef PNG_ARM_NEON_INTRINSICS_AVAILABLE
-         if ((png_ptr->num_trans > 0) && (png_ptr->bit_depth == 8))
-         {
-            if (png_ptr->riffled_palette == NULL)
-            {
-               /* Initialize the accelerated palette expansion. */
-               png_ptr->riffled_palette =
-                   (png_bytep)png_malloc(png_ptr, 256 * 4);
-               png_riffle_palette_neon(png_ptr);
-            }
-         }
-#endif
-         png_do_expand_palette(png_ptr, row_info, png_ptr->row_buf + 1,
-             png_ptr->palette, png_ptr->trans_alpha, png_ptr->num_trans);
-      }
-
-      else
+   if ((png_ptr->num_trans > 0) && (png_ptr->bit_depth == 8))
+   {
+      if (png_ptr->riffled_palette == NULL)
       {
-         if (png_ptr->num_trans != 0 &&
-             (png_ptr->transformations & PNG_EXPAND_tRNS) != 0)
-            png_do_expand(row_info, png_ptr->row_buf + 1,
-                &(png_ptr->trans_color));
-
-         else
-            png_do_expand(row_info, png_ptr->row_buf + 1, NULL);
+         /* Initialize the accelerated palette expansion. */
+         png_ptr->riffled_palette =
+             (png_bytep)png_malloc(png_ptr, 256 * 4);
+         png_riffle_palette_neon(png_ptr);
       }
    }
+#endif
+   png_do_expand_palette(png_ptr, row_info, row, png_ptr->palette,
+       png_ptr->trans_alpha, png_ptr->num_trans);
+}
+
+static void
+png_read_step_expand_tRNS(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_expand(row_info, row, &(png_ptr->trans_color));
+}
+
+static void
+png_read_step_expand(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_expand(row_info, row, NULL);
+   PNG_UNUSED(png_ptr)
+}
 #endif
 
 #ifdef PNG_READ_STRIP_ALPHA_SUPPORTED
-   if ((png_ptr->transformations & PNG_STRIP_ALPHA) != 0 &&
-       (png_ptr->transformations & PNG_COMPOSE) == 0 &&
-       (row_info->color_type == PNG_COLOR_TYPE_RGB_ALPHA ||
-       row_info->color_type == PNG_COLOR_TYPE_GRAY_ALPHA))
-      png_do_strip_channel(row_info, png_ptr->row_buf + 1,
+static void
+png_read_step_strip_alpha(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   if (row_info->color_type == PNG_COLOR_TYPE_RGB_ALPHA ||
+       row_info->color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+      png_do_strip_channel(row_info, row,
           0 /* at_start == false, because SWAP_ALPHA happens later */);
+   PNG_UNUSED(png_ptr)
+}
 #endif
 
 #ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
-   if ((png_ptr->transformations & PNG_RGB_TO_GRAY) != 0)
+/* Convert the row with read_rgb_to_gray_8 or read_rgb_to_gray_16, if set and
+ * the gamma tables they need are in gamma_table_wide.  Returns -1 if the row
+ * was not converted, otherwise the result of png_do_rgb_to_gray.
+ */
+static int
+png_do_rgb_to_gray_kernel(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_uint_32 rc = png_ptr->rgb_to_gray_red_coeff;
+   png_uint_32 gc = png_ptr->rgb_to_gray_green_coeff;
+   int alpha = (row_info->color_type & PNG_COLOR_MASK_ALPHA) != 0;
+   png_const_voidp tables = NULL;
+   int shift = 0;
+   int rgb_error;
+
+   if ((row_info->color_type & PNG_COLOR_MASK_PALETTE) != 0 ||
+       (row_info->color_type & PNG_COLOR_MASK_COLOR) == 0)
+      return -1;
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+   /* As for the gamma step gamma_table_wide is for the bit depth of the
+    * image, which is the bit depth of the row here.
+    */
+   if (row_info->bit_depth == 8 ?
+       png_ptr->gamma_from_1 != NULL && png_ptr->gamma_to_1 != NULL :
+       png_ptr->gamma_16_to_1 != NULL && png_ptr->gamma_16_from_1 != NULL)
+   {
+      tables = png_ptr->gamma_table_wide;
+      shift = png_ptr->gamma_shift;
+
+      if (tables == NULL)
+         return -1;
+   }
+#endif
+
+   if (row_info->bit_depth == 8 && png_ptr->read_rgb_to_gray_8 != NULL)
+      rgb_error = png_ptr->read_rgb_to_gray_8(row, row_info->width, alpha,
+          rc, gc, png_voidcast(png_const_uint_32p, tables));
+
+   else if (row_info->bit_depth == 16 && png_ptr->read_rgb_to_gray_16 != NULL)
+      rgb_error = png_ptr->read_rgb_to_gray_16(row, row_info->width, alpha,
+          rc, gc, png_voidcast(png_const_uint_16p, tables), shift);
+
+   else
+      return -1;
+
+   row_info->channels = (png_byte)(row_info->channels - 2);
+   row_info->color_type = (png_byte)(row_info->color_type &
+       ~PNG_COLOR_MASK_COLOR);
+   row_info->pixel_depth = (png_byte)(row_info->channels *
+       row_info->bit_depth);
+   row_info->rowbytes = PNG_ROWBYTES(row_info->pixel_depth, row_info->width);
+
+   return rgb_error;
+}
+
+static void
+png_read_step_rgb_to_gray(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   int rgb_error = png_do_rgb_to_gray_kernel(png_ptr, row_info, row);
+
+   if (rgb_error < 0)
+      rgb_error = png_do_rgb_to_gray(png_ptr, row_info, row);
+
+   if (rgb_error != 0)
+   {
+      png_ptr->rgb_to_gray_status=1;
+      if ((png_ptr->transformations & PNG_RGB_TO_GRAY) ==
+          PNG_RGB_TO_GRAY_WARN)
+         png_warning(png_ptr, "png_do_rgb_to_gray found nongray pixel");
+
+      if ((png_ptr->transformations & PNG_RGB_TO_GRAY) ==
+          PNG_RGB_TO_GRAY_ERR)
+         png_error(png_ptr, "png_do_rgb_to_gray found nongray pixel");
+   }
+}
+#endif
+
+#ifdef PNG_READ_GRAY_TO_RGB_SUPPORTED
+static void
+png_read_step_gray_to_rgb(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_gray_to_rgb(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+static void
+png_read_step_gamma(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   /* gamma_table_wide is made for the bit depth of the image, which is the
+    * bit depth of the row here.
+    */
+   if (png_ptr->gamma_table_wide != NULL &&
+       row_info->color_type != PNG_COLOR_TYPE_PALETTE)
+   {
+      unsigned int pixel_bytes = row_info->pixel_depth >> 3;
+      int alpha = (row_info->color_type & PNG_COLOR_MASK_ALPHA) != 0;
+
+      if (row_info->bit_depth == 8 && png_ptr->read_gamma_8 != NULL)
+      {
+         png_ptr->read_gamma_8(row, row_info->rowbytes, pixel_bytes, alpha,
+             png_voidcast(png_const_uint_32p, png_ptr->gamma_table_wide));
+         return;
+      }
+
+      if (row_info->bit_depth == 16 && png_ptr->read_gamma_16 != NULL)
+      {
+         png_ptr->read_gamma_16(row, row_info->rowbytes, pixel_bytes, alpha,
+             png_voidcast(png_const_uint_16p, png_ptr->gamma_table_wide),
+             png_ptr->gamma_shift);
+         return;
+      }
+   }
+
+   png_do_gamma(row_info, row, png_ptr);
+}
+#endif
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED)
+/* Return 1 if every pixel of an 8 or 16-bit row with alpha is opaque. */
+static int
+png_row_is_opaque(png_row_infop row_info, png_const_bytep row)
+{
+   const size_t pixel_bytes = row_info->pixel_depth >> 3;
+   const size_t alpha_bytes = row_info->bit_depth >> 3;
+   png_const_bytep ap = row + pixel_bytes - alpha_bytes;
+   png_const_bytep ep = row + row_info->rowbytes;
+
+   for (; ap < ep; ap += pixel_bytes)
+      if (ap[0] != 0xff || ap[alpha_bytes - 1] != 0xff)
+         return 0;
+
+   return 1;
+}
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+/* The test png_do_compose makes to composite in linear light. */
+static int
+png_compose_uses_gamma(png_const_structrp png_ptr, int bit_depth)
+{
+   if (bit_depth == 8)
+      return png_ptr->gamma_table != NULL && png_ptr->gamma_to_1 != NULL &&
+          png_ptr->gamma_from_1 != NULL;
+
+   return png_ptr->gamma_16_table != NULL && png_ptr->gamma_16_to_1 != NULL &&
+       png_ptr->gamma_16_from_1 != NULL;
+}
+#endif
+
+static void
+png_read_step_compose(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   const int alpha = (row_info->color_type & PNG_COLOR_MASK_ALPHA) != 0;
+
+   /* png_do_compose only gamma corrects opaque pixels, as the gamma step
+    * would.
+    */
+   if (alpha != 0 && (row_info->bit_depth == 8 || row_info->bit_depth == 16) &&
+       png_row_is_opaque(row_info, row) != 0)
+   {
+#ifdef PNG_READ_GAMMA_SUPPORTED
+      if (png_compose_uses_gamma(png_ptr, row_info->bit_depth) != 0)
+         png_read_step_gamma(png_ptr, row_info, row);
+#endif
+      return;
+   }
+
+   if (png_ptr->read_compose_8 != NULL && alpha != 0 &&
+       row_info->bit_depth == 8)
    {
-      int rgb_error =
-          png_do_rgb_to_gray(png_ptr, row_info,
-              png_ptr->row_buf + 1);
+      png_byte background[3], background_1[3];
+      png_const_uint_32p tables = NULL;
+      int optimize = 0;
 
-      if (rgb_error != 0)
+      if (row_info->color_type == PNG_COLOR_TYPE_RGB_ALPHA)
       {
-         png_ptr->rgb_to_gray_status=1;
-         if ((png_ptr->transformations & PNG_RGB_TO_GRAY) ==
-             PNG_RGB_TO_GRAY_WARN)
-            png_warning(png_ptr, "png_do_rgb_to_gray found nongray pixel");
-
-         if ((png_ptr->transformations & PNG_RGB_TO_GRAY) ==
-             PNG_RGB_TO_GRAY_ERR)
-            png_error(png_ptr, "png_do_rgb_to_gray found nongray pixel");
+         background[0] = (png_byte)png_ptr->background.red;
+         background[1] = (png_byte)png_ptr->background.green;
+         background[2] = (png_byte)png_ptr->background.blue;
       }
+
+      else
+         background[0] = background[1] = background[2] =
+             (png_byte)png_ptr->background.gray;
+
+      memcpy(background_1, background, 3);
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+      if (png_compose_uses_gamma(png_ptr, 8) != 0)
+      {
+         /* The tables are gamma_table, gamma_to_1 and gamma_from_1. */
+         if (png_ptr->gamma_table_wide == NULL)
+         {
+            png_do_compose(row_info, row, png_ptr);
+            return;
+         }
+
+         tables = png_voidcast(png_const_uint_32p, png_ptr->gamma_table_wide);
+         optimize = (png_ptr->flags & PNG_FLAG_OPTIMIZE_ALPHA) != 0;
+
+         if (row_info->color_type == PNG_COLOR_TYPE_RGB_ALPHA)
+         {
+            background_1[0] = (png_byte)png_ptr->background_1.red;
+            background_1[1] = (png_byte)png_ptr->background_1.green;
+            background_1[2] = (png_byte)png_ptr->background_1.blue;
+         }
+
+         else
+            background_1[0] = background_1[1] = background_1[2] =
+                (png_byte)png_ptr->background_1.gray;
+      }
+#endif
+
+      png_ptr->read_compose_8(row, row_info->rowbytes,
+          row_info->pixel_depth >> 3, background, background_1, tables,
+          optimize);
+      return;
+   }
+
+   png_do_compose(row_info, row, png_ptr);
+}
+#endif
+
+#ifdef PNG_READ_ALPHA_MODE_SUPPORTED
+static void
+png_read_step_encode_alpha(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   if ((row_info->color_type & PNG_COLOR_MASK_ALPHA) != 0)
+      png_do_encode_alpha(row_info, row, png_ptr);
+}
+#endif
+
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+static void
+png_read_step_scale_16_to_8(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   if (png_ptr->read_scale_16_to_8 != NULL && row_info->bit_depth == 16)
+   {
+      png_ptr->read_scale_16_to_8(row, row_info->rowbytes);
+
+      row_info->bit_depth = 8;
+      row_info->pixel_depth = (png_byte)(8 * row_info->channels);
+      row_info->rowbytes = row_info->width * row_info->channels;
+   }
+
+   else
+      png_do_scale_16_to_8(row_info, row);
+}
+#endif
+
+#ifdef PNG_READ_STRIP_16_TO_8_SUPPORTED
+static void
+png_read_step_chop(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_chop(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_QUANTIZE_SUPPORTED
+static void
+png_read_step_quantize(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_quantize(row_info, row, png_ptr->palette_lookup,
+       png_ptr->quantize_index);
+
+   if (row_info->rowbytes == 0)
+      png_error(png_ptr, "png_do_quantize returned rowbytes=0");
+}
+#endif
+
+#ifdef PNG_READ_EXPAND_16_SUPPORTED
+static void
+png_read_step_expand_16(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_expand_16(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_INVERT_SUPPORTED
+static void
+png_read_step_invert(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_invert(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_INVERT_ALPHA_SUPPORTED
+static void
+png_read_step_invert_alpha(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_read_invert_alpha(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_SHIFT_SUPPORTED
+static void
+png_read_step_unshift(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_unshift(row_info, row, &(png_ptr->shift));
+}
+#endif
+
+#ifdef PNG_READ_PACK_SUPPORTED
+static void
+png_read_step_unpack(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_unpack(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_CHECK_FOR_INVALID_INDEX_SUPPORTED
+static void
+png_read_step_check_palette_indexes(png_structrp png_ptr,
+    png_row_infop row_info, png_bytep row)
+{
+   /* Added at libpng-1.5.10 */
+   if (row_info->color_type == PNG_COLOR_TYPE_PALETTE &&
+       png_ptr->num_palette_max >= 0)
+      png_do_check_palette_indexes(png_ptr, row_info);
+   PNG_UNUSED(row)
+}
+#endif
+
+#ifdef PNG_READ_BGR_SUPPORTED
+static void
+png_read_step_bgr(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_bgr(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_PACKSWAP_SUPPORTED
+static void
+png_read_step_packswap(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_packswap(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_FILLER_SUPPORTED
+static void
+png_read_step_filler(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_read_filler(row_info, row, (png_uint_32)png_ptr->filler,
+       png_ptr->flags);
+}
+#endif
+
+#ifdef PNG_READ_SWAP_ALPHA_SUPPORTED
+static void
+png_read_step_swap_alpha(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_read_swap_alpha(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#if defined(PNG_READ_16BIT_SUPPORTED) && defined(PNG_READ_SWAP_SUPPORTED)
+static void
+png_read_step_swap(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   png_do_swap(row_info, row);
+   PNG_UNUSED(png_ptr)
+}
+#endif
+
+#ifdef PNG_READ_USER_TRANSFORM_SUPPORTED
+static void
+png_read_step_user_transform(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row)
+{
+   if (png_ptr->read_user_transform_fn != NULL)
+      (*(png_ptr->read_user_transform_fn)) /* User read transform function */
+          (png_ptr,     /* png_ptr */
+          row_info,     /* row_info: */
+             /*  png_uint_32 width;       width of row */
+             /*  size_t rowbytes;         number of bytes in row */
+             /*  png_byte color_type;     color type of pixels */
+             /*  png_byte bit_depth;      bit depth of samples */
+             /*  png_byte channels;       number of channels (1-4) */
+             /*  png_byte pixel_depth;    bits per pixel (depth*channels) */
+          row);         /* start of pixel data for row */
+#ifdef PNG_USER_TRANSFORM_PTR_SUPPORTED
+   if (png_ptr->user_transform_depth != 0)
+      row_info->bit_depth = png_ptr->user_transform_depth;
+
+   if (png_ptr->user_transform_channels != 0)
+      row_info->channels = png_ptr->user_transform_channels;
+#endif
+   row_info->pixel_depth = (png_byte)(row_info->bit_depth *
+       row_info->channels);
+
+   row_info->rowbytes = PNG_ROWBYTES(row_info->pixel_depth, row_info->width);
+}
+#endif
+
+/* Make the byte map for the steps of 'map' by running them on one pixel, twice
+ * with different values: each output byte must be a copy of one input byte
+ * or the same constant both times.  The portable map is only used if at least
+ * two of the steps change the pixel, otherwise the separate steps are as fast;
+ * png_struct::read_byte_map is used for one.
+ */
+static void
+png_make_byte_map(png_structrp png_ptr, png_read_transform *map,
+    const png_row_info *row_info)
+{
+   png_byte pixel[2][16];
+   png_row_info info[2];
+   unsigned int in_bytes, out_bytes, changes, i, j, k;
+
+   map->made = 1;
+   map->usable = 0;
+   map->in_color_type = row_info->color_type;
+   map->in_bit_depth = row_info->bit_depth;
+   map->in_channels = row_info->channels;
+
+   if (row_info->pixel_depth < 8 || (row_info->pixel_depth & 7) != 0)
+      return;
+
+   in_bytes = row_info->pixel_depth >> 3;
+
+   if (in_bytes > 8)
+      return;
+
+   for (k = 0; k < 2; ++k)
+   {
+      info[k] = *row_info;
+      info[k].width = 1;
+      info[k].rowbytes = in_bytes;
+      memset(pixel[k], 0, (sizeof pixel[k]));
+
+      for (i = 0; i < in_bytes; ++i)
+         pixel[k][i] = (png_byte)(k == 0 ? 0x01 + i : 0xa1 + i);
+
+      for (j = 0, changes = 0; j < map->steps; ++j)
+      {
+         png_byte before[16];
+         png_row_info before_info = info[k];
+
+         memcpy(before, pixel[k], (sizeof before));
+         map->step[j](png_ptr, info + k, pixel[k]);
+
+         if (memcmp(before, pixel[k], (sizeof before)) != 0 ||
+             before_info.pixel_depth != info[k].pixel_depth ||
+             before_info.color_type != info[k].color_type)
+            ++changes;
+      }
+   }
+
+   if (changes < (png_ptr->read_byte_map != NULL ? 1U : 2U))
+      return;
+
+   if (info[0].pixel_depth != info[1].pixel_depth ||
+       info[0].color_type != info[1].color_type ||
+       (info[0].pixel_depth & 7) != 0 || info[0].pixel_depth < 8 ||
+       info[0].pixel_depth > 64)
+      return;
+
+   out_bytes = info[0].pixel_depth >> 3;
+
+   for (j = 0; j < out_bytes; ++j)
+   {
+      for (i = 0; i < in_bytes; ++i)
+         if (pixel[0][j] == 0x01 + i && pixel[1][j] == 0xa1 + i)
+            break;
+
+      if (i < in_bytes)
+         map->src[j] = (png_byte)i;
+
+      else if (pixel[0][j] == pixel[1][j])
+      {
+         map->src[j] = (png_byte)(8 + j);
+         map->value[j] = pixel[0][j];
+      }
+
+      else
+         return;
+   }
+
+   map->in_bytes = (png_byte)in_bytes;
+   map->out_bytes = (png_byte)out_bytes;
+   map->out_color_type = info[0].color_type;
+   map->out_bit_depth = info[0].bit_depth;
+   map->out_channels = info[0].channels;
+   map->usable = 1;
+}
+
+/* Apply the byte map in place.  A pixel is read completely before it is
+ * written, so the row is processed from the end if the pixels get larger.
+ * The common pixel sizes are handled by loops where the sizes are constants,
+ * so that the compiler can keep the pixel in registers.
+ */
+#define PNG_BYTE_MAP_PIXEL(in_bytes, out_bytes)\
+   {\
+      unsigned int j;\
+\
+      memcpy(pixel, sp, in_bytes);\
+\
+      for (j = 0; j < out_bytes; ++j)\
+         dp[j] = pixel[src[j]];\
+   }
+
+#define PNG_BYTE_MAP_ROW(in_bytes, out_bytes)\
+   if ((out_bytes) > (in_bytes))\
+   {\
+      sp += (size_t)width * (in_bytes);\
+      dp += (size_t)width * (out_bytes);\
+\
+      while (width-- > 0)\
+      {\
+         sp -= in_bytes;\
+         dp -= out_bytes;\
+         PNG_BYTE_MAP_PIXEL(in_bytes, out_bytes)\
+      }\
+   }\
+\
+   else\
+   {\
+      while (width-- > 0)\
+      {\
+         PNG_BYTE_MAP_PIXEL(in_bytes, out_bytes)\
+         sp += in_bytes;\
+         dp += out_bytes;\
+      }\
+   }
+
+#define PNG_BYTE_MAP_CASE(in_bytes, out_bytes)\
+   case (in_bytes) * 16 + (out_bytes):\
+      PNG_BYTE_MAP_ROW(in_bytes, out_bytes)\
+      break;
+
+static void
+png_do_byte_map(const png_row_info *row_info, png_bytep row,
+    const png_read_transform *map)
+{
+   png_uint_32 width = row_info->width;
+   png_const_bytep sp = row;
+   png_bytep dp = row;
+   png_byte src[8], pixel[16];
+
+   memcpy(src, map->src, (sizeof src));
+   memcpy(pixel + 8, map->value, (sizeof map->value));
+
+   switch (map->in_bytes * 16 + map->out_bytes)
+   {
+      PNG_BYTE_MAP_CASE(1, 2)
+      PNG_BYTE_MAP_CASE(1, 3)
+      PNG_BYTE_MAP_CASE(1, 4)
+      PNG_BYTE_MAP_CASE(2, 2)
+      PNG_BYTE_MAP_CASE(2, 3)
+      PNG_BYTE_MAP_CASE(2, 4)
+      PNG_BYTE_MAP_CASE(3, 3)
+      PNG_BYTE_MAP_CASE(3, 4)
+      PNG_BYTE_MAP_CASE(4, 3)
+      PNG_BYTE_MAP_CASE(4, 4)
+      PNG_BYTE_MAP_CASE(6, 3)
+      PNG_BYTE_MAP_CASE(6, 4)
+      PNG_BYTE_MAP_CASE(8, 3)
+      PNG_BYTE_MAP_CASE(8, 4)
+
+      default:
+      {
+         unsigned int in_bytes = map->in_bytes, out_bytes = map->out_bytes;
+
+         PNG_BYTE_MAP_ROW(in_bytes, out_bytes)
+      }
+         break;
+   }
+}
+
+static void
+png_read_byte_map(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row, png_read_transform *map)
+{
+   unsigned int j;
+
+   if (map->made == 0 || map->in_color_type != row_info->color_type ||
+       map->in_bit_depth != row_info->bit_depth ||
+       map->in_channels != row_info->channels)
+      png_make_byte_map(png_ptr, map, row_info);
+
+   if (map->usable != 0)
+   {
+      if (png_ptr->read_byte_map != NULL)
+         png_ptr->read_byte_map(row, row_info->width, map->in_bytes,
+             map->out_bytes, map->src, map->value);
+
+      else
+         png_do_byte_map(row_info, row, map);
+
+      row_info->color_type = map->out_color_type;
+      row_info->bit_depth = map->out_bit_depth;
+      row_info->channels = map->out_channels;
+      row_info->pixel_depth = (png_byte)(map->out_bytes << 3);
+      row_info->rowbytes = (size_t)row_info->width * map->out_bytes;
+   }
+
+   else
+      for (j = 0; j < map->steps; ++j)
+         map->step[j](png_ptr, row_info, row);
+}
+
+#ifdef PNG_READ_EXPAND_SUPPORTED
+/* Make the palette map by running the steps on a row of the 256 indices.  The
+ * map is used if the result is 1 to 4 whole bytes per pixel, which it is for
+ * the byte map steps.
+ */
+static void
+png_make_palette_map(png_structrp png_ptr, png_read_transform *map,
+    png_bytep palette_map)
+{
+   png_byte row[256 * 8];
+   png_row_info info;
+   unsigned int out_bytes, i, j;
+
+   map->made = 1;
+   map->usable = 0;
+
+   info.width = 256;
+   info.rowbytes = 256;
+   info.color_type = PNG_COLOR_TYPE_PALETTE;
+   info.bit_depth = 8;
+   info.channels = 1;
+   info.pixel_depth = 8;
+
+   for (i = 0; i < 256; ++i)
+      row[i] = (png_byte)i;
+
+   for (j = 0; j < map->steps; ++j)
+      map->step[j](png_ptr, &info, row);
+
+   if ((info.pixel_depth & 7) != 0 || info.pixel_depth < 8 ||
+       info.pixel_depth > 32)
+      return;
+
+   out_bytes = info.pixel_depth >> 3;
+   memset(palette_map, 0, 256 * 4);
+
+   for (i = 0; i < 256; ++i)
+      memcpy(palette_map + 4 * i + (4 - out_bytes), row + out_bytes * i,
+          out_bytes);
+
+   map->out_bytes = (png_byte)out_bytes;
+   map->out_color_type = info.color_type;
+   map->out_bit_depth = info.bit_depth;
+   map->out_channels = info.channels;
+   map->usable = 1;
+}
+
+/* Expand a row of 8-bit indices in place, from the end.  Each entry is copied
+ * whole, to 4 - out_bytes bytes before the pixel; these bytes are output of
+ * the pixels still to be done, not their indices, once the pixel is far enough
+ * into the row.
+ */
+static void
+png_do_palette_map(png_bytep row, png_uint_32 width, unsigned int out_bytes,
+    png_const_bytep palette_map)
+{
+   png_const_bytep sp = row + width;
+   png_bytep dp = row + (size_t)width * out_bytes;
+   const unsigned int lead = 4 - out_bytes;
+
+   /* Pixel n is at n * out_bytes; the copy must not reach index n-1. */
+   while (sp > row && (size_t)(sp - row - 1) * (out_bytes - 1) >= lead)
+   {
+      dp -= out_bytes;
+      memcpy(dp - lead, palette_map + 4 * *--sp, 4);
+   }
+
+   while (sp > row)
+   {
+      dp -= out_bytes;
+      memcpy(dp, palette_map + 4 * *--sp + lead, out_bytes);
+   }
+}
+
+static void
+png_read_palette_map(png_structrp png_ptr, png_row_infop row_info,
+    png_bytep row, png_read_transform *map)
+{
+   png_read_transformsp list =
+      png_voidcast(png_read_transformsp, png_ptr->read_transforms);
+   unsigned int j;
+
+   if (map->made == 0)
+      png_make_palette_map(png_ptr, map, list->palette_map);
+
+   if (map->usable != 0 && row_info->color_type == PNG_COLOR_TYPE_PALETTE)
+   {
+      png_do_expand_palette_index(row_info, row);
+
+      if (png_ptr->read_palette_map != NULL)
+         png_ptr->read_palette_map(row, row_info->width, map->out_bytes,
+             list->palette_map);
+
+      else
+         png_do_palette_map(row, row_info->width, map->out_bytes,
+             list->palette_map);
+
+      row_info->color_type = map->out_color_type;
+      row_info->bit_depth = map->out_bit_depth;
+      row_info->channels = map->out_channels;
+      row_info->pixel_depth = (png_byte)(map->out_bytes << 3);
+      row_info->rowbytes = (size_t)row_info->width * map->out_bytes;
+   }
+
+   else
+      for (j = 0; j < map->steps; ++j)
+         map->step[j](png_ptr, row_info, row);
+}
+#endif /* READ_EXPAND */
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+/* Return 1 if the gamma table png_do_gamma would use changes nothing.  This
+ * happens when the gamma is significant for png_gamma_significant but the
+ * table still rounds to the input, as it does for small corrections with a
+ * PNG_GAMMA_THRESHOLD of 0.  The 16-bit tables are only an identity with
+ * all the bits (a gamma_shift of 0) and if they are not the 16-to-8 tables.
+ */
+static int
+png_gamma_table_is_identity(png_const_structrp png_ptr)
+{
+   unsigned int i, j;
+
+   if (png_ptr->bit_depth <= 8)
+   {
+      if (png_ptr->gamma_table == NULL)
+         return 0;
+
+      for (i = 0; i < 256; ++i)
+         if (png_ptr->gamma_table[i] != i)
+            return 0;
+
+      return 1;
+   }
+
+   if (png_ptr->gamma_16_table == NULL || png_ptr->gamma_shift != 0 ||
+       (png_ptr->transformations & (PNG_16_TO_8 | PNG_SCALE_16_TO_8)) != 0)
+      return 0;
+
+   for (i = 0; i < 256; ++i)
+      for (j = 0; j < 256; ++j)
+         if (png_ptr->gamma_16_table[i][j] != ((j << 8) | i))
+            return 0;
+
+   return 1;
+}
+
+/* Make png_struct::gamma_table_wide for the read_gamma_8, read_gamma_16,
+ * read_compose_8 and read_rgb_to_gray kernels: gamma_table, gamma_to_1 and
+ * gamma_from_1 with 32-bit entries, one after the other, or the 16-bit
+ * gamma_16_table followed by gamma_16_to_1 and gamma_16_from_1, if they are
+ * set, in one block with two bytes after the end.  It is freed with the other
+ * gamma tables.
+ */
+static void
+png_make_gamma_table_wide(png_structrp png_ptr)
+{
+   if (png_ptr->gamma_table_wide != NULL)
+      return;
+
+   if (png_ptr->bit_depth <= 8)
+   {
+      png_uint_32p table;
+      unsigned int i;
+
+      if (png_ptr->gamma_table == NULL)
+         return;
+
+      table = png_voidcast(png_uint_32p, png_malloc(png_ptr, 3 * 256 * 4));
+
+      for (i = 0; i < 256; ++i)
+      {
+         table[i] = png_ptr->gamma_table[i];
+         table[256 + i] = i;
+         table[512 + i] = i;
+      }
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED) ||\
+   defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
+      if (png_ptr->gamma_to_1 != NULL && png_ptr->gamma_from_1 != NULL)
+      {
+         for (i = 0; i < 256; ++i)
+         {
+            table[256 + i] = png_ptr->gamma_to_1[i];
+            table[512 + i] = png_ptr->gamma_from_1[i];
+         }
+      }
+#endif
+
+      png_ptr->gamma_table_wide = table;
+   }
+
+#ifdef PNG_16BIT_SUPPORTED
+   else
+   {
+      png_uint_16p table;
+      unsigned int num = 1U << (8 - png_ptr->gamma_shift), count = 1, i;
+
+      if (png_ptr->gamma_16_table == NULL)
+         return;
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED) ||\
+   defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
+      if (png_ptr->gamma_16_to_1 != NULL && png_ptr->gamma_16_from_1 != NULL)
+         count = 3;
+#endif
+
+      table = png_voidcast(png_uint_16p,
+          png_malloc(png_ptr, ((size_t)count * num * 256 + 1) * 2));
+
+      for (i = 0; i < num; ++i)
+         memcpy(table + 256 * i, png_ptr->gamma_16_table[i], 256 * 2);
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED) ||\
+   defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
+      if (count == 3)
+      {
+         for (i = 0; i < num; ++i)
+         {
+            memcpy(table + 256 * (num + i), png_ptr->gamma_16_to_1[i], 256 * 2);
+            memcpy(table + 256 * (2 * num + i), png_ptr->gamma_16_from_1[i],
+                256 * 2);
+         }
+      }
+#endif
+
+      table[256 * count * num] = 0;
+      png_ptr->gamma_table_wide = table;
+   }
+#endif
+}
+#endif /* READ_GAMMA */
+
+/* Add a step.  Steps which can be part of a byte map are collected in the
+ * last entry while they follow each other, or follow the palette expansion.
+ */
+#define PNG_STEP          0 /* run on its own */
+#define PNG_STEP_BYTE_MAP 1 /* only moves or sets bytes */
+#define PNG_STEP_PALETTE  2 /* the palette expansion */
+
+static void
+png_add_read_step(png_read_transformsp list, png_read_transform_fn fn,
+    int kind)
+{
+   png_read_transform *last = list->count > 0 ?
+      list->step + list->count - 1 : NULL;
+
+   if (kind == PNG_STEP_BYTE_MAP && last != NULL && last->steps > 0 &&
+       last->steps < PNG_BYTE_MAP_STEPS_MAX)
+   {
+      last->step[last->steps++] = fn;
+      return;
+   }
+
+   last = list->step + list->count++;
+   memset(last, 0, (sizeof *last));
+
+   if (kind != PNG_STEP)
+   {
+      last->steps = 1;
+      last->step[0] = fn;
+      last->palette = kind == PNG_STEP_PALETTE;
+   }
+
+   else
+      last->fn = fn;
+}
+
+/* Resolve the transformations for this image into png_struct::read_transforms.
+ * The order of transformations is significant, and is very touchy.  If you
+ * add a transformation, take care to decide how it fits in with the other
+ * transformations here.
+ */
+void /* PRIVATE */
+png_build_read_transformations(png_structrp png_ptr)
+{
+   png_read_transformsp list;
+
+   png_debug(1, "in png_build_read_transformations");
+
+   list = png_voidcast(png_read_transformsp, png_ptr->read_transforms);
+
+   if (list == NULL)
+   {
+      list = png_voidcast(png_read_transformsp,
+          png_malloc(png_ptr, (sizeof *list)));
+      png_ptr->read_transforms = list;
+   }
+
+   list->count = 0;
+
+#ifdef PNG_READ_TRANSFORM_OPTIMIZATIONS
+   PNG_READ_TRANSFORM_OPTIMIZATIONS(png_ptr);
+#endif
+
+#ifdef PNG_READ_EXPAND_SUPPORTED
+   if ((png_ptr->transformations & PNG_EXPAND) != 0)
+   {
+      if (png_ptr->color_type == PNG_COLOR_TYPE_PALETTE)
+         png_add_read_step(list, png_read_step_expand_palette,
+             PNG_STEP_PALETTE);
+
+      else if (png_ptr->num_trans != 0 &&
+          (png_ptr->transformations & PNG_EXPAND_tRNS) != 0)
+         png_add_read_step(list, png_read_step_expand_tRNS, PNG_STEP);
+
+      else
+         png_add_read_step(list, png_read_step_expand, PNG_STEP);
+   }
+#endif
+
+#ifdef PNG_READ_STRIP_ALPHA_SUPPORTED
+   if ((png_ptr->transformations & PNG_STRIP_ALPHA) != 0 &&
+       (png_ptr->transformations & PNG_COMPOSE) == 0)
+      png_add_read_step(list, png_read_step_strip_alpha, PNG_STEP_BYTE_MAP);
+#endif
+
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+   if ((png_ptr->transformations & PNG_RGB_TO_GRAY) != 0)
+   {
+      png_add_read_step(list, png_read_step_rgb_to_gray, PNG_STEP);
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+      if (png_ptr->bit_depth <= 8 ? png_ptr->read_rgb_to_gray_8 != NULL :
+          png_ptr->read_rgb_to_gray_16 != NULL)
+         png_make_gamma_table_wide(png_ptr);
+#endif
    }
 #endif
 
@@ -4947,13 +6027,22 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
     */
    if ((png_ptr->transformations & PNG_GRAY_TO_RGB) != 0 &&
        (png_ptr->mode & PNG_BACKGROUND_IS_GRAY) == 0)
-      png_do_gray_to_rgb(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_gray_to_rgb, PNG_STEP_BYTE_MAP);
 #endif
 
 #if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
    defined(PNG_READ_ALPHA_MODE_SUPPORTED)
    if ((png_ptr->transformations & PNG_COMPOSE) != 0)
-      png_do_compose(row_info, png_ptr->row_buf + 1, png_ptr);
+   {
+      png_add_read_step(list, png_read_step_compose, PNG_STEP);
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+      /* The compose step gamma corrects opaque rows with the gamma step. */
+      if (png_ptr->bit_depth <= 8 ? png_ptr->read_compose_8 != NULL ||
+          png_ptr->read_gamma_8 != NULL : png_ptr->read_gamma_16 != NULL)
+         png_make_gamma_table_wide(png_ptr);
+#endif
+   }
 #endif
 
 #ifdef PNG_READ_GAMMA_SUPPORTED
@@ -4974,28 +6063,31 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
       /* Because png_init_read_transformations transforms the palette, unless
        * RGB_TO_GRAY will do the transform.
        */
-       (png_ptr->color_type != PNG_COLOR_TYPE_PALETTE))
-      png_do_gamma(row_info, png_ptr->row_buf + 1, png_ptr);
+       (png_ptr->color_type != PNG_COLOR_TYPE_PALETTE) &&
+       png_gamma_table_is_identity(png_ptr) == 0)
+   {
+      png_add_read_step(list, png_read_step_gamma, PNG_STEP);
+
+      if (png_ptr->bit_depth <= 8 ? png_ptr->read_gamma_8 != NULL :
+          png_ptr->read_gamma_16 != NULL)
+         png_make_gamma_table_wide(png_ptr);
+   }
 #endif
 
 #ifdef PNG_READ_STRIP_ALPHA_SUPPORTED
    if ((png_ptr->transformations & PNG_STRIP_ALPHA) != 0 &&
-       (png_ptr->transformations & PNG_COMPOSE) != 0 &&
-       (row_info->color_type == PNG_COLOR_TYPE_RGB_ALPHA ||
-       row_info->color_type == PNG_COLOR_TYPE_GRAY_ALPHA))
-      png_do_strip_channel(row_info, png_ptr->row_buf + 1,
-          0 /* at_start == false, because SWAP_ALPHA happens later */);
+       (png_ptr->transformations & PNG_COMPOSE) != 0)
+      png_add_read_step(list, png_read_step_strip_alpha, PNG_STEP_BYTE_MAP);
 #endif
 
 #ifdef PNG_READ_ALPHA_MODE_SUPPORTED
-   if ((png_ptr->transformations & PNG_ENCODE_ALPHA) != 0 &&
-       (row_info->color_type & PNG_COLOR_MASK_ALPHA) != 0)
-      png_do_encode_alpha(row_info, png_ptr->row_buf + 1, png_ptr);
+   if ((png_ptr->transformations & PNG_ENCODE_ALPHA) != 0)
+      png_add_read_step(list, png_read_step_encode_alpha, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
    if ((png_ptr->transformations & PNG_SCALE_16_TO_8) != 0)
-      png_do_scale_16_to_8(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_scale_16_to_8, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_STRIP_16_TO_8_SUPPORTED
@@ -5004,18 +6096,12 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
     * calling the API or in a TRANSFORM flag) this is what happens.
     */
    if ((png_ptr->transformations & PNG_16_TO_8) != 0)
-      png_do_chop(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_chop, PNG_STEP_BYTE_MAP);
 #endif
 
 #ifdef PNG_READ_QUANTIZE_SUPPORTED
    if ((png_ptr->transformations & PNG_QUANTIZE) != 0)
-   {
-      png_do_quantize(row_info, png_ptr->row_buf + 1,
-          png_ptr->palette_lookup, png_ptr->quantize_index);
-
-      if (row_info->rowbytes == 0)
-         png_error(png_ptr, "png_do_quantize returned rowbytes=0");
-   }
+      png_add_read_step(list, png_read_step_quantize, PNG_STEP);
 #endif /* READ_QUANTIZE */
 
 #ifdef PNG_READ_EXPAND_16_SUPPORTED
@@ -5025,99 +6111,132 @@ png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
     * better accuracy results faster!)
     */
    if ((png_ptr->transformations & PNG_EXPAND_16) != 0)
-      png_do_expand_16(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_expand_16, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_GRAY_TO_RGB_SUPPORTED
    /* NOTE: moved here in 1.5.4 (from much later in this list.) */
    if ((png_ptr->transformations & PNG_GRAY_TO_RGB) != 0 &&
        (png_ptr->mode & PNG_BACKGROUND_IS_GRAY) != 0)
-      png_do_gray_to_rgb(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_gray_to_rgb, PNG_STEP_BYTE_MAP);
 #endif
 
 #ifdef PNG_READ_INVERT_SUPPORTED
    if ((png_ptr->transformations & PNG_INVERT_MONO) != 0)
-      png_do_invert(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_invert, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_INVERT_ALPHA_SUPPORTED
    if ((png_ptr->transformations & PNG_INVERT_ALPHA) != 0)
-      png_do_read_invert_alpha(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_invert_alpha, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_SHIFT_SUPPORTED
    if ((png_ptr->transformations & PNG_SHIFT) != 0)
-      png_do_unshift(row_info, png_ptr->row_buf + 1,
-          &(png_ptr->shift));
+      png_add_read_step(list, png_read_step_unshift, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_PACK_SUPPORTED
    if ((png_ptr->transformations & PNG_PACK) != 0)
-      png_do_unpack(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_unpack, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_CHECK_FOR_INVALID_INDEX_SUPPORTED
-   /* Added at libpng-1.5.10 */
-   if (row_info->color_type == PNG_COLOR_TYPE_PALETTE &&
-       png_ptr->num_palette_max >= 0)
-      png_do_check_palette_indexes(png_ptr, row_info);
+   /* After the palette expansion there are no indices to check. */
+   if (png_ptr->color_type == PNG_COLOR_TYPE_PALETTE &&
+       (png_ptr->transformations & PNG_EXPAND) == 0)
+      png_add_read_step(list, png_read_step_check_palette_indexes, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_BGR_SUPPORTED
    if ((png_ptr->transformations & PNG_BGR) != 0)
-      png_do_bgr(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_bgr, PNG_STEP_BYTE_MAP);
 #endif
 
 #ifdef PNG_READ_PACKSWAP_SUPPORTED
    if ((png_ptr->transformations & PNG_PACKSWAP) != 0)
-      png_do_packswap(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_packswap, PNG_STEP);
 #endif
 
 #ifdef PNG_READ_FILLER_SUPPORTED
    if ((png_ptr->transformations & PNG_FILLER) != 0)
-      png_do_read_filler(row_info, png_ptr->row_buf + 1,
-          (png_uint_32)png_ptr->filler, png_ptr->flags);
+      png_add_read_step(list, png_read_step_filler, PNG_STEP_BYTE_MAP);
 #endif
 
 #ifdef PNG_READ_SWAP_ALPHA_SUPPORTED
    if ((png_ptr->transformations & PNG_SWAP_ALPHA) != 0)
-      png_do_read_swap_alpha(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_swap_alpha, PNG_STEP_BYTE_MAP);
 #endif
 
 #ifdef PNG_READ_16BIT_SUPPORTED
 #ifdef PNG_READ_SWAP_SUPPORTED
    if ((png_ptr->transformations & PNG_SWAP_BYTES) != 0)
-      png_do_swap(row_info, png_ptr->row_buf + 1);
+      png_add_read_step(list, png_read_step_swap, PNG_STEP_BYTE_MAP);
 #endif
 #endif
 
 #ifdef PNG_READ_USER_TRANSFORM_SUPPORTED
    if ((png_ptr->transformations & PNG_USER_TRANSFORM) != 0)
+      png_add_read_step(list, png_read_step_user_transform, PNG_STEP);
+#endif
+}
+
+/* Transform the row with the steps made by png_build_read_transformations. */
+void /* PRIVATE */
+png_do_read_transformations(png_structrp png_ptr, png_row_infop row_info)
+{
+   png_read_transformsp list;
+   png_bytep row;
+   unsigned int i;
+
+   png_debug(1, "in png_do_read_transformations");
+
+   if (png_ptr->row_buf == NULL)
    {
-      if (png_ptr->read_user_transform_fn != NULL)
-         (*(png_ptr->read_user_transform_fn)) /* User read transform function */
-             (png_ptr,     /* png_ptr */
-             row_info,     /* row_info: */
-                /*  png_uint_32 width;       width of row */
-                /*  size_t rowbytes;         number of bytes in row */
-                /*  png_byte color_type;     color type of pixels */
-                /*  png_byte bit_depth;      bit depth of samples */
-                /*  png_byte channels;       number of channels (1-4) */
-                /*  png_byte pixel_depth;    bits per pixel (depth*channels) */
-             png_ptr->row_buf + 1);    /* start of pixel data for row */
-#ifdef PNG_USER_TRANSFORM_PTR_SUPPORTED
-      if (png_ptr->user_transform_depth != 0)
-         row_info->bit_depth = png_ptr->user_transform_depth;
+      /* Prior to 1.5.4 this output row/pass where the NULL pointer is, but this
+       * error is incredibly rare and incredibly easy to debug without this
+       * information.
+       */
+      png_error(png_ptr, "NULL row buffer");
+   }
 
-      if (png_ptr->user_transform_channels != 0)
-         row_info->channels = png_ptr->user_transform_channels;
+   /* The following is debugging; prior to 1.5.4 the code was never compiled in;
+    * in 1.5.4 PNG_FLAG_DETECT_UNINITIALIZED was added and the macro
+    * PNG_WARN_UNINITIALIZED_ROW removed.  In 1.6 the new flag is set only for
+    * all transformations, however in practice the ROW_INIT always gets done on
+    * demand, if necessary.
+    */
+   if ((png_ptr->flags & PNG_FLAG_DETECT_UNINITIALIZED) != 0 &&
+       (png_ptr->flags & PNG_FLAG_ROW_INIT) == 0)
+   {
+      /* Application has failed to call either png_read_start_image() or
+       * png_read_update_info() after setting transforms that expand pixels.
+       * This check added to libpng-1.2.19 (but not enabled until 1.5.4).
+       */
+      png_error(png_ptr, "Uninitialized row");
+   }
+
+   if (png_ptr->read_transforms == NULL)
+      png_build_read_transformations(png_ptr);
+
+   list = png_voidcast(png_read_transformsp, png_ptr->read_transforms);
+   row = png_ptr->row_buf + 1;
+
+   for (i = 0; i < list->count; ++i)
+   {
+      png_read_transform *step = list->step + i;
+
+      if (step->fn != NULL)
+         step->fn(png_ptr, row_info, row);
+
+#ifdef PNG_READ_EXPAND_SUPPORTED
+      else if (step->palette != 0)
+         png_read_palette_map(png_ptr, row_info, row, step);
 #endif
-      row_info->pixel_depth = (png_byte)(row_info->bit_depth *
-          row_info->channels);
 
-      row_info->rowbytes = PNG_ROWBYTES(row_info->pixel_depth, row_info->width);
+      else
+         png_read_byte_map(png_ptr, row_info, row, step);
    }
-#endif
 }
 
 #endif /* READ_TRANSFORMS */
@@ -193,7 +193,26 @@ png_read_chunk_header(png_structrp png_ptr)
     * updated even if they are detectably wrong.  This aids error message
     * handling by allowing png_chunk_error to be used.
     */
-   png_read_data(png_ptr, buf, 8);
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+   if ((png_ptr->flags & PNG_FLAG_CHUNK_HEADER_PENDING) != 0)
+   {
+      /* png_read_IDAT_gather has already read this header; reconstruct it so
+       * that the checks below are the same.
+       */
+      png_uint_32 pending = png_ptr->pending_chunk_length;
+
+      png_ptr->flags &= ~PNG_FLAG_CHUNK_HEADER_PENDING;
+      buf[0] = (png_byte)((pending >> 24) & 0xff);
+      buf[1] = (png_byte)((pending >> 16) & 0xff);
+      buf[2] = (png_byte)((pending >>  8) & 0xff);
+      buf[3] = (png_byte)( pending        & 0xff);
+      PNG_STRING_FROM_CHUNK(buf+4, png_ptr->chunk_name);
+   }
+
+   else
+#endif
+      png_read_data(png_ptr, buf, 8);
+
    length = png_get_uint_31(png_ptr, buf);
    png_ptr->chunk_name = chunk_name = PNG_CHUNK_FROM_STRING(buf+4);
 
@@ -3266,6 +3285,11 @@ png_combine_row(png_const_structrp png_ptr, png_bytep dp, int display)
    if (pixel_depth == 0)
       png_error(png_ptr, "internal row logic error");
 
+#ifdef PNG_READ_REGION_SUPPORTED
+   if (png_ptr->region_width != 0)
+      row_width = png_ptr->region_width;
+#endif
+
    /* Added in 1.5.4: the pixel depth should match the information returned by
     * any call to png_read_update_info at this point.  Do not continue if we got
     * this wrong.
@@ -3495,7 +3519,7 @@ png_combine_row(png_const_structrp png_ptr, png_bytep dp, int display)
 
       else /* pixel_depth >= 8 */
       {
-         unsigned int bytes_to_copy, bytes_to_jump;
+         unsigned int offset, bytes_to_copy, bytes_to_jump;
 
          /* Validate the depth - it must be a multiple of 8 */
          if (pixel_depth & 7)
@@ -3508,13 +3532,7 @@ png_combine_row(png_const_structrp png_ptr, png_bytep dp, int display)
           * fixed number of pixels to copy then to skip.  There may be a
           * different number of pixels to skip at the start though.
           */
-         {
-            unsigned int offset = PNG_PASS_START_COL(pass) * pixel_depth;
-
-            row_width -= offset;
-            dp += offset;
-            sp += offset;
-         }
+         offset = PNG_PASS_START_COL(pass) * pixel_depth;
 
          /* Work out the bytes to copy. */
          if (display != 0)
@@ -3524,10 +3542,6 @@ png_combine_row(png_const_structrp png_ptr, png_bytep dp, int display)
              * passes are skipped above - the entire expanded row is copied.
              */
             bytes_to_copy = (1<<((6-pass)>>1)) * pixel_depth;
-
-            /* But don't allow this number to exceed the actual row width. */
-            if (bytes_to_copy > row_width)
-               bytes_to_copy = (unsigned int)/*SAFE*/row_width;
          }
 
          else /* normal row; Adam7 only ever gives us one pixel to copy. */
@@ -3536,180 +3550,82 @@ png_combine_row(png_const_structrp png_ptr, png_bytep dp, int display)
          /* In Adam7 there is a constant offset between where the pixels go. */
          bytes_to_jump = PNG_PASS_COL_OFFSET(pass) * pixel_depth;
 
-         /* And simply copy these bytes.  Some optimization is possible here,
-          * depending on the value of 'bytes_to_copy'.  Special case the low
-          * byte counts, which we know to be frequent.
+#ifdef PNG_READ_TRANSFORMS_SUPPORTED
+         /* The vector version does the whole row at once. */
+         if (png_ptr->read_combine_row != NULL &&
+             png_ptr->read_combine_row(dp, sp, row_width, offset,
+                bytes_to_copy, bytes_to_jump) != 0)
+            return;
+#endif
+
+         row_width -= offset;
+         dp += offset;
+         sp += offset;
+
+         /* But don't allow this number to exceed the actual row width. */
+         if (bytes_to_copy > row_width)
+            bytes_to_copy = (unsigned int)/*SAFE*/row_width;
+
+         /* And simply copy these bytes.  Each of the common sizes has its own
+          * loop, so that the copy is a constant number of bytes; only the last
+          * copy can be cut short by the end of the row.
           *
           * Notice that these cases all 'return' rather than 'break' - this
           * avoids an unnecessary test on whether to restore the last byte
           * below.
           */
+#        define PNG_COMBINE_BYTES(n)\
+            for (;;)\
+            {\
+               memcpy(dp, sp, (n));\
+               if (row_width <= bytes_to_jump)\
+                  return;\
+               dp += bytes_to_jump;\
+               sp += bytes_to_jump;\
+               row_width -= bytes_to_jump;\
+               if (row_width < (n))\
+               {\
+                  memcpy(dp, sp, row_width);\
+                  return;\
+               }\
+            }
+
          switch (bytes_to_copy)
          {
             case 1:
-               for (;;)
-               {
-                  *dp = *sp;
-
-                  if (row_width <= bytes_to_jump)
-                     return;
-
-                  dp += bytes_to_jump;
-                  sp += bytes_to_jump;
-                  row_width -= bytes_to_jump;
-               }
+               PNG_COMBINE_BYTES(1)
 
             case 2:
-               /* There is a possibility of a partial copy at the end here; this
-                * slows the code down somewhat.
-                */
-               do
-               {
-                  dp[0] = sp[0]; dp[1] = sp[1];
-
-                  if (row_width <= bytes_to_jump)
-                     return;
-
-                  sp += bytes_to_jump;
-                  dp += bytes_to_jump;
-                  row_width -= bytes_to_jump;
-               }
-               while (row_width > 1);
-
-               /* And there can only be one byte left at this point: */
-               *dp = *sp;
-               return;
+               PNG_COMBINE_BYTES(2)
 
             case 3:
-               /* This can only be the RGB case, so each copy is exactly one
-                * pixel and it is not necessary to check for a partial copy.
-                */
-               for (;;)
-               {
-                  dp[0] = sp[0]; dp[1] = sp[1]; dp[2] = sp[2];
-
-                  if (row_width <= bytes_to_jump)
-                     return;
-
-                  sp += bytes_to_jump;
-                  dp += bytes_to_jump;
-                  row_width -= bytes_to_jump;
-               }
-
-            default:
-#if PNG_ALIGN_TYPE != PNG_ALIGN_NONE
-               /* Check for double byte alignment and, if possible, use a
-                * 16-bit copy.  Don't attempt this for narrow images - ones that
-                * are less than an interlace panel wide.  Don't attempt it for
-                * wide bytes_to_copy either - use the memcpy there.
-                */
-               if (bytes_to_copy < 16 /*else use memcpy*/ &&
-                   png_isaligned(dp, png_uint_16) &&
-                   png_isaligned(sp, png_uint_16) &&
-                   bytes_to_copy % (sizeof (png_uint_16)) == 0 &&
-                   bytes_to_jump % (sizeof (png_uint_16)) == 0)
-               {
-                  /* Everything is aligned for png_uint_16 copies, but try for
-                   * png_uint_32 first.
-                   */
-                  if (png_isaligned(dp, png_uint_32) &&
-                      png_isaligned(sp, png_uint_32) &&
-                      bytes_to_copy % (sizeof (png_uint_32)) == 0 &&
-                      bytes_to_jump % (sizeof (png_uint_32)) == 0)
-                  {
-                     png_uint_32p dp32 = png_aligncast(png_uint_32p,dp);
-                     png_const_uint_32p sp32 = png_aligncastconst(
-                         png_const_uint_32p, sp);
-                     size_t skip = (bytes_to_jump-bytes_to_copy) /
-                         (sizeof (png_uint_32));
-
-                     do
-                     {
-                        size_t c = bytes_to_copy;
-                        do
-                        {
-                           *dp32++ = *sp32++;
-                           c -= (sizeof (png_uint_32));
-                        }
-                        while (c > 0);
-
-                        if (row_width <= bytes_to_jump)
-                           return;
+               PNG_COMBINE_BYTES(3)
 
-                        dp32 += skip;
-                        sp32 += skip;
-                        row_width -= bytes_to_jump;
-                     }
-                     while (bytes_to_copy <= row_width);
-
-                     /* Get to here when the row_width truncates the final copy.
-                      * There will be 1-3 bytes left to copy, so don't try the
-                      * 16-bit loop below.
-                      */
-                     dp = (png_bytep)dp32;
-                     sp = (png_const_bytep)sp32;
-                     do
-                        *dp++ = *sp++;
-                     while (--row_width > 0);
-                     return;
-                  }
+            case 4:
+               PNG_COMBINE_BYTES(4)
 
-                  /* Else do it in 16-bit quantities, but only if the size is
-                   * not too large.
-                   */
-                  else
-                  {
-                     png_uint_16p dp16 = png_aligncast(png_uint_16p, dp);
-                     png_const_uint_16p sp16 = png_aligncastconst(
-                        png_const_uint_16p, sp);
-                     size_t skip = (bytes_to_jump-bytes_to_copy) /
-                        (sizeof (png_uint_16));
+            case 6:
+               PNG_COMBINE_BYTES(6)
 
-                     do
-                     {
-                        size_t c = bytes_to_copy;
-                        do
-                        {
-                           *dp16++ = *sp16++;
-                           c -= (sizeof (png_uint_16));
-                        }
-                        while (c > 0);
+            case 8:
+               PNG_COMBINE_BYTES(8)
 
-                        if (row_width <= bytes_to_jump)
-                           return;
+            case 12:
+               PNG_COMBINE_BYTES(12)
 
-                        dp16 += skip;
-                        sp16 += skip;
-                        row_width -= bytes_to_jump;
-                     }
-                     while (bytes_to_copy <= row_width);
-
-                     /* End of row - 1 byte left, bytes_to_copy > row_width: */
-                     dp = (png_bytep)dp16;
-                     sp = (png_const_bytep)sp16;
-                     do
-                        *dp++ = *sp++;
-                     while (--row_width > 0);
-                     return;
-                  }
-               }
-#endif /* ALIGN_TYPE code */
+            case 16:
+               PNG_COMBINE_BYTES(16)
 
-               /* The true default - use a memcpy: */
-               for (;;)
-               {
-                  memcpy(dp, sp, bytes_to_copy);
+            case 24:
+               PNG_COMBINE_BYTES(24)
 
-                  if (row_width <= bytes_to_jump)
-                     return;
+            case 32:
+               PNG_COMBINE_BYTES(32)
 
-                  sp += bytes_to_jump;
-                  dp += bytes_to_jump;
-                  row_width -= bytes_to_jump;
-                  if (bytes_to_copy > row_width)
-                     bytes_to_copy = (unsigned int)/*SAFE*/row_width;
-               }
+            default:
+               PNG_COMBINE_BYTES(bytes_to_copy)
          }
+#        undef PNG_COMBINE_BYTES
 
          /* NOT REACHED*/
       } /* pixel_depth >= 8 */
@@ -3972,6 +3888,122 @@ png_do_read_interlace(png_row_infop row_info, png_bytep row, int pass,
    PNG_UNUSED(transformations)  /* Silence compiler warning */
 #endif
 }
+
+void /* PRIVATE */
+png_do_read_deinterlace(png_const_structrp png_ptr, png_row_infop row_info,
+    png_bytep dp)
+{
+   unsigned int pass = png_ptr->pass;
+   unsigned int pixel_depth = row_info->pixel_depth;
+   png_const_bytep sp = png_ptr->row_buf + 1;
+   png_uint_32 width = row_info->width; /* pixels in the pass */
+   png_uint_32 step, i;
+
+   png_debug(1, "in png_do_read_deinterlace");
+
+   /* The last pass has every pixel of its rows. */
+   if (pass >= 6)
+   {
+      png_combine_row(png_ptr, dp, 0/*row*/);
+      return;
+   }
+
+   /* The same check as png_combine_row on the width of the whole row. */
+   if (png_ptr->info_rowbytes != 0 && png_ptr->info_rowbytes !=
+          PNG_ROWBYTES(pixel_depth, png_ptr->width))
+      png_error(png_ptr, "internal row size calculation error");
+
+   step = PNG_PASS_COL_OFFSET(pass);
+
+   if (pixel_depth < 8)
+   {
+      /* Each pixel is stored on its own, so the bits of the other pixels in
+       * the byte, and any unused bits at the end of the row, are kept.  PNG
+       * puts the first pixel in the high bits, PACKSWAP in the low bits.
+       */
+      unsigned int mask = (1U << pixel_depth) - 1;
+      unsigned int flip = 8 - pixel_depth;
+      png_uint_32 x = PNG_PASS_START_COL(pass);
+
+#     ifdef PNG_READ_PACKSWAP_SUPPORTED
+      if ((png_ptr->transformations & PNG_PACKSWAP) != 0)
+         flip = 0;
+#     endif
+
+      for (i = 0; i < width; ++i, x += step)
+      {
+         size_t sbit = (size_t)i * pixel_depth;
+         size_t dbit = (size_t)x * pixel_depth;
+         unsigned int sshift = (unsigned int)(sbit & 7) ^ flip;
+         unsigned int dshift = (unsigned int)(dbit & 7) ^ flip;
+         unsigned int v = (sp[sbit >> 3] >> sshift) & mask;
+
+         dp[dbit >> 3] = (png_byte)((dp[dbit >> 3] & ~(mask << dshift)) |
+             (v << dshift));
+      }
+   }
+
+   else
+   {
+      unsigned int pixel_bytes;
+      size_t jump;
+
+      if (pixel_depth & 7)
+         png_error(png_ptr, "invalid user transform pixel depth");
+
+      pixel_bytes = pixel_depth >> 3;
+      jump = (size_t)step * pixel_bytes;
+      i = 0;
+
+#     ifdef PNG_READ_TRANSFORMS_SUPPORTED
+      if (png_ptr->read_deinterlace != NULL)
+         i = png_ptr->read_deinterlace(dp, sp, width, pixel_bytes,
+             (int)pass);
+#     endif
+
+      dp += (PNG_PASS_START_COL(pass) + (size_t)i * step) * pixel_bytes;
+      sp += (size_t)i * pixel_bytes;
+
+      /* The constant sizes let the compiler use single moves. */
+      switch (pixel_bytes)
+      {
+         case 1:
+            for (; i < width; ++i, dp += jump)
+               *dp = *sp++;
+            break;
+
+         case 2:
+            for (; i < width; ++i, dp += jump, sp += 2)
+               memcpy(dp, sp, 2);
+            break;
+
+         case 3:
+            for (; i < width; ++i, dp += jump, sp += 3)
+               memcpy(dp, sp, 3);
+            break;
+
+         case 4:
+            for (; i < width; ++i, dp += jump, sp += 4)
+               memcpy(dp, sp, 4);
+            break;
+
+         case 6:
+            for (; i < width; ++i, dp += jump, sp += 6)
+               memcpy(dp, sp, 6);
+            break;
+
+         case 8:
+            for (; i < width; ++i, dp += jump, sp += 8)
+               memcpy(dp, sp, 8);
+            break;
+
+         default:
+            for (; i < width; ++i, dp += jump, sp += pixel_bytes)
+               memcpy(dp, sp, pixel_bytes);
+            break;
+      }
+   }
+}
 #endif /* READ_INTERLACING */
 
 static void
@@ -4192,11 +4224,550 @@ png_read_filter_row(png_structrp pp, png_row_infop row_info, png_bytep row,
 }
 
 #ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+/* Parallel IDAT inflate.  An encoder which uses Z_FULL_FLUSH (for example to
+ * allow random access or to compress in parallel) produces a deflate stream
+ * where the LZ77 window is reset at each flush point; each flush ends with an
+ * empty stored block, the byte sequence 00 00 FF FF, so the stream can be
+ * split at these points and the pieces inflated independently.  All the IDAT
+ * chunks are read first, the pieces are inflated by parallel jobs and the
+ * results are checked.  If anything does not match, including a false match
+ * on the byte sequence or a stream which was only sync-flushed (back
+ * references cross the split), the gathered data is simply inflated serially
+ * in the normal way.
+ */
+#ifndef PNG_INFLATE_SEGMENTS_MAX
+#  define PNG_INFLATE_SEGMENTS_MAX 64
+#endif
+
+typedef struct
+{
+   png_const_structrp png_ptr;   /* for memory allocation only */
+   png_const_bytep    input;     /* raw deflate data */
+   png_alloc_size_t   input_size;
+   png_bytep          output;    /* inflated data */
+   png_alloc_size_t   output_size;
+   png_alloc_size_t   output_max; /* limit on output_size */
+   uLong              adler;     /* Adler-32 of output */
+   int                last;      /* segment ends the zlib stream */
+   int                ok;        /* set by the job on success */
+} png_inflate_segment;
+
+typedef struct
+{
+   png_uint_32         count;    /* number of segments */
+   png_uint_32         current;  /* segment being copied to the caller */
+   png_alloc_size_t    offset;   /* offset in current segment */
+   png_inflate_segment segment[PNG_INFLATE_SEGMENTS_MAX];
+} png_inflate_segments;
+
+typedef png_inflate_segments *png_inflate_segmentsp;
+
+/* Return the size of the filtered image data or 0 on overflow. */
+static png_alloc_size_t
+png_filtered_image_size(png_const_structrp png_ptr)
+{
+   png_alloc_size_t size = 0;
+   int pass = png_ptr->interlaced == PNG_INTERLACE_ADAM7 ? 0 : 6;
+
+   for (; pass < 7; ++pass)
+   {
+      png_uint_32 width = png_ptr->width, height = png_ptr->height;
+      png_alloc_size_t rowbytes;
+
+      if (png_ptr->interlaced == PNG_INTERLACE_ADAM7)
+      {
+         width = PNG_PASS_COLS(width, pass);
+         height = PNG_PASS_ROWS(height, pass);
+      }
+
+      if (width == 0 || height == 0)
+         continue;
+
+      rowbytes = PNG_ROWBYTES(png_ptr->pixel_depth, width) + 1;
+
+      if (rowbytes > (PNG_SIZE_MAX - size) / height)
+         return 0;
+
+      size += rowbytes * height;
+   }
+
+   return size;
+}
+
+static void PNGCBAPI
+png_inflate_segment_job(png_voidp job_arg, png_uint_32 job_number)
+{
+   png_inflate_segmentsp segs = png_voidcast(png_inflate_segmentsp, job_arg);
+   png_inflate_segment *seg = segs->segment + job_number;
+   png_const_bytep next_in = seg->input;
+   png_alloc_size_t avail_in = seg->input_size;
+   png_alloc_size_t capacity = 0;
+   z_stream zs;
+   int ret;
+
+   memset(&zs, 0, (sizeof zs));
+   zs.zalloc = png_parallel_zalloc;
+   zs.zfree = png_parallel_zfree;
+   zs.opaque = png_constcast(png_structrp, seg->png_ptr);
+
+   if (inflateInit2(&zs, -15) != Z_OK)
+      return;
+
+   for (;;)
+   {
+      uInt in, out;
+
+      if (seg->output_size == capacity)
+      {
+         /* Grow the output buffer; start with a guess at the ratio. */
+         png_alloc_size_t new_capacity = seg->output_max;
+         png_bytep new_output;
+
+         if (capacity == 0)
+         {
+            if (seg->input_size < (PNG_SIZE_MAX - 4096) / 4)
+               new_capacity = 4 * seg->input_size + 4096;
+         }
+
+         else if (capacity < PNG_SIZE_MAX / 2)
+            new_capacity = 2 * capacity;
+
+         if (new_capacity > seg->output_max)
+            new_capacity = seg->output_max;
+
+         if (new_capacity <= capacity)
+            break; /* too much data */
+
+         new_output = png_voidcast(png_bytep,
+             png_malloc_base(seg->png_ptr, new_capacity));
+
+         if (new_output == NULL)
+            break;
+
+         if (seg->output_size > 0)
+            memcpy(new_output, seg->output, seg->output_size);
+
+         png_free(seg->png_ptr, seg->output);
+         seg->output = new_output;
+         capacity = new_capacity;
+      }
+
+      in = ZLIB_IO_MAX;
+      if (in > avail_in)
+         in = (uInt)avail_in;
+
+      out = ZLIB_IO_MAX;
+      if (out > capacity - seg->output_size)
+         out = (uInt)(capacity - seg->output_size);
+
+      zs.next_in = PNGZ_INPUT_CAST(next_in);
+      zs.avail_in = in;
+      zs.next_out = seg->output + seg->output_size;
+      zs.avail_out = out;
+
+      ret = inflate(&zs, Z_NO_FLUSH);
+
+      next_in += in - zs.avail_in;
+      avail_in -= in - zs.avail_in;
+      seg->output_size += out - zs.avail_out;
+
+      if (ret == Z_STREAM_END)
+      {
+         /* Only the last segment may end the stream and it must be followed
+          * by exactly the Adler-32.
+          */
+         seg->ok = seg->last && avail_in == 4;
+         break;
+      }
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+         break;
+
+      if (avail_in == 0 && zs.avail_out > 0)
+      {
+         /* All the input has been used; the stream must be at a block
+          * boundary which is byte aligned and not in the final block.
+          */
+         seg->ok = !seg->last && (zs.data_type & 0x1ff) == 128;
+         break;
+      }
+   }
+
+   (void)inflateEnd(&zs);
+
+   if (seg->ok)
+      seg->adler = png_adler32(seg->output, seg->output_size);
+}
+
+static void
+png_free_IDAT_segments(png_structrp png_ptr)
+{
+   png_inflate_segmentsp segs =
+      png_voidcast(png_inflate_segmentsp, png_ptr->idat_segments);
+
+   if (segs != NULL)
+   {
+      png_uint_32 i;
+
+      png_ptr->idat_segments = NULL;
+
+      for (i = 0; i < segs->count; ++i)
+         png_free(png_ptr, segs->segment[i].output);
+
+      png_free(png_ptr, segs);
+   }
+}
+
+void /* PRIVATE */
+png_read_free_IDAT_data(png_structrp png_ptr)
+{
+   png_free_IDAT_segments(png_ptr);
+   png_free(png_ptr, png_ptr->idat_data);
+   png_ptr->idat_data = NULL;
+   png_ptr->idat_data_size = png_ptr->idat_data_used = 0;
+}
+
+/* Split the gathered zlib stream at full flush points and inflate the pieces
+ * in parallel.  On success png_struct::idat_segments holds the whole of the
+ * filtered image data.
+ */
+static void
+png_inflate_IDAT_parallel(png_structrp png_ptr)
+{
+   png_const_bytep data = png_ptr->idat_data;
+   png_alloc_size_t size = png_ptr->idat_data_size;
+   png_alloc_size_t expected, target, start, i, total;
+   png_inflate_segmentsp segs;
+   uLong adler;
+
+   /* The zlib header must be valid and must not require a dictionary;
+    * otherwise leave it to inflate to report the problem.
+    */
+   if (size < 2+4+4 || (data[0] & 0x0f) != Z_DEFLATED || (data[0] >> 4) > 7 ||
+       (data[0] * 256U + data[1]) % 31U != 0 || (data[1] & 0x20) != 0)
+      return;
+
+   expected = png_filtered_image_size(png_ptr);
+
+   if (expected == 0)
+      return;
+
+   segs = png_voidcast(png_inflate_segmentsp,
+       png_malloc_base(png_ptr, (sizeof *segs)));
+
+   if (segs == NULL)
+      return;
+
+   memset(segs, 0, (sizeof *segs));
+   png_ptr->idat_segments = segs;
+
+   /* Cut the data after the 00 00 FF FF markers, but not into more than
+    * PNG_INFLATE_SEGMENTS_MAX pieces of roughly equal size.
+    */
+   size -= 4; /* Adler-32 */
+   target = (size - 2) / PNG_INFLATE_SEGMENTS_MAX + 1;
+   start = 2;
+
+   for (i = start; i + 4 <= size; ++i)
+   {
+      if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 0xff &&
+          data[i+3] == 0xff && i + 4 - start >= target && i + 4 < size &&
+          segs->count + 1 < PNG_INFLATE_SEGMENTS_MAX)
+      {
+         segs->segment[segs->count].input = data + start;
+         segs->segment[segs->count].input_size = i + 4 - start;
+         segs->count++;
+         start = i + 4;
+         i += 3;
+      }
+   }
+
+   if (segs->count == 0)
+   {
+      /* No restart points. */
+      png_free_IDAT_segments(png_ptr);
+      return;
+   }
+
+   segs->segment[segs->count].input = data + start;
+   segs->segment[segs->count].input_size = size + 4 - start;
+   segs->segment[segs->count].last = 1;
+   segs->count++;
+
+   for (i = 0; i < segs->count; ++i)
+   {
+      segs->segment[i].png_ptr = png_ptr;
+      segs->segment[i].output_max = expected;
+   }
+
+   png_run_parallel(png_ptr, png_inflate_segment_job, segs, segs->count);
+
+   /* Check the results: the total must be exactly the image size. */
+   total = 0;
+   adler = adler32(0, Z_NULL, 0);
+
+   for (i = 0; i < segs->count; ++i)
+   {
+      png_inflate_segment *seg = segs->segment + i;
+
+      if (!seg->ok || seg->output_size > expected - total)
+         break;
+
+      total += seg->output_size;
+      adler = adler32_combine(adler, seg->adler, (z_off_t)seg->output_size);
+   }
+
+   if (i == segs->count && total == expected)
+   {
+      png_const_bytep trailer = data + size;
+      png_uint_32 stored = png_get_uint_32(trailer);
+
+#     ifdef PNG_IGNORE_ADLER32
+         if (((png_ptr->options >> PNG_IGNORE_ADLER32) & 3) == PNG_OPTION_ON)
+            stored = (png_uint_32)adler;
+#     endif
+
+      if (stored == (png_uint_32)adler)
+      {
+         /* Success: the compressed data is no longer required. */
+         png_free(png_ptr, png_ptr->idat_data);
+         png_ptr->idat_data = NULL;
+         png_ptr->idat_data_size = png_ptr->idat_data_used = 0;
+
+         png_ptr->mode |= PNG_AFTER_IDAT;
+         png_ptr->flags |= PNG_FLAG_ZSTREAM_ENDED;
+         return;
+      }
+   }
+
+   png_free_IDAT_segments(png_ptr);
+}
+
+#ifdef PNG_READ_DEFLATE_CODEC_SUPPORTED
+/* Decompress the gathered zlib stream with png_struct::deflate_codec into a
+ * single segment holding the whole of the filtered image data.  If this fails
+ * the stream is inflated in the normal way, which reports any error.
+ */
+static void
+png_inflate_IDAT_codec(png_structrp png_ptr)
+{
+   const png_deflate_codec *codec = png_ptr->deflate_codec;
+   png_alloc_size_t expected = png_filtered_image_size(png_ptr);
+   png_inflate_segmentsp segs;
+   png_bytep output;
+   int ok;
+
+#  ifdef PNG_IGNORE_ADLER32
+      /* The codecs always check the Adler-32. */
+      if (((png_ptr->options >> PNG_IGNORE_ADLER32) & 3) == PNG_OPTION_ON)
+         return;
+#  endif
+
+   if (expected == 0)
+      return;
+
+   if (png_ptr->deflate_codec_state == NULL)
+   {
+      png_ptr->deflate_codec_state = codec->init(png_ptr, 0, 0, 0);
+
+      if (png_ptr->deflate_codec_state == NULL)
+         return;
+   }
+
+   segs = png_voidcast(png_inflate_segmentsp,
+       png_malloc_base(png_ptr, (sizeof *segs)));
+
+   if (segs == NULL)
+      return;
+
+   memset(segs, 0, (sizeof *segs));
+   png_ptr->idat_segments = segs;
+
+   output = png_voidcast(png_bytep, png_malloc_base(png_ptr, expected));
+
+   if (output == NULL)
+   {
+      png_free_IDAT_segments(png_ptr);
+      return;
+   }
+
+   segs->segment[0].output = output;
+   segs->segment[0].output_size = expected;
+   segs->count = 1;
+
+   ok = codec->decompress(png_ptr->deflate_codec_state, png_ptr->idat_data,
+       png_ptr->idat_data_size, output, expected);
+   codec->reset(png_ptr->deflate_codec_state);
+
+   if (ok == 0)
+   {
+      png_free_IDAT_segments(png_ptr);
+      return;
+   }
+
+   png_free(png_ptr, png_ptr->idat_data);
+   png_ptr->idat_data = NULL;
+   png_ptr->idat_data_size = png_ptr->idat_data_used = 0;
+
+   png_ptr->mode |= PNG_AFTER_IDAT;
+   png_ptr->flags |= PNG_FLAG_ZSTREAM_ENDED;
+}
+#endif /* READ_DEFLATE_CODEC */
+
+/* Read all the remaining IDAT chunks into png_struct::idat_data, then try to
+ * inflate them with the deflate codec or in parallel.  This reads the header
+ * of the following chunk, which is replayed by the next call to
+ * png_read_chunk_header.
+ *
+ * Deflate adds only a few bytes per block to incompressible data, so the IDAT
+ * data of a valid image is never much larger than the filtered image.  The
+ * gathered data is limited to twice that plus 64K; beyond the limit the IDAT
+ * data is inflated serially, starting with what has been read, so a stream
+ * padded with gigabytes of IDAT data is not held in memory.
+ */
+static void
+png_read_IDAT_gather(png_structrp png_ptr)
+{
+   png_alloc_size_t capacity = 0;
+   png_alloc_size_t limit = png_filtered_image_size(png_ptr);
+
+   if (limit > (PNG_SIZE_MAX - 65536U) / 2)
+      limit = PNG_SIZE_MAX;
+
+   else
+      limit = 2 * limit + 65536U;
+
+   png_ptr->flags |= PNG_FLAG_IDAT_GATHERED;
+
+   for (;;)
+   {
+      png_uint_32 length = png_ptr->idat_size;
+
+      if (length > 0)
+      {
+         if (length > limit - png_ptr->idat_data_size)
+         {
+            /* The rest of this chunk and any that follow are read by
+             * png_read_IDAT_data once idat_data is used up.
+             */
+            png_ptr->flags |= PNG_FLAG_IDAT_PARTIAL;
+            return;
+         }
+
+         if (png_ptr->idat_data_size + length > capacity)
+         {
+            png_alloc_size_t new_capacity = png_ptr->idat_data_size + length;
+            png_bytep data;
+
+            if (capacity <= PNG_SIZE_MAX/2 && new_capacity < 2 * capacity)
+               new_capacity = 2 * capacity;
+
+            data = png_voidcast(png_bytep,
+                png_malloc_base(png_ptr, new_capacity));
+
+            if (data == NULL)
+               png_chunk_error(png_ptr, "out of memory");
+
+            if (png_ptr->idat_data_size > 0)
+               memcpy(data, png_ptr->idat_data, png_ptr->idat_data_size);
+
+            png_free(png_ptr, png_ptr->idat_data);
+            png_ptr->idat_data = data;
+            capacity = new_capacity;
+         }
+
+         png_crc_read(png_ptr, png_ptr->idat_data + png_ptr->idat_data_size,
+             length);
+         png_ptr->idat_data_size += length;
+         png_ptr->idat_size = 0;
+      }
+
+      png_crc_finish(png_ptr, 0);
+
+      length = png_read_chunk_header(png_ptr);
+
+      if (png_ptr->chunk_name != png_IDAT)
+      {
+         png_ptr->pending_chunk_length = length;
+         png_ptr->flags |= PNG_FLAG_CHUNK_HEADER_PENDING;
+         break;
+      }
+
+      png_ptr->idat_size = length;
+   }
+
+#ifdef PNG_READ_DEFLATE_CODEC_SUPPORTED
+   if (png_ptr->deflate_codec != NULL)
+      png_inflate_IDAT_codec(png_ptr);
+
+   if (png_ptr->idat_segments == NULL &&
+       ((png_ptr->options >> PNG_PARALLEL_INFLATE) & 3) == PNG_OPTION_ON)
+#endif
+      png_inflate_IDAT_parallel(png_ptr);
+}
+
+/* Copy data inflated by png_inflate_IDAT_parallel or png_inflate_IDAT_codec
+ * to the caller.
+ */
+static void
+png_read_IDAT_segments(png_structrp png_ptr, png_bytep output,
+    png_alloc_size_t avail_out)
+{
+   png_inflate_segmentsp segs =
+      png_voidcast(png_inflate_segmentsp, png_ptr->idat_segments);
+
+   while (avail_out > 0 && segs->current < segs->count)
+   {
+      png_inflate_segment *seg = segs->segment + segs->current;
+      png_alloc_size_t avail = seg->output_size - segs->offset;
+
+      if (avail > avail_out)
+         avail = avail_out;
+
+      memcpy(output, seg->output + segs->offset, avail);
+      output += avail;
+      avail_out -= avail;
+      segs->offset += avail;
+
+      if (segs->offset == seg->output_size)
+      {
+         /* Release the memory as soon as it has been used. */
+         png_free(png_ptr, seg->output);
+         seg->output = NULL;
+         segs->current++;
+         segs->offset = 0;
+      }
+   }
+
+   if (avail_out > 0) /* cannot happen: the total was checked */
+      png_error(png_ptr, "Not enough image data");
+}
+#endif /* PARALLEL_INFLATE */
+
 void /* PRIVATE */
 png_read_IDAT_data(png_structrp png_ptr, png_bytep output,
     png_alloc_size_t avail_out)
 {
    /* Loop reading IDATs and decompressing the result into output[avail_out] */
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+   if ((png_ptr->flags & PNG_FLAG_IDAT_GATHERED) == 0 && output != NULL &&
+       (((png_ptr->options >> PNG_PARALLEL_INFLATE) & 3) == PNG_OPTION_ON
+#     ifdef PNG_READ_DEFLATE_CODEC_SUPPORTED
+          || png_ptr->deflate_codec != NULL
+#     endif
+       ) && png_ptr->zstream.avail_in == 0 && png_ptr->zstream.total_in == 0)
+      png_read_IDAT_gather(png_ptr);
+
+   if (png_ptr->idat_segments != NULL)
+   {
+      if (output != NULL)
+         png_read_IDAT_segments(png_ptr, output, avail_out);
+
+      return;
+   }
+#endif
+
    png_ptr->zstream.next_out = output;
    png_ptr->zstream.avail_out = 0; /* safety: set below */
 
@@ -4211,44 +4782,94 @@ png_read_IDAT_data(png_structrp png_ptr, png_bytep output,
       if (png_ptr->zstream.avail_in == 0)
       {
          uInt avail_in;
-         png_bytep buffer;
 
-         while (png_ptr->idat_size == 0)
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+         if ((png_ptr->flags & PNG_FLAG_IDAT_GATHERED) != 0 &&
+             ((png_ptr->flags & PNG_FLAG_IDAT_PARTIAL) == 0 ||
+             png_ptr->idat_data_used < png_ptr->idat_data_size))
          {
-            png_crc_finish(png_ptr, 0);
-
-            png_ptr->idat_size = png_read_chunk_header(png_ptr);
-            /* This is an error even in the 'check' case because the code just
-             * consumed a non-IDAT header.
+            /* All the IDAT data, or all up to the gather limit, has been read
+             * already.
              */
-            if (png_ptr->chunk_name != png_IDAT)
+            png_alloc_size_t avail = png_ptr->idat_data_size -
+               png_ptr->idat_data_used;
+
+            if (avail == 0)
                png_error(png_ptr, "Not enough image data");
+
+            if (avail > ZLIB_IO_MAX)
+               avail = ZLIB_IO_MAX;
+
+            png_ptr->zstream.next_in = png_ptr->idat_data +
+               png_ptr->idat_data_used;
+            avail_in = (uInt)avail;
+            png_ptr->idat_data_used += avail;
          }
 
-         avail_in = png_ptr->IDAT_read_size;
+         else
+#endif
+         {
+            while (png_ptr->idat_size == 0)
+            {
+               png_crc_finish(png_ptr, 0);
 
-         if (avail_in > png_chunk_max(png_ptr))
-            avail_in = (uInt)/*SAFE*/png_chunk_max(png_ptr);
+               png_ptr->idat_size = png_read_chunk_header(png_ptr);
+               /* This is an error even in the 'check' case because the code
+                * just consumed a non-IDAT header.
+                */
+               if (png_ptr->chunk_name != png_IDAT)
+                  png_error(png_ptr, "Not enough image data");
+            }
 
-         if (avail_in > png_ptr->idat_size)
-            avail_in = (uInt)png_ptr->idat_size;
+            if (png_ptr->read_memory != NULL)
+            {
+               /* The whole PNG is in memory; inflate straight from it without
+                * copying to the read buffer.  IDAT_read_size does not apply
+                * because nothing is allocated.
+                */
+               png_const_bytep data;
 
-         /* A PNG with a gradually increasing IDAT size will defeat this attempt
-          * to minimize memory usage by causing lots of re-allocs, but
-          * realistically doing IDAT_read_size re-allocs is not likely to be a
-          * big problem.
-          *
-          * An error here corresponds to the system being out of memory.
-          */
-         buffer = png_read_buffer(png_ptr, avail_in);
+               avail_in = ZLIB_IO_MAX;
 
-         if (buffer == NULL)
-            png_chunk_error(png_ptr, "out of memory");
+               if (avail_in > png_ptr->idat_size)
+                  avail_in = (uInt)png_ptr->idat_size;
 
-         png_crc_read(png_ptr, buffer, avail_in);
-         png_ptr->idat_size -= avail_in;
+               data = png_read_data_in_place(png_ptr, avail_in);
+               png_calculate_crc(png_ptr, data, avail_in);
+               png_ptr->zstream.next_in = PNGZ_INPUT_CAST(data);
+            }
+
+            else
+            {
+               png_bytep buffer;
+
+               avail_in = png_ptr->IDAT_read_size;
+
+               if (avail_in > png_chunk_max(png_ptr))
+                  avail_in = (uInt)/*SAFE*/png_chunk_max(png_ptr);
+
+               if (avail_in > png_ptr->idat_size)
+                  avail_in = (uInt)png_ptr->idat_size;
+
+               /* A PNG with a gradually increasing IDAT size will defeat this
+                * attempt to minimize memory usage by causing lots of
+                * re-allocs, but realistically doing IDAT_read_size re-allocs
+                * is not likely to be a big problem.
+                *
+                * An error here corresponds to the system being out of memory.
+                */
+               buffer = png_read_buffer(png_ptr, avail_in);
+
+               if (buffer == NULL)
+                  png_chunk_error(png_ptr, "out of memory");
+
+               png_crc_read(png_ptr, buffer, avail_in);
+               png_ptr->zstream.next_in = buffer;
+            }
+
+            png_ptr->idat_size -= avail_in;
+         }
 
-         png_ptr->zstream.next_in = buffer;
          png_ptr->zstream.avail_in = avail_in;
       }
 
@@ -4296,7 +4917,11 @@ png_read_IDAT_data(png_structrp png_ptr, png_bytep output,
          png_ptr->mode |= PNG_AFTER_IDAT;
          png_ptr->flags |= PNG_FLAG_ZSTREAM_ENDED;
 
-         if (png_ptr->zstream.avail_in > 0 || png_ptr->idat_size > 0)
+         if (png_ptr->zstream.avail_in > 0 || png_ptr->idat_size > 0
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+             || png_ptr->idat_data_used < png_ptr->idat_data_size
+#endif
+            )
             png_chunk_benign_error(png_ptr, "Extra compressed data");
          break;
       }
@@ -4368,6 +4993,19 @@ png_read_finish_IDAT(png_structrp png_ptr)
       /* Now we no longer own the zstream. */
       png_ptr->zowner = 0;
 
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+      if ((png_ptr->flags & PNG_FLAG_IDAT_GATHERED) != 0)
+      {
+         png_read_free_IDAT_data(png_ptr);
+
+         /* Unless the limit was reached all the IDAT chunks have been read and
+          * checked already.
+          */
+         if ((png_ptr->flags & PNG_FLAG_IDAT_PARTIAL) == 0)
+            return;
+      }
+#endif
+
       /* The slightly weird semantics of the sequential IDAT reading is that we
        * are always in or at the end of an IDAT chunk, so we always need to do a
        * crc_finish here.  If idat_size is non-zero we also need to read the
@@ -4436,8 +5074,15 @@ png_read_start_row(png_structrp png_ptr)
 
    png_debug(1, "in png_read_start_row");
 
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+   /* Set again by png_read_image or png_read_rows_into if it applies. */
+   png_ptr->flags &= ~PNG_FLAG_FUSED_ROWS;
+   png_ptr->fused_prev_row = NULL;
+#endif
+
 #ifdef PNG_READ_TRANSFORMS_SUPPORTED
    png_init_read_transformations(png_ptr);
+   png_build_read_transformations(png_ptr);
 #endif
    if (png_ptr->interlaced != 0)
    {
@@ -1849,6 +1849,22 @@ png_set_chunk_malloc_max(png_structrp png_ptr,
 }
 #endif /* ?SET_USER_LIMITS */
 
+#ifdef PNG_PARALLEL_SUPPORTED
+/* This function was added to libpng 1.6.49 */
+void PNGAPI
+png_set_parallel_fn(png_structrp png_ptr, png_voidp parallel_ptr,
+    png_parallel_ptr parallel_fn)
+{
+   png_debug(1, "in png_set_parallel_fn");
+
+   if (png_ptr == NULL)
+      return;
+
+   png_ptr->parallel_ptr = parallel_ptr;
+   png_ptr->parallel_fn = parallel_fn;
+}
+#endif /* PARALLEL */
+
 
 #ifdef PNG_BENIGN_ERRORS_SUPPORTED
 void PNGAPI
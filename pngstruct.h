@@ -283,6 +283,10 @@ struct png_struct_def
 
    png_bytep gamma_table;     /* gamma table for 8-bit depth files */
    png_uint_16pp gamma_16_table; /* gamma table for 16-bit depth files */
+   png_voidp gamma_table_wide; /* the table in one block for read_gamma_8/16 */
+#ifdef PNG_GAMMA_CACHE_SUPPORTED
+   png_byte gamma_cached;     /* the tables are shared, see png_build_gamma_table */
+#endif
 #if defined(PNG_READ_BACKGROUND_SUPPORTED) || \
    defined(PNG_READ_ALPHA_MODE_SUPPORTED) || \
    defined(PNG_READ_RGB_TO_GRAY_SUPPORTED)
@@ -325,6 +329,14 @@ struct png_struct_def
    size_t current_buffer_size;       /* amount of data now in current_buffer */
    int process_mode;                 /* what push library is currently doing */
    int cur_palette;                  /* current push library palette index */
+#ifdef PNG_PULL_READ_SUPPORTED
+   int pull_state;                   /* last png_pull_row result, 0 if unused */
+   png_uint_32 pull_rows;            /* rows of row_buf not yet returned */
+   png_uint_32 pull_row_number;      /* row number of the first of these */
+   png_uint_32 pull_saved_row_number;/* reader's row_number and pass while */
+   png_byte pull_pass;               /* pass of the rows */
+   png_byte pull_saved_pass;         /* a returned row's values are set */
+#endif
 #endif /* PROGRESSIVE_READ */
 
 #ifdef PNG_READ_QUANTIZE_SUPPORTED
@@ -461,5 +473,160 @@ struct png_struct_def
 /* New member added in libpng-1.5.7 */
    void (*read_filter[PNG_FILTER_VALUE_LAST-1])(png_row_infop row_info,
       png_bytep row, png_const_bytep prev_row);
+
+#ifdef PNG_PARALLEL_SUPPORTED
+/* New members added in libpng-1.6.49 */
+   png_voidp        parallel_ptr;     /* application data for parallel_fn */
+   png_parallel_ptr parallel_fn;      /* runs a batch of independent jobs */
+#endif
+
+#ifdef PNG_PARALLEL_INFLATE_SUPPORTED
+   /* With PNG_PARALLEL_INFLATE all the IDAT chunks are read at once; this
+    * requires reading the header of the following chunk early.
+    */
+   png_uint_32      pending_chunk_length; /* length of the chunk read early */
+   png_bytep        idat_data;        /* the concatenated IDAT data */
+   png_alloc_size_t idat_data_size;   /* bytes in idat_data */
+   png_alloc_size_t idat_data_used;   /* bytes passed to inflate so far */
+   png_voidp        idat_segments;    /* the parallel inflate results */
+#endif
+
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+   png_uint_32      IDAT_band_rows;   /* rows per IDAT band, 0 for none */
+   png_uint_32      IDAT_band_jobs;   /* bands compressed at once */
+   png_voidp        IDAT_bands;       /* the band compression state */
+#endif
+
+#ifdef PNG_READ_SUPPORTED
+   /* Set by png_set_read_memory; the unread part of the PNG in memory. */
+   png_const_bytep  read_memory;
+   size_t           read_memory_size;
+#endif
+
+#ifdef PNG_SEQUENTIAL_READ_SUPPORTED
+   /* With PNG_FLAG_FUSED_ROWS rows are unfiltered in the caller's buffer
+    * against the row before, which is also in the caller's image.
+    */
+   png_const_bytep  fused_prev_row;   /* the last row read, or NULL */
+#endif
+
+#ifdef PNG_READ_REGION_SUPPORTED
+   /* Set by png_set_read_region; region_width is 0 for the whole image. */
+   png_uint_32      region_x;
+   png_uint_32      region_y;
+   png_uint_32      region_width;
+   png_uint_32      region_height;
+#endif
+
+#ifdef PNG_CRC32_OPTIMIZATIONS
+   /* Set by PNG_CRC32_OPTIMIZATIONS to a function that updates the CRC over
+    * a multiple of 16 bytes, at least 64; NULL to use zlib's crc32.
+    */
+   png_uint_32 (*crc32_blocks)(png_uint_32 crc, png_const_bytep buf,
+       size_t length);
+#endif
+
+#ifdef PNG_WRITE_FILTER_SUPPORTED
+   /* Set by PNG_WRITE_FILTER_OPTIMIZATIONS, otherwise NULL: the first finds
+    * the sums of absolute differences of the five filters (in the order of
+    * the filter values) in one pass, the second applies one filter to a row.
+    */
+   void (*write_filter_sums)(png_const_bytep row, png_const_bytep prev_row,
+       size_t row_bytes, unsigned int bpp, size_t *sums);
+   void (*write_filter_row)(png_bytep filtered_row, png_const_bytep row,
+       png_const_bytep prev_row, size_t row_bytes, unsigned int bpp,
+       int filter);
+#endif
+
+#if defined(PNG_SIMPLIFIED_WRITE_SUPPORTED) &&\
+   defined(PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS)
+   /* Set by PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS, otherwise NULL: converts the
+    * first pixels of a row of 16-bit linear (premultiplied if alpha is not -1)
+    * samples to 8-bit sRGB and returns the number of pixels converted.
+    */
+   png_uint_32 (*write_sRGB_8)(png_bytep out, png_const_uint_16p in,
+       png_uint_32 width, unsigned int channels, int alpha);
+#endif
+
+#ifdef PNG_DEFLATE_CODEC_SUPPORTED
+   /* Set by png_set_deflate_codec; NULL for the zlib stream. */
+   const struct png_deflate_codec_struct *deflate_codec;
+   png_voidp        deflate_codec_state;
+#endif
+
+#ifdef PNG_READ_TRANSFORMS_SUPPORTED
+   /* The row transformation steps, see png_build_read_transformations. */
+   png_voidp        read_transforms;
+
+   /* Set by PNG_READ_TRANSFORM_OPTIMIZATIONS, otherwise NULL: applies the
+    * byte map of fused steps to a row, see png_do_byte_map.
+    */
+   void (*read_byte_map)(png_bytep row, png_uint_32 width,
+       unsigned int in_bytes, unsigned int out_bytes, png_const_bytep src,
+       png_const_bytep value);
+
+   /* Likewise for the palette expansion, see png_do_palette_map. */
+   void (*read_palette_map)(png_bytep row, png_uint_32 width,
+       unsigned int out_bytes, png_const_bytep palette_map);
+
+#ifdef PNG_READ_GAMMA_SUPPORTED
+   /* And for png_do_gamma on 8 and 16-bit rows, with the table in
+    * gamma_table_wide; see png_make_gamma_table_wide.
+    */
+   void (*read_gamma_8)(png_bytep row, size_t rowbytes,
+       unsigned int pixel_bytes, int alpha, png_const_uint_32p table);
+   void (*read_gamma_16)(png_bytep row, size_t rowbytes,
+       unsigned int pixel_bytes, int alpha, png_const_uint_16p table,
+       int shift);
+#endif
+
+#if defined(PNG_READ_BACKGROUND_SUPPORTED) ||\
+   defined(PNG_READ_ALPHA_MODE_SUPPORTED)
+   /* And for png_do_compose on 8-bit rows with alpha; 'tables' is NULL or
+    * gamma_table_wide.
+    */
+   void (*read_compose_8)(png_bytep row, size_t rowbytes,
+       unsigned int pixel_bytes, png_const_bytep background,
+       png_const_bytep background_1, png_const_uint_32p tables, int optimize);
+#endif
+
+#ifdef PNG_READ_RGB_TO_GRAY_SUPPORTED
+   /* And for png_do_rgb_to_gray on RGB and RGBA rows; 'tables' is NULL
+    * without gamma correction, else gamma_table_wide.  They return 1 if a
+    * pixel was not gray.
+    */
+   int (*read_rgb_to_gray_8)(png_bytep row, png_uint_32 width, int alpha,
+       png_uint_32 rc, png_uint_32 gc, png_const_uint_32p tables);
+   int (*read_rgb_to_gray_16)(png_bytep row, png_uint_32 width, int alpha,
+       png_uint_32 rc, png_uint_32 gc, png_const_uint_16p tables, int shift);
+#endif
+
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+   /* And for png_do_scale_16_to_8 on 16-bit rows. */
+   void (*read_scale_16_to_8)(png_bytep row, size_t rowbytes);
+#endif
+
+#ifdef PNG_READ_INTERLACING_SUPPORTED
+   /* And for png_do_read_deinterlace on pixels of whole bytes: stores the
+    * first pixels of the pass row 'sp' in 'row' and returns the number done.
+    */
+   png_uint_32 (*read_deinterlace)(png_bytep row, png_const_bytep sp,
+       png_uint_32 width, unsigned int pixel_bytes, int pass);
+
+   /* And for png_combine_row on interlaced rows of whole byte pixels: copies
+    * 'copy' bytes every 'jump' bytes, starting at 'offset', of the row_bytes
+    * of the row.  Returns 0 if it cannot do so.
+    */
+   int (*read_combine_row)(png_bytep dp, png_const_bytep sp, size_t row_bytes,
+       unsigned int offset, unsigned int copy, unsigned int jump);
+#endif
+#endif
+
+#ifdef PNG_WRITE_DEFLATE_CODEC_SUPPORTED
+   /* The filtered rows, compressed with deflate_codec at the end. */
+   png_bytep        IDAT_codec_data;
+   png_alloc_size_t IDAT_codec_size;  /* allocated size of IDAT_codec_data */
+   png_alloc_size_t IDAT_codec_used;
+#endif
 };
 #endif /* PNGSTRUCT_H */
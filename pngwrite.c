@@ -948,6 +948,29 @@ png_write_row(png_structrp png_ptr, png_const_bytep row)
       (*(png_ptr->write_row_fn))(png_ptr, png_ptr->row_number, png_ptr->pass);
 }
 
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+/* This function was added to libpng 1.6.49 */
+void PNGAPI
+png_set_compression_bands(png_structrp png_ptr, png_uint_32 band_rows,
+    png_uint_32 max_jobs)
+{
+   png_debug(1, "in png_set_compression_bands");
+
+   if (png_ptr == NULL)
+      return;
+
+   if (max_jobs == 0)
+      max_jobs = PNG_DEFAULT_BAND_JOBS;
+
+   /* Limit the memory used by the band array. */
+   else if (max_jobs > 1024)
+      max_jobs = 1024;
+
+   png_ptr->IDAT_band_rows = band_rows;
+   png_ptr->IDAT_band_jobs = max_jobs;
+}
+#endif /* PARALLEL_DEFLATE */
+
 #ifdef PNG_WRITE_FLUSH_SUPPORTED
 /* Set the automatic flush interval or 0 to turn flushing off */
 void PNGAPI
@@ -992,6 +1015,20 @@ png_write_destroy(png_structrp png_ptr)
 
    /* Free our memory.  png_free checks NULL for us. */
    png_free_buffer_list(png_ptr, &png_ptr->zbuffer_list);
+
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+   png_write_free_IDAT_bands(png_ptr);
+#endif
+
+#ifdef PNG_WRITE_DEFLATE_CODEC_SUPPORTED
+   png_free(png_ptr, png_ptr->IDAT_codec_data);
+   png_ptr->IDAT_codec_data = NULL;
+#endif
+
+#ifdef PNG_DEFLATE_CODEC_SUPPORTED
+   png_deflate_codec_end(png_ptr);
+#endif
+
    png_free(png_ptr, png_ptr->row_buf);
    png_ptr->row_buf = NULL;
 #ifdef PNG_WRITE_FILTER_SUPPORTED
@@ -1541,6 +1578,10 @@ png_image_write_init(png_imagep image)
             control->info_ptr = info_ptr;
             control->for_write = 1;
 
+#           ifdef PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS
+               PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS(png_ptr);
+#           endif
+
             image->opaque = control;
             return 1;
          }
@@ -1777,6 +1818,22 @@ png_write_image_8bit(png_voidp argument)
          png_const_uint_16p in_ptr = input_row;
          png_bytep out_ptr = output_row;
 
+#        ifdef PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS
+            if (png_ptr->write_sRGB_8 != NULL)
+            {
+               /* The kernel takes the start of the pixel and the index of the
+                * alpha channel in it.
+                */
+               int afirst = aindex < 0;
+               png_uint_32 done = png_ptr->write_sRGB_8(out_ptr - afirst,
+                   in_ptr - afirst, image->width, channels+1,
+                   afirst ? 0 : aindex);
+
+               in_ptr += done * (channels+1);
+               out_ptr += done * (channels+1);
+            }
+#        endif
+
          while (out_ptr < row_end)
          {
             png_uint_16 alpha = in_ptr[aindex];
@@ -1818,6 +1875,17 @@ png_write_image_8bit(png_voidp argument)
          png_const_uint_16p in_ptr = input_row;
          png_bytep out_ptr = output_row;
 
+#        ifdef PNG_SIMPLIFIED_WRITE_OPTIMIZATIONS
+            if (png_ptr->write_sRGB_8 != NULL)
+            {
+               png_uint_32 done = png_ptr->write_sRGB_8(out_ptr, in_ptr,
+                   image->width, channels, -1);
+
+               in_ptr += done * channels;
+               out_ptr += done * channels;
+            }
+#        endif
+
          while (out_ptr < row_end)
          {
             png_uint_32 component = *in_ptr++;
@@ -2155,6 +2223,18 @@ png_image_write_main(png_voidp argument)
       display->row_bytes = row_bytes;
    }
 
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+   /* Compress in bands of about 256KB if requested. */
+   if ((image->flags & PNG_IMAGE_FLAG_PARALLEL) != 0)
+   {
+      png_alloc_size_t row_size = (png_alloc_size_t)image->width *
+         PNG_IMAGE_PIXEL_CHANNELS(image->format) * (write_16bit ? 2U : 1U) + 1U;
+
+      png_set_compression_bands(png_ptr,
+          (png_uint_32)/*SAFE*/(262144U / row_size) + 1U, 0/*default*/);
+   }
+#endif
+
    /* Apply 'fast' options if the flag is set. */
    if ((image->flags & PNG_IMAGE_FLAG_FAST) != 0)
    {
@@ -944,10 +944,503 @@ png_write_PLTE(png_structrp png_ptr, png_const_colorp palette,
  * checking and (at the end) clearing png_ptr->zowner; it does some sanity
  * checks on the 'mode' flags while doing this.
  */
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+/* Band-parallel IDAT compression.  The filtered rows are collected into bands
+ * of (about) IDAT_band_rows rows and each band is compressed independently as
+ * raw deflate data terminated with Z_FULL_FLUSH, so the LZ77 window does not
+ * cross the band boundaries.  The concatenation of the band outputs, the zlib
+ * header and the combined Adler-32 is a valid zlib stream; the cost is a
+ * small loss of compression at each boundary.  Up to IDAT_band_jobs bands are
+ * compressed at once by png_run_parallel.
+ */
+typedef struct
+{
+   png_const_structrp png_ptr;   /* for memory allocation only */
+   png_const_bytep    input;     /* filtered rows */
+   png_alloc_size_t   input_size;
+   png_bytep          output;    /* raw deflate data */
+   png_alloc_size_t   output_size;
+   png_alloc_size_t   output_max; /* allocated size of output */
+   uLong              adler;     /* Adler-32 of input */
+   int                flush;     /* Z_FULL_FLUSH or Z_FINISH */
+   int                ok;        /* set by the job on success */
+} png_deflate_band;
+
+typedef struct
+{
+   int               level;      /* zlib parameters for every band */
+   int               window_bits;
+   int               mem_level;
+   int               strategy;
+   png_alloc_size_t  band_size;  /* close a band at this many bytes */
+   png_bytep         buffer;     /* filtered rows for all the bands */
+   png_alloc_size_t  buffer_used;
+   png_alloc_size_t  band_start; /* offset of the open band in buffer */
+   uLong             adler;      /* Adler-32 of everything compressed */
+   png_uint_32       max;        /* number of entries in band[] */
+   png_uint_32       count;      /* number of closed bands */
+   png_deflate_band  band[1];    /* actually band[max] */
+} png_deflate_bands;
+
+typedef png_deflate_bands *png_deflate_bandsp;
+
+static int
+png_IDAT_strategy(png_const_structrp png_ptr)
+{
+   if ((png_ptr->flags & PNG_FLAG_ZLIB_CUSTOM_STRATEGY) != 0)
+      return png_ptr->zlib_strategy;
+
+   else if (png_ptr->do_filter != PNG_FILTER_NONE)
+      return PNG_Z_DEFAULT_STRATEGY;
+
+   else
+      return PNG_Z_DEFAULT_NOFILTER_STRATEGY;
+}
+
+static void PNGCBAPI
+png_deflate_band_job(png_voidp job_arg, png_uint_32 job_number)
+{
+   png_deflate_bandsp bands = png_voidcast(png_deflate_bandsp, job_arg);
+   png_deflate_band *band = bands->band + job_number;
+   png_alloc_size_t avail_in = band->input_size;
+   png_alloc_size_t capacity;
+   z_stream zs;
+   int ret;
+
+   band->ok = 0;
+   band->output_size = 0;
+   band->adler = png_adler32(band->input, band->input_size);
+
+   memset(&zs, 0, (sizeof zs));
+   zs.zalloc = png_parallel_zalloc;
+   zs.zfree = png_parallel_zfree;
+   zs.opaque = png_constcast(png_structrp, band->png_ptr);
+
+   if (deflateInit2(&zs, bands->level, Z_DEFLATED, -bands->window_bits,
+       bands->mem_level, bands->strategy) != Z_OK)
+      return;
+
+   /* deflateBound does not allow for the empty stored block written by the
+    * flush, nor for the 'flush' marker of the final block.
+    */
+   capacity = deflateBound(&zs, (uLong)band->input_size) + 16;
+
+   if (band->output_max < capacity)
+   {
+      png_free(band->png_ptr, band->output);
+      band->output = png_voidcast(png_bytep,
+          png_malloc_base(band->png_ptr, capacity));
+      band->output_max = band->output != NULL ? capacity : 0;
+   }
+
+   if (band->output != NULL)
+   {
+      zs.next_in = PNGZ_INPUT_CAST(band->input);
+      zs.next_out = band->output;
+
+      do
+      {
+         uInt in = ZLIB_IO_MAX, out = ZLIB_IO_MAX;
+
+         if (in > avail_in)
+            in = (uInt)avail_in;
+
+         if (out > capacity - band->output_size)
+            out = (uInt)(capacity - band->output_size);
+
+         zs.avail_in = in;
+         zs.avail_out = out;
+         ret = deflate(&zs, in == avail_in ? band->flush : Z_NO_FLUSH);
+         avail_in -= in - zs.avail_in;
+         band->output_size += out - zs.avail_out;
+      }
+      while (ret == Z_OK && (avail_in > 0 || zs.avail_out == 0) &&
+             band->output_size < capacity);
+
+      band->ok = avail_in == 0 && zs.avail_out > 0 &&
+         (band->flush == Z_FINISH ? ret == Z_STREAM_END : ret == Z_OK);
+   }
+
+   (void)deflateEnd(&zs);
+}
+
+/* Append compressed data to the IDAT buffer, writing complete IDAT chunks. */
+static void
+png_write_IDAT_data(png_structrp png_ptr, png_const_bytep data,
+    png_alloc_size_t size)
+{
+   while (size > 0)
+   {
+      uInt avail = png_ptr->zstream.avail_out;
+
+      if (avail > size)
+         avail = (uInt)size;
+
+      memcpy(png_ptr->zstream.next_out, data, avail);
+      png_ptr->zstream.next_out += avail;
+      png_ptr->zstream.avail_out -= avail;
+      data += avail;
+      size -= avail;
+
+      if (png_ptr->zstream.avail_out == 0)
+      {
+         png_write_complete_chunk(png_ptr, png_IDAT,
+             png_ptr->zbuffer_list->output, png_ptr->zbuffer_size);
+         png_ptr->mode |= PNG_HAVE_IDAT;
+
+         png_ptr->zstream.next_out = png_ptr->zbuffer_list->output;
+         png_ptr->zstream.avail_out = png_ptr->zbuffer_size;
+      }
+   }
+}
+
+void /* PRIVATE */
+png_write_free_IDAT_bands(png_structrp png_ptr)
+{
+   png_deflate_bandsp bands =
+      png_voidcast(png_deflate_bandsp, png_ptr->IDAT_bands);
+
+   if (bands != NULL)
+   {
+      png_uint_32 i;
+
+      png_ptr->IDAT_bands = NULL;
+
+      for (i = 0; i < bands->max; ++i)
+         png_free(png_ptr, bands->band[i].output);
+
+      png_free(png_ptr, bands->buffer);
+      png_free(png_ptr, bands);
+   }
+}
+
+/* Decide whether to compress the image in bands; called on the first call to
+ * png_compress_IDAT.  Returns 0 if the image fits in a single band.
+ */
+static int
+png_start_IDAT_bands(png_structrp png_ptr)
+{
+   png_alloc_size_t row_size = png_ptr->rowbytes + 1;
+   png_alloc_size_t band_size, buffer_size;
+   png_uint_32 max = png_ptr->IDAT_band_jobs;
+   png_deflate_bandsp bands;
+   png_byte header[2];
+   unsigned int z_header;
+
+   if (png_ptr->IDAT_band_rows >= (PNG_SIZE_MAX / row_size) / max)
+      return 0; /* too large to buffer, so compress serially */
+
+   band_size = png_ptr->IDAT_band_rows * row_size;
+
+   if (png_image_size(png_ptr) <= band_size)
+      return 0;
+
+   /* A band is closed when it reaches band_size, so it may exceed that by at
+    * most one row.
+    */
+   buffer_size = max * (band_size + row_size);
+
+   bands = png_voidcast(png_deflate_bandsp, png_malloc(png_ptr,
+       (sizeof *bands) + (max-1) * (sizeof bands->band[0])));
+   memset(bands, 0, (sizeof *bands) + (max-1) * (sizeof bands->band[0]));
+   png_ptr->IDAT_bands = bands;
+
+   bands->buffer = png_voidcast(png_bytep, png_malloc(png_ptr, buffer_size));
+   bands->max = max;
+   bands->band_size = band_size;
+   bands->adler = adler32(0, Z_NULL, 0);
+   bands->level = png_ptr->zlib_level;
+   bands->window_bits = png_ptr->zlib_window_bits;
+   bands->mem_level = png_ptr->zlib_mem_level;
+   bands->strategy = png_IDAT_strategy(png_ptr);
+
+   /* zlib always uses a 512 byte window in place of the 256 byte one. */
+   if (bands->window_bits < 9)
+      bands->window_bits = 9;
+
+   /* The zlib header; this matches the one deflate would write. */
+   z_header = (Z_DEFLATED + ((bands->window_bits-8) << 4)) << 8;
+
+   if (bands->strategy >= Z_HUFFMAN_ONLY || (bands->level >= 0 &&
+       bands->level < 2))
+      z_header |= 0; /* FLEVEL 0: fastest */
+
+   else if (bands->level >= 0 && bands->level < 6)
+      z_header |= 1 << 6;
+
+   else if (bands->level == 6 || bands->level == Z_DEFAULT_COMPRESSION)
+      z_header |= 2 << 6;
+
+   else
+      z_header |= 3 << 6;
+
+   z_header += 31 - (z_header % 31);
+   header[0] = (png_byte)(z_header >> 8);
+   header[1] = (png_byte)(z_header & 0xff);
+
+   png_ptr->zowner = png_IDAT;
+   png_ptr->zstream.next_out = png_ptr->zbuffer_list->output;
+   png_ptr->zstream.avail_out = png_ptr->zbuffer_size;
+   png_write_IDAT_data(png_ptr, header, 2);
+
+   return 1;
+}
+
+/* Compress the closed bands and write the results. */
+static void
+png_deflate_IDAT_bands(png_structrp png_ptr, png_deflate_bandsp bands)
+{
+   png_uint_32 i;
+
+   for (i = 0; i < bands->count; ++i)
+      bands->band[i].png_ptr = png_ptr;
+
+   png_run_parallel(png_ptr, png_deflate_band_job, bands, bands->count);
+
+   for (i = 0; i < bands->count; ++i)
+   {
+      png_deflate_band *band = bands->band + i;
+
+      /* A job can only fail through lack of memory; try again here. */
+      if (band->ok == 0)
+      {
+         png_deflate_band_job(bands, i);
+
+         if (band->ok == 0)
+            png_error(png_ptr, "IDAT band compression failed");
+      }
+
+      png_write_IDAT_data(png_ptr, band->output, band->output_size);
+      bands->adler = adler32_combine(bands->adler, band->adler,
+          (z_off_t)band->input_size);
+
+      /* Output buffers are kept for the next batch unless they are large. */
+      if (band->output_size > 2 * bands->band_size)
+      {
+         png_free(png_ptr, band->output);
+         band->output = NULL;
+      }
+   }
+
+   bands->count = 0;
+   bands->buffer_used = bands->band_start = 0;
+}
+
+static void
+png_close_IDAT_band(png_deflate_bandsp bands, int flush)
+{
+   png_deflate_band *band = bands->band + bands->count++;
+
+   band->input = bands->buffer + bands->band_start;
+   band->input_size = bands->buffer_used - bands->band_start;
+   band->flush = flush;
+   bands->band_start = bands->buffer_used;
+}
+
+static void
+png_compress_IDAT_bands(png_structrp png_ptr, png_const_bytep input,
+    png_alloc_size_t input_len, int flush)
+{
+   png_deflate_bandsp bands =
+      png_voidcast(png_deflate_bandsp, png_ptr->IDAT_bands);
+
+   if (input_len > 0)
+   {
+      if (input_len > png_ptr->rowbytes + 1) /* not a row */
+         png_error(png_ptr, "IDAT band overflow");
+
+      memcpy(bands->buffer + bands->buffer_used, input, input_len);
+      bands->buffer_used += input_len;
+
+      if (bands->buffer_used - bands->band_start >= bands->band_size)
+      {
+         png_close_IDAT_band(bands, Z_FULL_FLUSH);
+
+         if (bands->count == bands->max)
+            png_deflate_IDAT_bands(png_ptr, bands);
+      }
+   }
+
+   if (flush == Z_FINISH)
+   {
+      png_byte adler[4];
+      png_uint_32 a;
+
+      /* The last band ends the stream, even if it is empty. */
+      png_close_IDAT_band(bands, Z_FINISH);
+      png_deflate_IDAT_bands(png_ptr, bands);
+
+      a = (png_uint_32)bands->adler;
+      adler[0] = (png_byte)((a >> 24) & 0xff);
+      adler[1] = (png_byte)((a >> 16) & 0xff);
+      adler[2] = (png_byte)((a >>  8) & 0xff);
+      adler[3] = (png_byte)( a        & 0xff);
+      png_write_IDAT_data(png_ptr, adler, 4);
+
+      if (png_ptr->zstream.avail_out < png_ptr->zbuffer_size)
+         png_write_complete_chunk(png_ptr, png_IDAT,
+             png_ptr->zbuffer_list->output,
+             png_ptr->zbuffer_size - png_ptr->zstream.avail_out);
+
+      png_ptr->zstream.avail_out = 0;
+      png_ptr->zstream.next_out = NULL;
+      png_ptr->mode |= PNG_HAVE_IDAT | PNG_AFTER_IDAT;
+      png_ptr->zowner = 0; /* Release the stream */
+
+      png_write_free_IDAT_bands(png_ptr);
+   }
+
+   else if (flush != Z_NO_FLUSH)
+   {
+      /* png_write_flush: close the open band and compress everything; as in
+       * the serial case the output stays in the buffer until a full IDAT
+       * chunk is available.
+       */
+      if (bands->buffer_used > bands->band_start)
+         png_close_IDAT_band(bands, Z_FULL_FLUSH);
+
+      png_deflate_IDAT_bands(png_ptr, bands);
+   }
+}
+#endif /* PARALLEL_DEFLATE */
+
+#ifdef PNG_WRITE_DEFLATE_CODEC_SUPPORTED
+/* With a deflate codec the filtered rows are collected and the whole stream
+ * is compressed at the end.  Returns 0 if the codec cannot be used, in which
+ * case the zlib stream is used instead.
+ */
+static int
+png_start_IDAT_codec(png_structrp png_ptr)
+{
+   png_alloc_size_t size = png_image_size(png_ptr);
+
+   if (png_ptr->deflate_codec_state == NULL)
+   {
+      png_ptr->deflate_codec_state = png_ptr->deflate_codec->init(png_ptr, 1,
+          png_ptr->zlib_level, png_IDAT_strategy(png_ptr));
+
+      if (png_ptr->deflate_codec_state == NULL)
+         return 0;
+   }
+
+   /* png_image_size returns 0xffffffff for large images; the buffer is grown
+    * as required.
+    */
+   if (size == 0xffffffffU)
+      size = png_ptr->rowbytes + 1;
+
+   png_ptr->IDAT_codec_data = png_voidcast(png_bytep,
+       png_malloc_base(png_ptr, size));
+
+   if (png_ptr->IDAT_codec_data == NULL)
+      return 0;
+
+   png_ptr->IDAT_codec_size = size;
+   png_ptr->IDAT_codec_used = 0;
+
+   png_ptr->zowner = png_IDAT;
+   png_ptr->zstream.next_out = png_ptr->zbuffer_list->output;
+   png_ptr->zstream.avail_out = png_ptr->zbuffer_size;
+
+   return 1;
+}
+
+static void
+png_compress_IDAT_codec(png_structrp png_ptr, png_const_bytep input,
+    png_alloc_size_t input_len, int flush)
+{
+   if (input_len > png_ptr->IDAT_codec_size - png_ptr->IDAT_codec_used)
+   {
+      png_alloc_size_t size = png_ptr->IDAT_codec_size;
+      png_bytep data;
+
+      if (input_len > PNG_SIZE_MAX - png_ptr->IDAT_codec_used)
+         png_error(png_ptr, "IDAT data too large");
+
+      if (size <= PNG_SIZE_MAX/2)
+         size *= 2;
+
+      if (size < png_ptr->IDAT_codec_used + input_len)
+         size = png_ptr->IDAT_codec_used + input_len;
+
+      data = png_voidcast(png_bytep, png_malloc(png_ptr, size));
+      memcpy(data, png_ptr->IDAT_codec_data, png_ptr->IDAT_codec_used);
+      png_free(png_ptr, png_ptr->IDAT_codec_data);
+      png_ptr->IDAT_codec_data = data;
+      png_ptr->IDAT_codec_size = size;
+   }
+
+   if (input_len > 0)
+   {
+      memcpy(png_ptr->IDAT_codec_data + png_ptr->IDAT_codec_used, input,
+          input_len);
+      png_ptr->IDAT_codec_used += input_len;
+   }
+
+   /* png_write_flush has no effect; nothing is output until the end. */
+   if (flush == Z_FINISH)
+   {
+      const png_deflate_codec *codec = png_ptr->deflate_codec;
+      png_bytep data = NULL;
+      png_alloc_size_t size = 0;
+      int ok;
+
+      ok = codec->compress(png_ptr->deflate_codec_state,
+          png_ptr->IDAT_codec_data, png_ptr->IDAT_codec_used, &data, &size);
+      codec->reset(png_ptr->deflate_codec_state);
+
+      /* The compressed data replaces the rows, so that it is freed by
+       * png_write_destroy if writing fails.
+       */
+      png_free(png_ptr, png_ptr->IDAT_codec_data);
+      png_ptr->IDAT_codec_data = data;
+
+      if (ok == 0)
+         png_error(png_ptr, "IDAT compression failed");
+
+#ifdef PNG_WRITE_OPTIMIZE_CMF_SUPPORTED
+      if (png_ptr->compression_type == PNG_COMPRESSION_TYPE_BASE && size >= 2)
+         optimize_cmf(data, png_image_size(png_ptr));
+#endif
+
+      png_write_IDAT_data(png_ptr, data, size);
+
+      if (png_ptr->zstream.avail_out < png_ptr->zbuffer_size)
+         png_write_complete_chunk(png_ptr, png_IDAT,
+             png_ptr->zbuffer_list->output,
+             png_ptr->zbuffer_size - png_ptr->zstream.avail_out);
+
+      png_ptr->zstream.avail_out = 0;
+      png_ptr->zstream.next_out = NULL;
+      png_ptr->mode |= PNG_HAVE_IDAT | PNG_AFTER_IDAT;
+      png_ptr->zowner = 0; /* Release the stream */
+
+      png_free(png_ptr, png_ptr->IDAT_codec_data);
+      png_ptr->IDAT_codec_data = NULL;
+   }
+}
+#endif /* WRITE_DEFLATE_CODEC */
+
 void /* PRIVATE */
 png_compress_IDAT(png_structrp png_ptr, png_const_bytep input,
     png_alloc_size_t input_len, int flush)
 {
+#ifdef PNG_WRITE_DEFLATE_CODEC_SUPPORTED
+   if (png_ptr->IDAT_codec_data != NULL)
+   {
+      png_compress_IDAT_codec(png_ptr, input, input_len, flush);
+      return;
+   }
+#endif
+
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+   if (png_ptr->IDAT_bands != NULL)
+   {
+      png_compress_IDAT_bands(png_ptr, input, input_len, flush);
+      return;
+   }
+#endif
+
    if (png_ptr->zowner != png_IDAT)
    {
       /* First time.   Ensure we have a temporary buffer for compression and
@@ -965,6 +1458,22 @@ png_compress_IDAT(png_structrp png_ptr, png_const_bytep input,
       else
          png_free_buffer_list(png_ptr, &png_ptr->zbuffer_list->next);
 
+#ifdef PNG_WRITE_DEFLATE_CODEC_SUPPORTED
+      if (png_ptr->deflate_codec != NULL && png_start_IDAT_codec(png_ptr) != 0)
+      {
+         png_compress_IDAT_codec(png_ptr, input, input_len, flush);
+         return;
+      }
+#endif
+
+#ifdef PNG_PARALLEL_DEFLATE_SUPPORTED
+      if (png_ptr->IDAT_band_rows > 0 && png_start_IDAT_bands(png_ptr) != 0)
+      {
+         png_compress_IDAT_bands(png_ptr, input, input_len, flush);
+         return;
+      }
+#endif
+
       /* It is a terminal error if we can't claim the zstream. */
       if (png_deflate_claim(png_ptr, png_IDAT, png_image_size(png_ptr)) != Z_OK)
          png_error(png_ptr, png_ptr->zstream.msg);
@@ -2038,6 +2547,10 @@ png_write_start_row(png_structrp png_ptr)
    if ((filters & (PNG_FILTER_AVG | PNG_FILTER_UP | PNG_FILTER_PAETH)) != 0)
       png_ptr->prev_row = png_voidcast(png_bytep,
           png_calloc(png_ptr, buf_size));
+
+#  ifdef PNG_WRITE_FILTER_OPTIMIZATIONS
+   PNG_WRITE_FILTER_OPTIMIZATIONS(png_ptr);
+#  endif
 #endif /* WRITE_FILTER */
 
 #ifdef PNG_WRITE_INTERLACING_SUPPORTED
@@ -2649,6 +3162,43 @@ png_write_find_filter(png_structrp png_ptr, png_row_infop row_info)
        */
       filter_to_do &= 0U-filter_to_do;
    }
+#ifdef PNG_WRITE_FILTER_OPTIMIZATIONS
+   else if (png_ptr->write_filter_sums != NULL &&
+         (filter_to_do & (filter_to_do-1)) != 0 &&
+         png_ptr->prev_row != NULL && png_ptr->try_row != NULL)
+   {
+      /* Several filters to try: find the sums for all of them in one pass,
+       * then filter the row once with the best.  The first filter with the
+       * lowest sum wins, as in the code below.
+       */
+      size_t sums[PNG_FILTER_VALUE_LAST];
+      int filter, best = PNG_FILTER_VALUE_NONE;
+
+      png_ptr->write_filter_sums(row_buf + 1, png_ptr->prev_row + 1,
+          row_bytes, bpp, sums);
+
+      for (filter = PNG_FILTER_VALUE_NONE; filter < PNG_FILTER_VALUE_LAST;
+           filter++)
+      {
+         if ((filter_to_do & (PNG_FILTER_NONE << filter)) != 0 &&
+             sums[filter] < mins)
+         {
+            mins = sums[filter];
+            best = filter;
+         }
+      }
+
+      if (best != PNG_FILTER_VALUE_NONE)
+      {
+         best_row = png_ptr->try_row;
+         best_row[0] = (png_byte)best;
+         png_ptr->write_filter_row(best_row + 1, row_buf + 1,
+             png_ptr->prev_row + 1, row_bytes, bpp, best);
+      }
+
+      filter_to_do = 0; /* done */
+   }
+#endif
    else if ((filter_to_do & PNG_FILTER_NONE) != 0 &&
          filter_to_do != PNG_FILTER_NONE)
    {